@@ -0,0 +1,372 @@
+// Bvh.cpp
+#include "Bvh.h"
+#include "CpuCulling.h"
+
+#include <algorithm>
+#include <array>
+#include <numeric>
+
+namespace {
+
+// Distance along the ray to the entry point of the box (0 if the origin is
+// inside), or a negative value if the ray misses it
+float intersectRay(const Aabb& box, const glm::vec3& origin, const glm::vec3& inverseDirection)
+{
+	const glm::vec3 t0 = (box.min - origin) * inverseDirection;
+	const glm::vec3 t1 = (box.max - origin) * inverseDirection;
+	const glm::vec3 tNear = glm::min(t0, t1);
+	const glm::vec3 tFar = glm::max(t0, t1);
+	const float entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+	const float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+	return entry <= exit ? entry : -1.0f;
+}
+
+enum class FrustumTest { Outside, Intersecting, Inside };
+
+FrustumTest testFrustum(const FrustumPlanes& frustum, const Aabb& box)
+{
+	FrustumTest result{ FrustumTest::Inside };
+	for (const glm::vec4& plane : frustum.planes) {
+		// Corners farthest along and against the plane normal
+		const glm::vec3 positive{ plane.x >= 0.0f ? box.max.x : box.min.x, plane.y >= 0.0f ? box.max.y : box.min.y, plane.z >= 0.0f ? box.max.z : box.min.z };
+		const glm::vec3 negative{ plane.x >= 0.0f ? box.min.x : box.max.x, plane.y >= 0.0f ? box.min.y : box.max.y, plane.z >= 0.0f ? box.min.z : box.max.z };
+		if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f) {
+			return FrustumTest::Outside;
+		}
+		if (glm::dot(glm::vec3(plane), negative) + plane.w < 0.0f) {
+			result = FrustumTest::Intersecting;
+		}
+	}
+	return result;
+}
+
+} // namespace
+
+float Aabb::surfaceArea() const
+{
+	const glm::vec3 extent = glm::max(max - min, glm::vec3(0.0f));
+	return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+bool Aabb::overlaps(const Aabb& other) const
+{
+	return glm::all(glm::lessThanEqual(min, other.max)) && glm::all(glm::lessThanEqual(other.min, max));
+}
+
+void Bvh::build(const std::vector<Aabb>& bounds)
+{
+	bounds_ = bounds;
+	rebuildCount_ = 0;
+	rebuild();
+}
+
+void Bvh::update(uint32_t object, const Aabb& bounds)
+{
+	if (bounds_[object] == bounds) {
+		return;
+	}
+	bounds_[object] = bounds;
+	dirtyLeaves_.push_back(leafOfObject_[object]);
+}
+
+bool Bvh::refit()
+{
+	if (dirtyLeaves_.empty()) {
+		return false;
+	}
+	for (uint32_t leaf : dirtyLeaves_) {
+		uint32_t nodeIndex = leaf;
+		while (nodeIndex != UINT32_MAX) {
+			Node& node = nodes_[nodeIndex];
+			Aabb refitted{};
+			if (node.count > 0) {
+				for (uint32_t i = node.first; i < node.first + node.count; i++) {
+					refitted.grow(bounds_[objects_[i]]);
+				}
+			} else {
+				refitted.grow(nodes_[node.first].bounds);
+				refitted.grow(nodes_[node.first + 1].bounds);
+			}
+			// Ancestors only change if this node did (a leaf listed twice stops here the second time)
+			if (refitted == node.bounds) {
+				break;
+			}
+			cost_ -= nodeCost(node);
+			node.bounds = refitted;
+			cost_ += nodeCost(node);
+			nodeIndex = node.parent;
+		}
+	}
+	dirtyLeaves_.clear();
+	if (getCostRatio() > builtCostRatio_ * rebuildThreshold) {
+		rebuild();
+		rebuildCount_++;
+		return true;
+	}
+	return false;
+}
+
+float Bvh::getCostRatio() const
+{
+	if (nodes_.empty()) {
+		return 0.0f;
+	}
+	const float rootArea = nodes_[0].bounds.surfaceArea();
+	return rootArea > 0.0f ? cost_ / rootArea : 0.0f;
+}
+
+float Bvh::nodeCost(const Node& node) const
+{
+	// Traversal and intersection are weighted equally
+	return node.bounds.surfaceArea() * static_cast<float>(node.count > 0 ? node.count : 1);
+}
+
+void Bvh::rebuild()
+{
+	const uint32_t objectCount = static_cast<uint32_t>(bounds_.size());
+	nodes_.clear();
+	dirtyLeaves_.clear();
+	objects_.resize(objectCount);
+	std::iota(objects_.begin(), objects_.end(), 0u);
+	leafOfObject_.resize(objectCount);
+	centroids_.resize(objectCount);
+	for (uint32_t i = 0; i < objectCount; i++) {
+		centroids_[i] = bounds_[i].center();
+	}
+	cost_ = 0.0f;
+	builtCostRatio_ = 0.0f;
+	if (objectCount == 0) {
+		return;
+	}
+	// A binary tree with at least one object per leaf has less than 2n nodes,
+	// so node references stay valid while splitting
+	nodes_.reserve(2 * static_cast<size_t>(objectCount));
+	nodes_.push_back({ .first = 0, .count = objectCount });
+	std::vector<uint32_t> stack{ 0 };
+	while (!stack.empty()) {
+		uint32_t nodeIndex = stack.back();
+		stack.pop_back();
+		split(nodeIndex);
+		if (nodes_[nodeIndex].count == 0) {
+			stack.push_back(nodes_[nodeIndex].first);
+			stack.push_back(nodes_[nodeIndex].first + 1);
+		}
+	}
+	for (const Node& node : nodes_) {
+		cost_ += nodeCost(node);
+	}
+	builtCostRatio_ = getCostRatio();
+}
+
+void Bvh::split(uint32_t nodeIndex)
+{
+	Node& node = nodes_[nodeIndex];
+	const uint32_t first = node.first;
+	const uint32_t count = node.count;
+	Aabb centroidBounds{};
+	for (uint32_t i = first; i < first + count; i++) {
+		node.bounds.grow(bounds_[objects_[i]]);
+		centroidBounds.grow({ centroids_[objects_[i]], centroids_[objects_[i]] });
+	}
+	auto makeLeaf = [&]() {
+		for (uint32_t i = first; i < first + count; i++) {
+			leafOfObject_[objects_[i]] = nodeIndex;
+		}
+	};
+	if (count <= maxLeafSize) {
+		makeLeaf();
+		return;
+	}
+
+	// Binned SAH: objects are sorted into bins by centroid along each axis,
+	// every boundary between bins is a split candidate
+	struct Bin {
+		Aabb bounds;
+		uint32_t count{ 0 };
+	};
+	const float leafCost = node.bounds.surfaceArea() * static_cast<float>(count);
+	float bestCost = std::numeric_limits<float>::max();
+	int bestAxis = -1;
+	uint32_t bestSplit = 0;
+	const glm::vec3 centroidExtent = centroidBounds.max - centroidBounds.min;
+	for (int axis = 0; axis < 3; axis++) {
+		if (centroidExtent[axis] <= 0.0f) {
+			continue;
+		}
+		const float binScale = static_cast<float>(binCount) / centroidExtent[axis];
+		std::array<Bin, binCount> bins{};
+		for (uint32_t i = first; i < first + count; i++) {
+			uint32_t bin = std::min(binCount - 1, static_cast<uint32_t>((centroids_[objects_[i]][axis] - centroidBounds.min[axis]) * binScale));
+			bins[bin].bounds.grow(bounds_[objects_[i]]);
+			bins[bin].count++;
+		}
+		// Sweep from the right, then evaluate every split from the left
+		std::array<float, binCount> rightCost{};
+		Aabb rightBounds{};
+		uint32_t rightCount{ 0 };
+		for (uint32_t b = binCount - 1; b > 0; b--) {
+			rightBounds.grow(bins[b].bounds);
+			rightCount += bins[b].count;
+			rightCost[b] = rightCount > 0 ? rightBounds.surfaceArea() * static_cast<float>(rightCount) : 0.0f;
+		}
+		Aabb leftBounds{};
+		uint32_t leftCount{ 0 };
+		for (uint32_t b = 1; b < binCount; b++) {
+			leftBounds.grow(bins[b - 1].bounds);
+			leftCount += bins[b - 1].count;
+			if (leftCount == 0 || leftCount == count) {
+				continue;
+			}
+			float cost = node.bounds.surfaceArea() + leftBounds.surfaceArea() * static_cast<float>(leftCount) + rightCost[b];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = b;
+			}
+		}
+	}
+
+	uint32_t leftCount{ 0 };
+	if (bestAxis >= 0) {
+		if (bestCost >= leafCost && count <= 4 * maxLeafSize) {
+			makeLeaf();
+			return;
+		}
+		const float binScale = static_cast<float>(binCount) / centroidExtent[bestAxis];
+		auto middle = std::partition(objects_.begin() + first, objects_.begin() + first + count, [&](uint32_t object) {
+			return std::min(binCount - 1, static_cast<uint32_t>((centroids_[object][bestAxis] - centroidBounds.min[bestAxis]) * binScale)) < bestSplit;
+		});
+		leftCount = static_cast<uint32_t>(middle - (objects_.begin() + first));
+	} else {
+		// All centroids coincide, split in the middle to bound the leaf size
+		leftCount = count / 2;
+	}
+
+	const uint32_t leftIndex = static_cast<uint32_t>(nodes_.size());
+	nodes_.push_back({ .first = first, .count = leftCount, .parent = nodeIndex });
+	nodes_.push_back({ .first = first + leftCount, .count = count - leftCount, .parent = nodeIndex });
+	nodes_[nodeIndex].first = leftIndex;
+	nodes_[nodeIndex].count = 0;
+}
+
+void Bvh::collect(uint32_t nodeIndex, std::vector<uint32_t>& objects) const
+{
+	std::vector<uint32_t> stack{ nodeIndex };
+	while (!stack.empty()) {
+		const Node& node = nodes_[stack.back()];
+		stack.pop_back();
+		if (node.count > 0) {
+			objects.insert(objects.end(), objects_.begin() + node.first, objects_.begin() + node.first + node.count);
+		} else {
+			stack.push_back(node.first);
+			stack.push_back(node.first + 1);
+		}
+	}
+}
+
+void Bvh::cullFrustum(const FrustumPlanes& frustum, std::vector<uint32_t>& visible) const
+{
+	visible.clear();
+	if (nodes_.empty()) {
+		return;
+	}
+	std::vector<uint32_t> stack{ 0 };
+	while (!stack.empty()) {
+		const uint32_t nodeIndex = stack.back();
+		stack.pop_back();
+		const Node& node = nodes_[nodeIndex];
+		FrustumTest test = testFrustum(frustum, node.bounds);
+		if (test == FrustumTest::Outside) {
+			continue;
+		}
+		if (test == FrustumTest::Inside) {
+			// Whole subtree visible, no further plane tests
+			collect(nodeIndex, visible);
+		} else if (node.count > 0) {
+			for (uint32_t i = node.first; i < node.first + node.count; i++) {
+				if (testFrustum(frustum, bounds_[objects_[i]]) != FrustumTest::Outside) {
+					visible.push_back(objects_[i]);
+				}
+			}
+		} else {
+			stack.push_back(node.first);
+			stack.push_back(node.first + 1);
+		}
+	}
+}
+
+bool Bvh::raycast(const glm::vec3& origin, const glm::vec3& direction, uint32_t& object, float& distance, const IntersectFn& intersect) const
+{
+	if (nodes_.empty()) {
+		return false;
+	}
+	const glm::vec3 inverseDirection = 1.0f / direction;
+	float nearest = std::numeric_limits<float>::max();
+	bool hit{ false };
+	std::vector<uint32_t> stack{ 0 };
+	while (!stack.empty()) {
+		const Node& node = nodes_[stack.back()];
+		stack.pop_back();
+		const float entry = intersectRay(node.bounds, origin, inverseDirection);
+		if (entry < 0.0f || entry >= nearest) {
+			continue;
+		}
+		if (node.count > 0) {
+			for (uint32_t i = node.first; i < node.first + node.count; i++) {
+				float objectDistance = intersectRay(bounds_[objects_[i]], origin, inverseDirection);
+				if (objectDistance < 0.0f || objectDistance >= nearest) {
+					continue;
+				}
+				if (intersect && !intersect(objects_[i], objectDistance)) {
+					continue;
+				}
+				if (objectDistance < nearest) {
+					nearest = objectDistance;
+					object = objects_[i];
+					hit = true;
+				}
+			}
+			continue;
+		}
+		// Visit the nearer child first so the farther one is more likely to be pruned
+		const float leftEntry = intersectRay(nodes_[node.first].bounds, origin, inverseDirection);
+		const float rightEntry = intersectRay(nodes_[node.first + 1].bounds, origin, inverseDirection);
+		if (leftEntry >= 0.0f && rightEntry >= 0.0f && leftEntry < rightEntry) {
+			stack.push_back(node.first + 1);
+			stack.push_back(node.first);
+		} else {
+			stack.push_back(node.first);
+			stack.push_back(node.first + 1);
+		}
+	}
+	if (hit) {
+		distance = nearest;
+	}
+	return hit;
+}
+
+void Bvh::queryRange(const Aabb& range, std::vector<uint32_t>& objects) const
+{
+	objects.clear();
+	if (nodes_.empty()) {
+		return;
+	}
+	std::vector<uint32_t> stack{ 0 };
+	while (!stack.empty()) {
+		const Node& node = nodes_[stack.back()];
+		stack.pop_back();
+		if (!node.bounds.overlaps(range)) {
+			continue;
+		}
+		if (node.count > 0) {
+			for (uint32_t i = node.first; i < node.first + node.count; i++) {
+				if (bounds_[objects_[i]].overlaps(range)) {
+					objects.push_back(objects_[i]);
+				}
+			}
+		} else {
+			stack.push_back(node.first);
+			stack.push_back(node.first + 1);
+		}
+	}
+}
@@ -0,0 +1,93 @@
+// Bvh.h
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+
+struct FrustumPlanes; // forward (CpuCulling.h)
+
+struct Aabb {
+    glm::vec3 min{ std::numeric_limits<float>::max() };
+    glm::vec3 max{ -std::numeric_limits<float>::max() };
+
+    static Aabb fromSphere(const glm::vec3& center, float radius) { return { center - glm::vec3(radius), center + glm::vec3(radius) }; }
+
+    void grow(const Aabb& other) { min = glm::min(min, other.min); max = glm::max(max, other.max); }
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    float surfaceArea() const;
+    bool overlaps(const Aabb& other) const;
+    bool operator==(const Aabb& other) const { return min == other.min && max == other.max; }
+};
+
+// Bounding volume hierarchy over object AABBs, for frustum culling, ray
+// picking and range queries on the CPU.
+//
+// The tree is built top down with a binned surface area heuristic. When
+// objects move, update() only records the new box; refit() then recomputes
+// the boxes on the paths from the changed leaves to the root, stopping early
+// where a parent doesn't change, so a few moving objects cost O(log n) each.
+// Refitting keeps the topology, so the tree degrades as objects drift apart.
+// refit() tracks the SAH cost incrementally and rebuilds the tree once it
+// exceeds the cost right after the last build by rebuildThreshold.
+class Bvh {
+public:
+    // Primitive test for raycast(): returns true and the distance along the
+    // ray if the ray hits the object, AABB hits are exact if not given
+    using IntersectFn = std::function<bool(uint32_t object, float& distance)>;
+
+    static constexpr float rebuildThreshold = 1.5f;
+
+    Bvh() = default;
+    ~Bvh() = default;
+
+    void build(const std::vector<Aabb>& bounds);
+    void update(uint32_t object, const Aabb& bounds);
+    // Apply pending updates. Returns true if the tree was rebuilt.
+    bool refit();
+
+    // Objects whose box intersects the frustum (in no particular order)
+    void cullFrustum(const FrustumPlanes& frustum, std::vector<uint32_t>& visible) const;
+    // Nearest object hit by the ray, false if none
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, uint32_t& object, float& distance, const IntersectFn& intersect = {}) const;
+    // Objects whose box overlaps the range
+    void queryRange(const Aabb& range, std::vector<uint32_t>& objects) const;
+
+    uint32_t getObjectCount() const { return static_cast<uint32_t>(bounds_.size()); }
+    uint32_t getNodeCount() const { return static_cast<uint32_t>(nodes_.size()); }
+    uint32_t getRebuildCount() const { return rebuildCount_; }
+    // Current SAH cost relative to the cost after the last build
+    float getCostRatio() const;
+
+private:
+    // Leaves hold count > 0 objects at objects_[first...]. Interior nodes have
+    // count == 0 and their children at first and first + 1.
+    struct Node {
+        Aabb bounds;
+        uint32_t first{ 0 };
+        uint32_t count{ 0 };
+        uint32_t parent{ UINT32_MAX };
+    };
+
+    static constexpr uint32_t maxLeafSize = 4;
+    static constexpr uint32_t binCount = 12;
+
+    void rebuild();
+    void split(uint32_t nodeIndex);
+    float nodeCost(const Node& node) const;
+    void collect(uint32_t nodeIndex, std::vector<uint32_t>& objects) const;
+
+    std::vector<Node> nodes_;
+    std::vector<Aabb> bounds_;            // per object
+    std::vector<uint32_t> objects_;       // object indices, grouped by leaf
+    std::vector<uint32_t> leafOfObject_;  // per object
+    std::vector<uint32_t> dirtyLeaves_;
+    std::vector<glm::vec3> centroids_;    // scratch for builds
+    // Sum of the cost terms of all nodes (area * objects for leaves, area for
+    // interior nodes), and its value relative to the root area after a build
+    float cost_{ 0.0f };
+    float builtCostRatio_{ 0.0f };
+    uint32_t rebuildCount_{ 0 };
+};
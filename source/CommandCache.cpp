@@ -0,0 +1,60 @@
+// CommandCache.cpp
+#include "CommandCache.h"
+
+#include <volk/volk.h>
+#include <iostream>
+
+CommandCache::~CommandCache()
+{
+	destroy();
+}
+
+bool CommandCache::create(VkDevice device, uint32_t queueFamilyIndex, uint32_t frameCount)
+{
+	device_ = device;
+	frameCount_ = frameCount;
+	// Buffers are reset one by one when they are recorded again
+	pool_ = CommandPool(device, queueFamilyIndex, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+	if (pool_.getPool() == VK_NULL_HANDLE) {
+		std::cerr << "Failed to create command cache pool" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void CommandCache::destroy()
+{
+	pool_.destroy();
+	buffers_.clear();
+	recorded_.clear();
+	imageCount_ = 0;
+	version_ = UINT64_MAX;
+}
+
+void CommandCache::validate(uint64_t version, uint32_t imageCount)
+{
+	if (version == version_ && imageCount == imageCount_) {
+		return;
+	}
+	// Recorded buffers may still be pending on the queue, they are left alone
+	// until get() hands them out for their own frame slot again
+	uint32_t required = imageCount * frameCount_;
+	if (buffers_.size() < required) {
+		auto allocated = pool_.allocate(device_, required - static_cast<uint32_t>(buffers_.size()));
+		buffers_.insert(buffers_.end(), allocated.begin(), allocated.end());
+	}
+	recorded_.assign(buffers_.size(), false);
+	imageCount_ = imageCount;
+	version_ = version;
+}
+
+VkCommandBuffer CommandCache::get(uint32_t imageIndex, uint32_t frameIndex, bool& needsRecording)
+{
+	uint32_t index = imageIndex * frameCount_ + frameIndex;
+	needsRecording = !recorded_[index];
+	if (needsRecording) {
+		recorded_[index] = true;
+		recordCount_++;
+	}
+	return buffers_[index];
+}
@@ -0,0 +1,57 @@
+// CommandCache.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+#include "CommandPool.h"
+
+// Pre-recorded primary command buffers, one per (swapchain image, frame slot)
+// pair. A frame's commands only depend on which swapchain image and which
+// shader data buffer (through its device address) it uses, so for a static
+// scene they can be recorded once and resubmitted every frame while the
+// per-frame data is updated in place.
+//
+// The recordings are tagged with a version supplied by the caller. Anything
+// that changes what would be recorded (swapchain recreation, render graph
+// recompilation, a different draw list) has to change that version.
+class CommandCache {
+public:
+    CommandCache() = default;
+    ~CommandCache();
+
+    // Non-copyable
+    CommandCache(const CommandCache&) = delete;
+    CommandCache& operator=(const CommandCache&) = delete;
+
+    bool create(VkDevice device, uint32_t queueFamilyIndex, uint32_t frameCount);
+
+    // Destroy the pool. The device must be idle.
+    void destroy();
+
+    // Drop all recordings if version or image count changed since the last
+    // call. Doesn't wait: the buffers are only marked stale, each one is reset
+    // when it is recorded again.
+    void validate(uint64_t version, uint32_t imageCount);
+
+    // Command buffer for the pair. needsRecording is set if the buffer has not
+    // been recorded since the last invalidation; the caller then records it
+    // (without ONE_TIME_SUBMIT, vkBeginCommandBuffer resets it) and the buffer
+    // counts as recorded from then on. A buffer is only ever submitted with
+    // its frame slot, so once the slot's fence has been waited on it is no
+    // longer pending and can be re-recorded.
+    VkCommandBuffer get(uint32_t imageIndex, uint32_t frameIndex, bool& needsRecording);
+
+    // Number of buffers recorded since creation, for diagnostics
+    uint64_t getRecordCount() const { return recordCount_; }
+
+private:
+    VkDevice device_{ VK_NULL_HANDLE };
+    CommandPool pool_;
+    uint32_t frameCount_{ 0 };
+    uint32_t imageCount_{ 0 };
+    uint64_t version_{ UINT64_MAX };
+    std::vector<VkCommandBuffer> buffers_;    // imageIndex * frameCount + frameIndex
+    std::vector<bool> recorded_;
+    uint64_t recordCount_{ 0 };
+};
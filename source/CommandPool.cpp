@@ -52,14 +52,14 @@ void CommandPool::destroy()
 	}
 }
 
-std::vector<VkCommandBuffer> CommandPool::allocate(VkDevice device, uint32_t count) const
+std::vector<VkCommandBuffer> CommandPool::allocate(VkDevice device, uint32_t count, VkCommandBufferLevel level) const
 {
 	if (pool_ == VK_NULL_HANDLE) return {};
 	std::vector<VkCommandBuffer> buffers(count);
 	VkCommandBufferAllocateInfo ai{};
 	ai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	ai.commandPool = pool_;
-	ai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	ai.level = level;
 	ai.commandBufferCount = count;
 
 	VkResult r = vkAllocateCommandBuffers(device, &ai, buffers.data());
@@ -69,3 +69,9 @@ std::vector<VkCommandBuffer> CommandPool::allocate(VkDevice device, uint32_t cou
 	}
 	return buffers;
 }
+
+VkResult CommandPool::reset(VkCommandPoolResetFlags flags) const
+{
+	if (device_ == VK_NULL_HANDLE || pool_ == VK_NULL_HANDLE) return VK_ERROR_INITIALIZATION_FAILED;
+	return vkResetCommandPool(device_, pool_, flags);
+}
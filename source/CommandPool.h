@@ -19,8 +19,12 @@ public:
     CommandPool(CommandPool&& other) noexcept;
     CommandPool& operator=(CommandPool&& other) noexcept;
 
-    // Allocate `count` primary command buffers from the owned pool.
-    std::vector<VkCommandBuffer> allocate(VkDevice device, uint32_t count) const;
+    // Allocate `count` command buffers (primary by default) from the owned pool.
+    std::vector<VkCommandBuffer> allocate(VkDevice device, uint32_t count, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY) const;
+
+    // Reset the pool, returning all of its command buffers to the initial state
+    // in one call. Cheaper than resetting the buffers one by one.
+    VkResult reset(VkCommandPoolResetFlags flags = 0) const;
 
     // Access underlying VkCommandPool
     VkCommandPool getPool() const { return pool_; }
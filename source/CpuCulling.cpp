@@ -0,0 +1,206 @@
+// CpuCulling.cpp
+#include "CpuCulling.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CPU_CULLING_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CPU_CULLING_SSE2
+#endif
+
+namespace {
+
+#if defined(CPU_CULLING_AVX2)
+constexpr uint32_t simdWidth = 8;
+#elif defined(CPU_CULLING_SSE2)
+constexpr uint32_t simdWidth = 4;
+#else
+constexpr uint32_t simdWidth = 1;
+#endif
+
+} // namespace
+
+FrustumPlanes FrustumPlanes::fromViewProjection(const glm::mat4& viewProjection)
+{
+	// glm matrices are column major, row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+	auto row = [&](int i) { return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]); };
+	FrustumPlanes frustum{};
+	frustum.planes = { row(3) + row(0), row(3) - row(0), row(3) + row(1), row(3) - row(1), row(3) + row(2), row(3) - row(2) };
+	for (auto& plane : frustum.planes) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return frustum;
+}
+
+void CpuCulling::resize(uint32_t count)
+{
+	const size_t padded = (static_cast<size_t>(count) + simdWidth - 1) / simdWidth * simdWidth;
+	centerX_.resize(padded, 0.0f);
+	centerY_.resize(padded, 0.0f);
+	centerZ_.resize(padded, 0.0f);
+	radius_.resize(padded, 0.0f);
+	count_ = count;
+}
+
+void CpuCulling::setBounds(uint32_t index, const glm::vec3& center, float radius)
+{
+	centerX_[index] = center.x;
+	centerY_[index] = center.y;
+	centerZ_[index] = center.z;
+	radius_[index] = radius;
+}
+
+uint32_t CpuCulling::cull(const FrustumPlanes& frustum, uint32_t* visible) const
+{
+	uint32_t visibleCount{ 0 };
+#if defined(CPU_CULLING_AVX2)
+	for (uint32_t base = 0; base < count_; base += simdWidth) {
+		const __m256 x = _mm256_loadu_ps(&centerX_[base]);
+		const __m256 y = _mm256_loadu_ps(&centerY_[base]);
+		const __m256 z = _mm256_loadu_ps(&centerZ_[base]);
+		const __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&radius_[base]));
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (const glm::vec4& plane : frustum.planes) {
+			__m256 distance = _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane.x)), _mm256_mul_ps(y, _mm256_set1_ps(plane.y)));
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(z, _mm256_set1_ps(plane.z)));
+			distance = _mm256_add_ps(distance, _mm256_set1_ps(plane.w));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+		}
+		uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(inside));
+		if (count_ - base < simdWidth) {
+			mask &= (1u << (count_ - base)) - 1;
+		}
+		while (mask != 0) {
+			visible[visibleCount++] = base + static_cast<uint32_t>(std::countr_zero(mask));
+			mask &= mask - 1;
+		}
+	}
+#elif defined(CPU_CULLING_SSE2)
+	for (uint32_t base = 0; base < count_; base += simdWidth) {
+		const __m128 x = _mm_loadu_ps(&centerX_[base]);
+		const __m128 y = _mm_loadu_ps(&centerY_[base]);
+		const __m128 z = _mm_loadu_ps(&centerZ_[base]);
+		const __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radius_[base]));
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (const glm::vec4& plane : frustum.planes) {
+			__m128 distance = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y)));
+			distance = _mm_add_ps(distance, _mm_mul_ps(z, _mm_set1_ps(plane.z)));
+			distance = _mm_add_ps(distance, _mm_set1_ps(plane.w));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+		}
+		uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(inside));
+		if (count_ - base < simdWidth) {
+			mask &= (1u << (count_ - base)) - 1;
+		}
+		while (mask != 0) {
+			visible[visibleCount++] = base + static_cast<uint32_t>(std::countr_zero(mask));
+			mask &= mask - 1;
+		}
+	}
+#else
+	for (uint32_t i = 0; i < count_; i++) {
+		bool inside{ true };
+		for (const glm::vec4& plane : frustum.planes) {
+			inside &= centerX_[i] * plane.x + centerY_[i] * plane.y + centerZ_[i] * plane.z + plane.w >= -radius_[i];
+		}
+		// Branchless compaction, the slot is overwritten if the sphere is outside
+		visible[visibleCount] = i;
+		visibleCount += inside ? 1 : 0;
+	}
+#endif
+	return visibleCount;
+}
+
+void CpuCulling::cull(const glm::mat4& viewProjection, std::vector<uint32_t>& visible) const
+{
+	visible.resize(count_);
+	visible.resize(cull(FrustumPlanes::fromViewProjection(viewProjection), visible.data()));
+}
+
+const char* CpuCulling::getInstructionSet()
+{
+#if defined(CPU_CULLING_AVX2)
+	return "AVX2";
+#elif defined(CPU_CULLING_SSE2)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+void runCullingBenchmark()
+{
+	struct Sphere {
+		glm::vec3 center;
+		float radius;
+	};
+	// Camera in front of a cube of random spheres, roughly half of them are visible
+	const glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 400.0f) * glm::lookAt(glm::vec3(0.0f, 0.0f, -150.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	const FrustumPlanes frustum = FrustumPlanes::fromViewProjection(viewProjection);
+	std::cout << "CPU frustum culling benchmark (" << CpuCulling::getInstructionSet() << ")\n";
+
+	for (uint32_t count : { 1000u, 10000u, 100000u, 1000000u }) {
+		std::mt19937 rng{ 1234 };
+		std::uniform_real_distribution<float> position{ -100.0f, 100.0f };
+		std::uniform_real_distribution<float> radius{ 0.5f, 2.0f };
+		std::vector<Sphere> spheres(count);
+		CpuCulling culling;
+		culling.resize(count);
+		for (uint32_t i = 0; i < count; i++) {
+			spheres[i] = { glm::vec3(position(rng), position(rng), position(rng)), radius(rng) };
+			culling.setBounds(i, spheres[i].center, spheres[i].radius);
+		}
+		// Same number of culled instances for every size
+		const uint32_t iterations = std::max(10000000u / count, 10u);
+
+		std::vector<uint32_t> naiveVisible;
+		naiveVisible.reserve(count);
+		auto naiveStart = std::chrono::steady_clock::now();
+		for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+			naiveVisible.clear();
+			for (uint32_t i = 0; i < count; i++) {
+				bool inside{ true };
+				for (const glm::vec4& plane : frustum.planes) {
+					if (glm::dot(glm::vec3(plane), spheres[i].center) + plane.w < -spheres[i].radius) {
+						inside = false;
+						break;
+					}
+				}
+				if (inside) {
+					naiveVisible.push_back(i);
+				}
+			}
+		}
+		auto naiveTime = std::chrono::steady_clock::now() - naiveStart;
+
+		std::vector<uint32_t> visible(count);
+		uint32_t visibleCount{ 0 };
+		auto soaStart = std::chrono::steady_clock::now();
+		for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+			visibleCount = culling.cull(frustum, visible.data());
+		}
+		auto soaTime = std::chrono::steady_clock::now() - soaStart;
+
+		using us = std::chrono::duration<double, std::micro>;
+		const double culled = static_cast<double>(count) * iterations;
+		const double naiveRate = culled / us(naiveTime).count();
+		const double soaRate = culled / us(soaTime).count();
+		std::cout << count << " instances (" << visibleCount << " visible): "
+			<< "AoS glm " << naiveRate << " per us, "
+			<< "SoA " << soaRate << " per us, "
+			<< soaRate / naiveRate << "x";
+		if (visibleCount != naiveVisible.size()) {
+			// Can differ for spheres touching a plane, the two loops round differently
+			std::cout << " (AoS loop found " << naiveVisible.size() << " visible)";
+		}
+		std::cout << "\n";
+	}
+}
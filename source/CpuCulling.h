@@ -0,0 +1,60 @@
+// CpuCulling.h
+#pragma once
+
+#include <glm/glm.hpp>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// View frustum as six inward facing planes (xyz normal, w distance), normalized
+// so that dot(plane.xyz, p) + plane.w is the signed distance of p
+struct FrustumPlanes {
+    std::array<glm::vec4, 6> planes{};
+
+    // Gribb/Hartmann extraction from a view projection matrix. The projection
+    // uses a 0..1 clip depth (GLM_FORCE_DEPTH_ZERO_TO_ONE), whose near plane
+    // is z >= 0. The near plane extracted here is w + z >= 0, which lies behind
+    // it, so spheres just in front of the camera may be kept but visible ones
+    // are never culled.
+    static FrustumPlanes fromViewProjection(const glm::mat4& viewProjection);
+};
+
+// CPU frustum culling of bounding spheres, for when GPU culling isn't
+// available. Spheres are stored as structure of arrays (center x/y/z, radius)
+// so each plane test covers 8 (AVX2) or 4 (SSE2) spheres with one instruction
+// per component. The instruction set is chosen at compile time (USE_AVX2 in
+// CMake), other targets use a scalar loop over the same arrays.
+class CpuCulling {
+public:
+    CpuCulling() = default;
+    ~CpuCulling() = default;
+
+    // Number of spheres. New spheres are zero sized at the origin.
+    void resize(uint32_t count);
+    uint32_t getCount() const { return count_; }
+
+    // World space bounding sphere of an instance
+    void setBounds(uint32_t index, const glm::vec3& center, float radius);
+
+    // Write the indices of all spheres intersecting the frustum, in ascending
+    // order, to visible (which must hold getCount() entries). Returns the
+    // number of visible spheres.
+    uint32_t cull(const FrustumPlanes& frustum, uint32_t* visible) const;
+    void cull(const glm::mat4& viewProjection, std::vector<uint32_t>& visible) const;
+
+    // Instruction set the culling loop was built for
+    static const char* getInstructionSet();
+
+private:
+    // Padded to a multiple of the SIMD width so full vectors can be loaded
+    std::vector<float> centerX_;
+    std::vector<float> centerY_;
+    std::vector<float> centerZ_;
+    std::vector<float> radius_;
+    uint32_t count_{ 0 };
+};
+
+// Microbenchmark (--bench-cull): culls random spheres with CpuCulling and with
+// a naive loop over an array of glm spheres, and prints instances culled per
+// microsecond for both
+void runCullingBenchmark();
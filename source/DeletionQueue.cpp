@@ -0,0 +1,78 @@
+// DeletionQueue.cpp
+#include "DeletionQueue.h"
+
+#include <volk/volk.h>
+
+void DeletionQueue::create(VkDevice device, VmaAllocator allocator)
+{
+	device_ = device;
+	allocator_ = allocator;
+}
+
+void DeletionQueue::destroy()
+{
+	for (auto& entry : entries_) {
+		entry.destroy();
+	}
+	entries_.clear();
+}
+
+void DeletionQueue::retireBuffer(VkBuffer buffer, VmaAllocation allocation)
+{
+	if (buffer != VK_NULL_HANDLE) {
+		retire([allocator = allocator_, buffer, allocation]() { vmaDestroyBuffer(allocator, buffer, allocation); });
+	}
+}
+
+void DeletionQueue::retireImage(VkImage image, VmaAllocation allocation)
+{
+	if (image == VK_NULL_HANDLE) {
+		return;
+	}
+	if (allocation != VK_NULL_HANDLE) {
+		retire([allocator = allocator_, image, allocation]() { vmaDestroyImage(allocator, image, allocation); });
+	} else {
+		retire([device = device_, image]() { vkDestroyImage(device, image, nullptr); });
+	}
+}
+
+void DeletionQueue::retireMemory(VmaAllocation allocation)
+{
+	if (allocation != VK_NULL_HANDLE) {
+		retire([allocator = allocator_, allocation]() { vmaFreeMemory(allocator, allocation); });
+	}
+}
+
+void DeletionQueue::retireImageView(VkImageView view)
+{
+	if (view != VK_NULL_HANDLE) {
+		retire([device = device_, view]() { vkDestroyImageView(device, view, nullptr); });
+	}
+}
+
+void DeletionQueue::retirePipeline(VkPipeline pipeline)
+{
+	if (pipeline != VK_NULL_HANDLE) {
+		retire([device = device_, pipeline]() { vkDestroyPipeline(device, pipeline, nullptr); });
+	}
+}
+
+void DeletionQueue::retireSwapchain(VkSwapchainKHR swapchain)
+{
+	if (swapchain != VK_NULL_HANDLE) {
+		retire([device = device_, swapchain]() { vkDestroySwapchainKHR(device, swapchain, nullptr); });
+	}
+}
+
+void DeletionQueue::retire(std::function<void()>&& destroy)
+{
+	entries_.push_back({ .frame = frame_, .destroy = std::move(destroy) });
+}
+
+void DeletionQueue::collect(uint64_t pendingFrame)
+{
+	while (!entries_.empty() && entries_.front().frame < pendingFrame) {
+		entries_.front().destroy();
+		entries_.pop_front();
+	}
+}
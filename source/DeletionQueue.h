@@ -0,0 +1,54 @@
+// DeletionQueue.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vma/vk_mem_alloc.h>
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+// Deferred destruction of objects that frames in flight may still use.
+// Frames are numbered in submission order; everything retired while frame N
+// is being prepared is destroyed by collect() once frame N has completed, so
+// replacing a resource (resize, reload, growth) doesn't need vkDeviceWaitIdle.
+//
+// The renderer calls nextFrame() after each submit and collect() after each
+// fence wait with the number of the oldest frame that may still be executing.
+class DeletionQueue {
+public:
+    DeletionQueue() = default;
+    ~DeletionQueue() = default;
+
+    void create(VkDevice device, VmaAllocator allocator);
+    // Destroys everything still queued, the device has to be idle
+    void destroy();
+
+    void retireBuffer(VkBuffer buffer, VmaAllocation allocation);
+    // Without an allocation only the image is destroyed, its memory is owned elsewhere
+    void retireImage(VkImage image, VmaAllocation allocation = VK_NULL_HANDLE);
+    void retireMemory(VmaAllocation allocation);
+    void retireImageView(VkImageView view);
+    void retirePipeline(VkPipeline pipeline);
+    void retireSwapchain(VkSwapchainKHR swapchain);
+    // Anything else, run once the current frame has completed
+    void retire(std::function<void()>&& destroy);
+
+    // Frame currently being prepared, incremented by nextFrame()
+    uint64_t getFrame() const { return frame_; }
+    void nextFrame() { frame_++; }
+    // Destroy everything retired before frame pendingFrame, i.e. by frames
+    // that are known to have completed
+    void collect(uint64_t pendingFrame);
+
+private:
+    struct Entry {
+        uint64_t frame{ 0 };
+        std::function<void()> destroy;
+    };
+
+    VkDevice device_{ VK_NULL_HANDLE };
+    VmaAllocator allocator_{ VK_NULL_HANDLE };
+    uint64_t frame_{ 0 };
+    // Ordered by frame, entries are only ever appended for the current one
+    std::deque<Entry> entries_;
+};
@@ -0,0 +1,109 @@
+// FrameAllocator.cpp
+#include "FrameAllocator.h"
+
+#include <volk/volk.h>
+#include <algorithm>
+#include <iostream>
+
+bool FrameAllocator::create(VkDevice device, VmaAllocator allocator, VkDeviceSize blockSize, VkBufferUsageFlags usage)
+{
+	device_ = device;
+	allocator_ = allocator;
+	blockSize_ = blockSize;
+	usage_ = usage | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+	for (auto& slot : slots_) {
+		slot.blocks.resize(1);
+		if (!createBlock(slot.blocks[0], blockSize_)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void FrameAllocator::destroy()
+{
+	for (auto& slot : slots_) {
+		for (auto& block : slot.blocks) {
+			if (block.buffer != VK_NULL_HANDLE) {
+				vmaDestroyBuffer(allocator_, block.buffer, block.allocation);
+			}
+		}
+		slot = {};
+	}
+}
+
+bool FrameAllocator::createBlock(Block& block, VkDeviceSize size)
+{
+	VkBufferCreateInfo bufferCI{ .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = size, .usage = usage_ };
+	VmaAllocationCreateInfo allocCI{
+		.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+		.usage = VMA_MEMORY_USAGE_AUTO
+	};
+	VmaAllocationInfo allocInfo{};
+	VkResult r = vmaCreateBuffer(allocator_, &bufferCI, &allocCI, &block.buffer, &block.allocation, &allocInfo);
+	if (r != VK_SUCCESS) {
+		std::cerr << "Failed to create frame allocator block: " << r << std::endl;
+		block = {};
+		return false;
+	}
+	block.mapped = allocInfo.pMappedData;
+	block.size = size;
+	VkMemoryPropertyFlags memoryFlags{ 0 };
+	vmaGetAllocationMemoryProperties(allocator_, block.allocation, &memoryFlags);
+	block.coherent = (memoryFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+	VkBufferDeviceAddressInfo bdaInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = block.buffer };
+	block.deviceAddress = vkGetBufferDeviceAddress(device_, &bdaInfo);
+	return true;
+}
+
+void FrameAllocator::reset(uint32_t frameIndex)
+{
+	Slot& slot = slots_[frameIndex];
+	for (auto& block : slot.blocks) {
+		block.used = 0;
+	}
+	slot.current = 0;
+}
+
+FrameAllocation FrameAllocator::allocate(uint32_t frameIndex, VkDeviceSize size, VkDeviceSize alignment)
+{
+	Slot& slot = slots_[frameIndex];
+	// Blocks are filled front to back; one that is too small for this request
+	// stays as it is for the rest of the frame
+	while (slot.current < slot.blocks.size()) {
+		Block& block = slot.blocks[slot.current];
+		const VkDeviceSize offset = (block.used + alignment - 1) / alignment * alignment;
+		if (offset + size <= block.size) {
+			block.used = offset + size;
+			return { .mapped = static_cast<uint8_t*>(block.mapped) + offset, .deviceAddress = block.deviceAddress + offset, .buffer = block.buffer, .offset = offset };
+		}
+		slot.current++;
+	}
+	Block block{};
+	if (!createBlock(block, std::max(blockSize_, size))) {
+		slot.current = slot.blocks.size() - 1;
+		return {};
+	}
+	block.used = size;
+	slot.blocks.push_back(block);
+	version_++;
+	return { .mapped = block.mapped, .deviceAddress = block.deviceAddress, .buffer = block.buffer, .offset = 0 };
+}
+
+void FrameAllocator::flush(uint32_t frameIndex)
+{
+	for (const auto& block : slots_[frameIndex].blocks) {
+		if (!block.coherent && block.used > 0) {
+			vmaFlushAllocation(allocator_, block.allocation, 0, block.used);
+		}
+	}
+}
+
+VkDeviceSize FrameAllocator::getUsed(uint32_t frameIndex) const
+{
+	VkDeviceSize used{ 0 };
+	for (const auto& block : slots_[frameIndex].blocks) {
+		used += block.used;
+	}
+	return used;
+}
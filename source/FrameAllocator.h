@@ -0,0 +1,83 @@
+// FrameAllocator.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vma/vk_mem_alloc.h>
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "VulkanApp.h" // for maxFramesInFlight
+
+// Region handed out by FrameAllocator. Valid until the slot is reset.
+struct FrameAllocation {
+    void* mapped{ nullptr };
+    VkDeviceAddress deviceAddress{ 0 };
+    VkBuffer buffer{ VK_NULL_HANDLE };
+    VkDeviceSize offset{ 0 };
+};
+
+// Linear allocator for data that only lives for one frame (per-pass
+// constants, per-draw parameters etc.). Each frame slot owns a chain of
+// persistently mapped, host-visible blocks; allocate() bumps an offset in the
+// current block and moves on to the next one (creating it if needed) when the
+// request doesn't fit. reset() rewinds the slot once its fence has signaled,
+// the blocks are kept, so after the first few frames nothing is allocated.
+//
+// Allocations are handed out in call order, so a frame that makes the same
+// requests as the previous one in that slot gets the same addresses. Adding a
+// block changes the layout, getVersion() changes whenever that happens.
+class FrameAllocator {
+public:
+    FrameAllocator() = default;
+    ~FrameAllocator() = default;
+
+    bool create(VkDevice device, VmaAllocator allocator, VkDeviceSize blockSize = 64 * 1024, VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    void destroy();
+
+    // Only call once the last frame submitted with this slot has completed
+    void reset(uint32_t frameIndex);
+    // Returns an empty allocation (mapped == nullptr) if a new block can't be created
+    FrameAllocation allocate(uint32_t frameIndex, VkDeviceSize size, VkDeviceSize alignment = minAlignment);
+    template <typename T>
+    FrameAllocation push(uint32_t frameIndex, const T& value)
+    {
+        FrameAllocation allocation = allocate(frameIndex, sizeof(T), alignof(T) > minAlignment ? alignof(T) : minAlignment);
+        if (allocation.mapped != nullptr) {
+            *static_cast<T*>(allocation.mapped) = value;
+        }
+        return allocation;
+    }
+    // Make the slot's writes visible to the device, needed before submit if
+    // the memory isn't host coherent
+    void flush(uint32_t frameIndex);
+
+    uint32_t getVersion() const { return version_; }
+    // Bytes handed out since the slot's last reset, including alignment padding
+    VkDeviceSize getUsed(uint32_t frameIndex) const;
+
+private:
+    struct Block {
+        VkBuffer buffer{ VK_NULL_HANDLE };
+        VmaAllocation allocation{ VK_NULL_HANDLE };
+        VkDeviceAddress deviceAddress{ 0 };
+        void* mapped{ nullptr };
+        VkDeviceSize size{ 0 };
+        VkDeviceSize used{ 0 };
+        bool coherent{ true };
+    };
+    struct Slot {
+        std::vector<Block> blocks;
+        size_t current{ 0 };
+    };
+
+    bool createBlock(Block& block, VkDeviceSize size);
+
+    static constexpr VkDeviceSize minAlignment = 16;
+
+    VkDevice device_{ VK_NULL_HANDLE };
+    VmaAllocator allocator_{ VK_NULL_HANDLE };
+    VkDeviceSize blockSize_{ 0 };
+    VkBufferUsageFlags usage_{ 0 };
+    std::array<Slot, VulkanApp::maxFramesInFlight> slots_{};
+    uint32_t version_{ 0 };
+};
@@ -0,0 +1,392 @@
+// GpuCulling.cpp
+#include "GpuCulling.h"
+#include "DeletionQueue.h"
+#include "FrameAllocator.h"
+#include "Pipeline.h"
+
+#include <volk/volk.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+struct PyramidParams {
+	int32_t sourceSize[2];
+	int32_t destinationSize[2];
+};
+
+} // namespace
+
+bool GpuCulling::create(VkPhysicalDevice physicalDevice, VkDevice device, VmaAllocator allocator, PipelineCache* pipelineCache, VkShaderModule shaderModule, VkFormat depthFormat, bool occlusion)
+{
+	device_ = device;
+	allocator_ = allocator;
+	depthFormat_ = depthFormat;
+
+	// The pyramid is built by sampling the depth buffer
+	VkFormatProperties depthProps{};
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, depthFormat, &depthProps);
+	occlusion_ = occlusion && (depthProps.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+	if (occlusion && !occlusion_) {
+		std::cerr << "Depth format can't be sampled, disabling occlusion culling\n";
+	}
+
+	// Binding 0: pyramid level (or depth buffer) to read, binding 1: pyramid level to write
+	const VkDescriptorSetLayoutBinding bindings[] = {
+		{ .binding = 0, .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT },
+		{ .binding = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT },
+	};
+	VkDescriptorSetLayoutCreateInfo setLayoutCI{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, .bindingCount = 2, .pBindings = bindings };
+	if (vkCreateDescriptorSetLayout(device, &setLayoutCI, nullptr, &setLayout_) != VK_SUCCESS) {
+		std::cerr << "vkCreateDescriptorSetLayout failed (culling)\n";
+		return false;
+	}
+	VkPushConstantRange pyramidPush{ .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .size = sizeof(PyramidParams) };
+	VkPipelineLayoutCreateInfo pyramidLayoutCI{ .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, .setLayoutCount = 1, .pSetLayouts = &setLayout_, .pushConstantRangeCount = 1, .pPushConstantRanges = &pyramidPush };
+	VkPushConstantRange cullPush{ .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .size = sizeof(VkDeviceAddress) };
+	VkPipelineLayoutCreateInfo cullLayoutCI{ .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, .setLayoutCount = 1, .pSetLayouts = &setLayout_, .pushConstantRangeCount = 1, .pPushConstantRanges = &cullPush };
+	if (vkCreatePipelineLayout(device, &pyramidLayoutCI, nullptr, &pyramidLayout_) != VK_SUCCESS ||
+		vkCreatePipelineLayout(device, &cullLayoutCI, nullptr, &cullLayout_) != VK_SUCCESS) {
+		std::cerr << "vkCreatePipelineLayout failed (culling)\n";
+		return false;
+	}
+	Pipeline pipelineHelper(pipelineCache);
+	pyramidPipeline_ = pipelineHelper.createCompute(device, pyramidLayout_, shaderModule, "depthPyramidMain");
+	cullPipeline_ = pipelineHelper.createCompute(device, cullLayout_, shaderModule, "cullMain");
+	if (pyramidPipeline_ == VK_NULL_HANDLE || cullPipeline_ == VK_NULL_HANDLE) {
+		return false;
+	}
+
+	for (auto& frame : frames_) {
+		if (!createBuffer(frame.stats, sizeof(CullStats), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT) ||
+			!createBuffer(frame.count, sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 0)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void GpuCulling::destroy()
+{
+	if (device_ == VK_NULL_HANDLE) {
+		return;
+	}
+	destroyPyramid(nullptr);
+	for (auto& frame : frames_) {
+		destroyBuffer(frame.draws);
+		destroyBuffer(frame.count);
+		destroyBuffer(frame.stats);
+	}
+	capacity_ = 0;
+	if (cullPipeline_ != VK_NULL_HANDLE) { vkDestroyPipeline(device_, cullPipeline_, nullptr); cullPipeline_ = VK_NULL_HANDLE; }
+	if (pyramidPipeline_ != VK_NULL_HANDLE) { vkDestroyPipeline(device_, pyramidPipeline_, nullptr); pyramidPipeline_ = VK_NULL_HANDLE; }
+	if (cullLayout_ != VK_NULL_HANDLE) { vkDestroyPipelineLayout(device_, cullLayout_, nullptr); cullLayout_ = VK_NULL_HANDLE; }
+	if (pyramidLayout_ != VK_NULL_HANDLE) { vkDestroyPipelineLayout(device_, pyramidLayout_, nullptr); pyramidLayout_ = VK_NULL_HANDLE; }
+	if (setLayout_ != VK_NULL_HANDLE) { vkDestroyDescriptorSetLayout(device_, setLayout_, nullptr); setLayout_ = VK_NULL_HANDLE; }
+	device_ = VK_NULL_HANDLE;
+}
+
+bool GpuCulling::createBuffer(Buffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage, VmaAllocationCreateFlags flags)
+{
+	VkBufferCreateInfo bufferCI{ .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = size, .usage = usage | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT };
+	VmaAllocationCreateInfo allocCI{ .flags = flags, .usage = VMA_MEMORY_USAGE_AUTO };
+	if (flags != 0) {
+		allocCI.flags |= VMA_ALLOCATION_CREATE_MAPPED_BIT;
+	}
+	VmaAllocationInfo allocInfo{};
+	VkResult r = vmaCreateBuffer(allocator_, &bufferCI, &allocCI, &buffer.buffer, &buffer.allocation, &allocInfo);
+	if (r != VK_SUCCESS) {
+		std::cerr << "Failed to create culling buffer: " << r << std::endl;
+		return false;
+	}
+	buffer.mapped = allocInfo.pMappedData;
+	VkBufferDeviceAddressInfo bdaInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = buffer.buffer };
+	buffer.deviceAddress = vkGetBufferDeviceAddress(device_, &bdaInfo);
+	return true;
+}
+
+void GpuCulling::destroyBuffer(Buffer& buffer)
+{
+	if (buffer.buffer != VK_NULL_HANDLE) {
+		vmaDestroyBuffer(allocator_, buffer.buffer, buffer.allocation);
+	}
+	buffer = {};
+}
+
+void GpuCulling::destroyPyramid(DeletionQueue* deletionQueue)
+{
+	// The descriptor sets go with their pool, the sets of the old pyramid may
+	// still be bound by frames in flight
+	if (deletionQueue != nullptr) {
+		for (auto view : levelViews_) {
+			deletionQueue->retireImageView(view);
+		}
+		deletionQueue->retireImageView(pyramidView_);
+		deletionQueue->retireImageView(depthView_);
+		deletionQueue->retireImage(pyramid_, pyramidAllocation_);
+		if (pool_ != VK_NULL_HANDLE) {
+			deletionQueue->retire([device = device_, pool = pool_]() { vkDestroyDescriptorPool(device, pool, nullptr); });
+		}
+	} else {
+		for (auto view : levelViews_) {
+			vkDestroyImageView(device_, view, nullptr);
+		}
+		if (pyramidView_ != VK_NULL_HANDLE) { vkDestroyImageView(device_, pyramidView_, nullptr); }
+		if (depthView_ != VK_NULL_HANDLE) { vkDestroyImageView(device_, depthView_, nullptr); }
+		if (pyramid_ != VK_NULL_HANDLE) { vmaDestroyImage(allocator_, pyramid_, pyramidAllocation_); }
+		if (pool_ != VK_NULL_HANDLE) { vkDestroyDescriptorPool(device_, pool_, nullptr); }
+	}
+	pool_ = VK_NULL_HANDLE;
+	levelSets_.clear();
+	cullSet_ = VK_NULL_HANDLE;
+	levelViews_.clear();
+	levelExtents_.clear();
+	pyramidView_ = VK_NULL_HANDLE;
+	depthView_ = VK_NULL_HANDLE;
+	pyramid_ = VK_NULL_HANDLE;
+	pyramidAllocation_ = VK_NULL_HANDLE;
+}
+
+bool GpuCulling::setDepthImage(VkImage depthImage, VkExtent2D extent, DeletionQueue& deletionQueue)
+{
+	destroyPyramid(&deletionQueue);
+
+	// One set per pyramid level plus the one used for culling
+	const VkDescriptorPoolSize poolSizes[] = {
+		{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, maxPyramidLevels + 1 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, maxPyramidLevels + 1 },
+	};
+	VkDescriptorPoolCreateInfo poolCI{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO, .maxSets = maxPyramidLevels + 1, .poolSizeCount = 2, .pPoolSizes = poolSizes };
+	if (vkCreateDescriptorPool(device_, &poolCI, nullptr, &pool_) != VK_SUCCESS) {
+		std::cerr << "vkCreateDescriptorPool failed (culling)\n";
+		return false;
+	}
+
+	// Without occlusion culling the pyramid is never built, but the culling
+	// shader still declares it, so a single texel stands in for it
+	VkExtent2D baseExtent = occlusion_ ? extent : VkExtent2D{ 1, 1 };
+	uint32_t levels = 1;
+	while (levels < maxPyramidLevels && (std::max(baseExtent.width, baseExtent.height) >> levels) > 0) {
+		levels++;
+	}
+	VkImageCreateInfo pyramidCI{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.imageType = VK_IMAGE_TYPE_2D,
+		.format = VK_FORMAT_R32_SFLOAT,
+		.extent{ .width = baseExtent.width, .height = baseExtent.height, .depth = 1 },
+		.mipLevels = levels,
+		.arrayLayers = 1,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.tiling = VK_IMAGE_TILING_OPTIMAL,
+		.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+	};
+	VmaAllocationCreateInfo allocCI{ .usage = VMA_MEMORY_USAGE_AUTO };
+	if (vmaCreateImage(allocator_, &pyramidCI, &allocCI, &pyramid_, &pyramidAllocation_, nullptr) != VK_SUCCESS) {
+		std::cerr << "Failed to create depth pyramid\n";
+		return false;
+	}
+	VkImageViewCreateInfo viewCI{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.image = pyramid_,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.format = VK_FORMAT_R32_SFLOAT,
+		.subresourceRange{ .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .baseMipLevel = 0, .levelCount = levels, .layerCount = 1 }
+	};
+	if (vkCreateImageView(device_, &viewCI, nullptr, &pyramidView_) != VK_SUCCESS) {
+		return false;
+	}
+	for (uint32_t i = 0; i < levels; i++) {
+		viewCI.subresourceRange.baseMipLevel = i;
+		viewCI.subresourceRange.levelCount = 1;
+		VkImageView view{ VK_NULL_HANDLE };
+		if (vkCreateImageView(device_, &viewCI, nullptr, &view) != VK_SUCCESS) {
+			return false;
+		}
+		levelViews_.push_back(view);
+		levelExtents_.push_back({ std::max(baseExtent.width >> i, 1u), std::max(baseExtent.height >> i, 1u) });
+	}
+	if (occlusion_) {
+		// Only the depth aspect can be sampled
+		VkImageViewCreateInfo depthViewCI{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.image = depthImage,
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = depthFormat_,
+			.subresourceRange{ .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT, .levelCount = 1, .layerCount = 1 }
+		};
+		if (vkCreateImageView(device_, &depthViewCI, nullptr, &depthView_) != VK_SUCCESS) {
+			return false;
+		}
+	}
+
+	// Level sets (only needed when the pyramid is built) and the culling set
+	const uint32_t setCount = (occlusion_ ? levels : 0) + 1;
+	std::vector<VkDescriptorSetLayout> setLayouts(setCount, setLayout_);
+	std::vector<VkDescriptorSet> sets(setCount);
+	VkDescriptorSetAllocateInfo allocInfo{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, .descriptorPool = pool_, .descriptorSetCount = setCount, .pSetLayouts = setLayouts.data() };
+	if (vkAllocateDescriptorSets(device_, &allocInfo, sets.data()) != VK_SUCCESS) {
+		std::cerr << "vkAllocateDescriptorSets failed (culling)\n";
+		return false;
+	}
+	cullSet_ = sets.back();
+	sets.pop_back();
+	levelSets_ = sets;
+
+	std::vector<VkDescriptorImageInfo> imageInfos;
+	imageInfos.reserve(setCount * 2);
+	std::vector<VkWriteDescriptorSet> writes;
+	auto addWrites = [&](VkDescriptorSet set, VkImageView source, VkImageLayout sourceLayout, VkImageView destination) {
+		imageInfos.push_back({ .imageView = source, .imageLayout = sourceLayout });
+		writes.push_back({ .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = set, .dstBinding = 0, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, .pImageInfo = &imageInfos.back() });
+		imageInfos.push_back({ .imageView = destination, .imageLayout = VK_IMAGE_LAYOUT_GENERAL });
+		writes.push_back({ .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = set, .dstBinding = 1, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .pImageInfo = &imageInfos.back() });
+	};
+	for (uint32_t i = 0; i < levelSets_.size(); i++) {
+		if (i == 0) {
+			addWrites(levelSets_[i], depthView_, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, levelViews_[0]);
+		} else {
+			addWrites(levelSets_[i], levelViews_[i - 1], VK_IMAGE_LAYOUT_GENERAL, levelViews_[i]);
+		}
+	}
+	addWrites(cullSet_, pyramidView_, VK_IMAGE_LAYOUT_GENERAL, levelViews_[0]);
+	vkUpdateDescriptorSets(device_, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	return true;
+}
+
+bool GpuCulling::reserve(uint32_t capacity, DeletionQueue& deletionQueue)
+{
+	if (capacity <= capacity_) {
+		return true;
+	}
+	for (auto& frame : frames_) {
+		// Frames in flight may still draw from the old buffer
+		if (frame.draws.buffer != VK_NULL_HANDLE) {
+			deletionQueue.retireBuffer(frame.draws.buffer, frame.draws.allocation);
+		}
+		frame.draws = {};
+		if (!createBuffer(frame.draws, static_cast<VkDeviceSize>(capacity) * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, 0)) {
+			capacity_ = 0;
+			return false;
+		}
+	}
+	capacity_ = capacity;
+	return true;
+}
+
+bool GpuCulling::update(FrameAllocator& frameAllocator, uint32_t frameIndex, const glm::mat4& prevViewProjection, VkDeviceAddress shaderData, VkDeviceAddress inputDraws, VkDeviceAddress inputCount, bool occlusion)
+{
+	auto& frame = frames_[frameIndex];
+	CullData data{
+		.prevViewProjection = prevViewProjection,
+		.shaderData = shaderData,
+		.inputDraws = inputDraws,
+		.inputCount = inputCount,
+		.outputDraws = frame.draws.deviceAddress,
+		.outputCount = frame.count.deviceAddress,
+		.stats = frame.stats.deviceAddress,
+		.pyramidSize = levelExtents_.empty() ? glm::vec2(0.0f) : glm::vec2(levelExtents_[0].width, levelExtents_[0].height),
+		.pyramidLevels = static_cast<uint32_t>(levelExtents_.size()),
+		.occlusion = (occlusion && occlusion_) ? 1u : 0u
+	};
+	frame.cullData = frameAllocator.push(frameIndex, data).deviceAddress;
+	if (frame.cullData == 0) {
+		return false;
+	}
+	frame.written = true;
+	return true;
+}
+
+void GpuCulling::recordPyramid(VkCommandBuffer cb) const
+{
+	if (!occlusion_) {
+		return;
+	}
+	vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidPipeline_);
+	for (uint32_t i = 0; i < levelSets_.size(); i++) {
+		if (i > 0) {
+			// Level i reads what the previous dispatch wrote to level i - 1
+			VkMemoryBarrier2 barrier{
+				.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+				.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+				.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+				.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+				.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT
+			};
+			VkDependencyInfo dependencyInfo{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .memoryBarrierCount = 1, .pMemoryBarriers = &barrier };
+			vkCmdPipelineBarrier2(cb, &dependencyInfo);
+		}
+		VkExtent2D source = (i == 0) ? levelExtents_[0] : levelExtents_[i - 1];
+		VkExtent2D destination = levelExtents_[i];
+		PyramidParams params{
+			.sourceSize = { static_cast<int32_t>(source.width), static_cast<int32_t>(source.height) },
+			.destinationSize = { static_cast<int32_t>(destination.width), static_cast<int32_t>(destination.height) }
+		};
+		vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidLayout_, 0, 1, &levelSets_[i], 0, nullptr);
+		vkCmdPushConstants(cb, pyramidLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PyramidParams), &params);
+		vkCmdDispatch(cb, (destination.width + 7) / 8, (destination.height + 7) / 8, 1);
+	}
+}
+
+void GpuCulling::recordCull(VkCommandBuffer cb, uint32_t frameIndex, uint32_t maxObjects) const
+{
+	const auto& frame = frames_[frameIndex];
+	// The counters are cleared with transfers; the previous indirect read of
+	// the count (two frames ago, same slot) has to finish first
+	VkMemoryBarrier2 clearBarrier{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+		.srcStageMask = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+		.dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+		.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT
+	};
+	VkDependencyInfo clearDependency{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .memoryBarrierCount = 1, .pMemoryBarriers = &clearBarrier };
+	vkCmdPipelineBarrier2(cb, &clearDependency);
+	vkCmdFillBuffer(cb, frame.count.buffer, 0, VK_WHOLE_SIZE, 0);
+	vkCmdFillBuffer(cb, frame.stats.buffer, 0, VK_WHOLE_SIZE, 0);
+	VkMemoryBarrier2 cullBarrier{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+		.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+		.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+		.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
+	};
+	VkDependencyInfo cullDependency{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .memoryBarrierCount = 1, .pMemoryBarriers = &cullBarrier };
+	vkCmdPipelineBarrier2(cb, &cullDependency);
+
+	vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline_);
+	vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_COMPUTE, cullLayout_, 0, 1, &cullSet_, 0, nullptr);
+	vkCmdPushConstants(cb, cullLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(VkDeviceAddress), &frame.cullData);
+	vkCmdDispatch(cb, (std::min(maxObjects, capacity_) + 63) / 64, 1, 1);
+
+	// Make the counters available to the host once the frame's fence signals
+	VkMemoryBarrier2 statsBarrier{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+		.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
+		.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT
+	};
+	VkDependencyInfo statsDependency{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .memoryBarrierCount = 1, .pMemoryBarriers = &statsBarrier };
+	vkCmdPipelineBarrier2(cb, &statsDependency);
+}
+
+void GpuCulling::draw(VkCommandBuffer cb, uint32_t frameIndex) const
+{
+	const auto& frame = frames_[frameIndex];
+	if (capacity_ == 0) {
+		return;
+	}
+	vkCmdDrawIndexedIndirectCount(cb, frame.draws.buffer, 0, frame.count.buffer, 0, capacity_, sizeof(VkDrawIndexedIndirectCommand));
+}
+
+bool GpuCulling::fetchStats(uint32_t frameIndex, CullStats& out) const
+{
+	const auto& frame = frames_[frameIndex];
+	if (!frame.written || frame.stats.mapped == nullptr) {
+		return false;
+	}
+	vmaInvalidateAllocation(allocator_, frame.stats.allocation, 0, VK_WHOLE_SIZE);
+	memcpy(&out, frame.stats.mapped, sizeof(CullStats));
+	return true;
+}
@@ -0,0 +1,133 @@
+// GpuCulling.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vma/vk_mem_alloc.h>
+#include <glm/glm.hpp>
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "VulkanApp.h" // for maxFramesInFlight
+
+class DeletionQueue; // forward
+class FrameAllocator; // forward
+class PipelineCache; // forward
+
+// Per-frame culling parameters, read by culling.slang through a device address
+struct CullData {
+    glm::mat4 prevViewProjection{ 1.0f };
+    VkDeviceAddress shaderData{ 0 };
+    VkDeviceAddress inputDraws{ 0 };
+    VkDeviceAddress inputCount{ 0 };
+    VkDeviceAddress outputDraws{ 0 };
+    VkDeviceAddress outputCount{ 0 };
+    VkDeviceAddress stats{ 0 };
+    glm::vec2 pyramidSize{ 0.0f };
+    uint32_t pyramidLevels{ 0 };
+    uint32_t occlusion{ 0 };
+};
+static_assert(sizeof(CullData) == 128, "CullData must match the layout in culling.slang");
+
+struct CullStats {
+    uint32_t visible{ 0 };
+    uint32_t frustumCulled{ 0 };
+    uint32_t occlusionCulled{ 0 };
+    uint32_t padding{ 0 };
+};
+
+// Compute culling of the GPU scene. A pyramid of farthest depths is built
+// from the previous frame's depth buffer, then one thread per object tests
+// the object's bounding sphere against the view frustum and, projected with
+// the previous frame's view projection, against the pyramid. Surviving draw
+// commands are compacted into a per-frame indirect buffer drawn with
+// vkCmdDrawIndexedIndirectCount.
+//
+// Objects that were hidden last frame and become visible this frame are
+// drawn one frame late; with the camera and objects moving slowly relative to
+// the frame rate this is rarely noticeable.
+class GpuCulling {
+public:
+    GpuCulling() = default;
+    ~GpuCulling() = default;
+
+    // occlusion requests Hi-Z occlusion culling; it is turned off if the depth
+    // format can't be sampled (see isOcclusionEnabled)
+    bool create(VkPhysicalDevice physicalDevice, VkDevice device, VmaAllocator allocator, PipelineCache* pipelineCache, VkShaderModule shaderModule, VkFormat depthFormat, bool occlusion);
+    void destroy();
+
+    // (Re)create the depth pyramid for a new depth buffer. The previous one is
+    // retired through deletionQueue.
+    bool setDepthImage(VkImage depthImage, VkExtent2D extent, DeletionQueue& deletionQueue);
+    // Make sure the output buffers can hold capacity draws. Buffers that have
+    // to grow are retired through deletionQueue.
+    bool reserve(uint32_t capacity, DeletionQueue& deletionQueue);
+
+    // Write the frame's culling parameters. The pyramid read this frame was
+    // built from depth rendered with prevViewProjection; pass occlusion =
+    // false if there is no such depth yet (first frame, new depth buffer).
+    // The parameters are allocated from the frame's slot of frameAllocator.
+    bool update(FrameAllocator& frameAllocator, uint32_t frameIndex, const glm::mat4& prevViewProjection, VkDeviceAddress shaderData, VkDeviceAddress inputDraws, VkDeviceAddress inputCount, bool occlusion);
+
+    // Record the pyramid build (reads the depth image in SHADER_READ_ONLY_OPTIMAL,
+    // writes the pyramid in GENERAL)
+    void recordPyramid(VkCommandBuffer cb) const;
+    // Record the culling dispatch for up to maxObjects objects
+    void recordCull(VkCommandBuffer cb, uint32_t frameIndex, uint32_t maxObjects) const;
+    // Draw the surviving objects
+    void draw(VkCommandBuffer cb, uint32_t frameIndex) const;
+
+    // Counters of the last culling run in this frame slot, valid once its fence has signaled
+    bool fetchStats(uint32_t frameIndex, CullStats& out) const;
+
+    bool isOcclusionEnabled() const { return occlusion_; }
+    VkImage getPyramid() const { return pyramid_; }
+    VkBuffer getDrawBuffer(uint32_t frameIndex) const { return frames_[frameIndex].draws.buffer; }
+    VkBuffer getCountBuffer(uint32_t frameIndex) const { return frames_[frameIndex].count.buffer; }
+
+private:
+    struct Buffer {
+        VkBuffer buffer{ VK_NULL_HANDLE };
+        VmaAllocation allocation{ VK_NULL_HANDLE };
+        VkDeviceAddress deviceAddress{ 0 };
+        void* mapped{ nullptr };
+    };
+    struct FrameResources {
+        Buffer draws;       // compacted VkDrawIndexedIndirectCommands
+        Buffer count;       // number of compacted draws
+        Buffer stats;       // CullStats, read back on the host
+        VkDeviceAddress cullData{ 0 };  // CullData, from the frame allocator
+        bool written{ false };
+    };
+
+    bool createBuffer(Buffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage, VmaAllocationCreateFlags flags);
+    void destroyBuffer(Buffer& buffer);
+    // Destroys right away without a deletion queue
+    void destroyPyramid(DeletionQueue* deletionQueue);
+
+    static constexpr uint32_t maxPyramidLevels = 16;
+
+    VkDevice device_{ VK_NULL_HANDLE };
+    VmaAllocator allocator_{ VK_NULL_HANDLE };
+    bool occlusion_{ false };
+    VkFormat depthFormat_{ VK_FORMAT_UNDEFINED };
+
+    VkDescriptorSetLayout setLayout_{ VK_NULL_HANDLE };
+    VkDescriptorPool pool_{ VK_NULL_HANDLE };    // one per pyramid
+    VkPipelineLayout pyramidLayout_{ VK_NULL_HANDLE };
+    VkPipelineLayout cullLayout_{ VK_NULL_HANDLE };
+    VkPipeline pyramidPipeline_{ VK_NULL_HANDLE };
+    VkPipeline cullPipeline_{ VK_NULL_HANDLE };
+
+    // Depth pyramid, level 0 has the size of the depth buffer
+    VkImage pyramid_{ VK_NULL_HANDLE };
+    VmaAllocation pyramidAllocation_{ VK_NULL_HANDLE };
+    VkImageView pyramidView_{ VK_NULL_HANDLE };
+    std::vector<VkImageView> levelViews_;
+    std::vector<VkExtent2D> levelExtents_;
+    VkImageView depthView_{ VK_NULL_HANDLE };
+    std::vector<VkDescriptorSet> levelSets_;    // level i reads level i - 1 (level 0 the depth buffer)
+    VkDescriptorSet cullSet_{ VK_NULL_HANDLE };
+
+    uint32_t capacity_{ 0 };
+    std::array<FrameResources, VulkanApp::maxFramesInFlight> frames_{};
+};
@@ -0,0 +1,198 @@
+// GpuScene.cpp
+#include "GpuScene.h"
+#include "DeletionQueue.h"
+
+#include <volk/volk.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+bool GpuScene::create(VkDevice device, VmaAllocator allocator, DeletionQueue* deletionQueue, bool drawIndirectCount, bool multiDrawIndirect, bool drawIndirectFirstInstance, bool deviceLocal)
+{
+	device_ = device;
+	allocator_ = allocator;
+	deletionQueue_ = deletionQueue;
+	drawIndirectCount_ = drawIndirectCount;
+	multiDrawIndirect_ = multiDrawIndirect;
+	drawIndirectFirstInstance_ = drawIndirectFirstInstance;
+	deviceLocal_ = deviceLocal;
+	return true;
+}
+
+void GpuScene::destroy()
+{
+	destroyBuffers();
+	objects_.clear();
+}
+
+void GpuScene::clear()
+{
+	objects_.clear();
+}
+
+uint32_t GpuScene::addObject(const MeshRange& mesh, uint32_t materialIndex, const glm::mat4& transform)
+{
+	objects_.push_back({
+		.transform = transform,
+		.firstIndex = mesh.firstIndex,
+		.indexCount = mesh.indexCount,
+		.vertexOffset = mesh.vertexOffset,
+		.materialIndex = materialIndex,
+		.boundingSphere = mesh.boundingSphere
+	});
+	return static_cast<uint32_t>(objects_.size() - 1);
+}
+
+bool GpuScene::createBuffer(Buffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage)
+{
+	VkBufferCreateInfo bufferCI{ .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = size, .usage = usage | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT };
+	VmaAllocationCreateInfo allocCI{ .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT, .usage = VMA_MEMORY_USAGE_AUTO };
+	VmaAllocationInfo allocInfo{};
+	VkResult r = vmaCreateBuffer(allocator_, &bufferCI, &allocCI, &buffer.buffer, &buffer.allocation, &allocInfo);
+	if (r != VK_SUCCESS) {
+		std::cerr << "Failed to create scene buffer: " << r << std::endl;
+		return false;
+	}
+	buffer.mapped = allocInfo.pMappedData;
+	VkBufferDeviceAddressInfo bdaInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = buffer.buffer };
+	buffer.deviceAddress = vkGetBufferDeviceAddress(device_, &bdaInfo);
+	return true;
+}
+
+void GpuScene::destroyBuffer(Buffer& buffer)
+{
+	if (buffer.buffer != VK_NULL_HANDLE) {
+		vmaDestroyBuffer(allocator_, buffer.buffer, buffer.allocation);
+	}
+	buffer = {};
+}
+
+void GpuScene::destroyBuffers()
+{
+	objectBuffer_.destroy();
+	destroyBuffer(drawBuffer_);
+	destroyBuffer(countBuffer_);
+	committedCount_ = 0;
+	capacity_ = 0;
+}
+
+void GpuScene::retireBuffers()
+{
+	if (deletionQueue_ == nullptr) {
+		destroyBuffers();
+		return;
+	}
+	if (objectBuffer_.getSize() > 0) {
+		deletionQueue_->retire([objectBuffer = std::move(objectBuffer_)]() mutable { objectBuffer.destroy(); });
+	}
+	objectBuffer_ = {};
+	for (Buffer* buffer : { &drawBuffer_, &countBuffer_ }) {
+		if (buffer->buffer != VK_NULL_HANDLE) {
+			deletionQueue_->retireBuffer(buffer->buffer, buffer->allocation);
+		}
+		*buffer = {};
+	}
+	committedCount_ = 0;
+	capacity_ = 0;
+}
+
+bool GpuScene::createBuffers(uint32_t capacity)
+{
+	if (!objectBuffer_.create(device_, allocator_, deletionQueue_, capacity * sizeof(ObjectRecord), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, deviceLocal_)) {
+		return false;
+	}
+	if (!createBuffer(drawBuffer_, capacity * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) ||
+		!createBuffer(countBuffer_, sizeof(uint32_t), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)) {
+		return false;
+	}
+	capacity_ = capacity;
+	return true;
+}
+
+bool GpuScene::commit()
+{
+	const uint32_t objectCount = static_cast<uint32_t>(objects_.size());
+	if (objectCount > capacity_) {
+		// Grow geometrically so a scene built up over several commits doesn't
+		// reallocate every time
+		uint32_t capacity = std::max(capacity_, 64u);
+		while (capacity < objectCount) {
+			capacity *= 2;
+		}
+		retireBuffers();
+		version_++;
+		if (!createBuffers(capacity)) {
+			destroyBuffers();
+			return false;
+		}
+	} else if ((!drawIndirectCount_ || !drawIndirectFirstInstance_) && objectCount != committedCount_) {
+		// The fallback draws bake the count into the command buffer
+		version_++;
+	}
+	if (capacity_ == 0) {
+		return true;
+	}
+
+	// One draw per object, firstInstance carries the object index to the vertex shader
+	auto* commands = static_cast<VkDrawIndexedIndirectCommand*>(drawBuffer_.mapped);
+	for (uint32_t i = 0; i < objects_.size(); i++) {
+		commands[i] = {
+			.indexCount = objects_[i].indexCount,
+			.instanceCount = 1,
+			.firstIndex = objects_[i].firstIndex,
+			.vertexOffset = objects_[i].vertexOffset,
+			.firstInstance = i
+		};
+	}
+	committedCount_ = objectCount;
+	memcpy(countBuffer_.mapped, &committedCount_, sizeof(uint32_t));
+	vmaFlushAllocation(allocator_, drawBuffer_.allocation, 0, VK_WHOLE_SIZE);
+	vmaFlushAllocation(allocator_, countBuffer_.allocation, 0, VK_WHOLE_SIZE);
+	// Unchanged records are skipped by the buffer, the next update of each slot uploads the rest
+	objectBuffer_.write(0, objects_.data(), committedCount_ * sizeof(ObjectRecord));
+	return true;
+}
+
+void GpuScene::setTransform(uint32_t object, const glm::mat4& transform)
+{
+	objects_[object].transform = transform;
+	if (object < committedCount_) {
+		objectBuffer_.write(object * sizeof(ObjectRecord) + offsetof(ObjectRecord, transform), transform);
+	}
+}
+
+void GpuScene::update(uint32_t frameIndex)
+{
+	if (capacity_ == 0) {
+		return;
+	}
+	if (!objectBuffer_.upload(frameIndex)) {
+		std::cerr << "Failed to upload scene objects\n";
+	}
+}
+
+void GpuScene::draw(VkCommandBuffer cb) const
+{
+	if (capacity_ == 0) {
+		return;
+	}
+	constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+	if (!drawIndirectFirstInstance_) {
+		// A non-zero firstInstance is only valid in direct draws then
+		for (uint32_t i = 0; i < std::min(committedCount_, static_cast<uint32_t>(objects_.size())); i++) {
+			vkCmdDrawIndexed(cb, objects_[i].indexCount, 1, objects_[i].firstIndex, objects_[i].vertexOffset, i);
+		}
+	} else if (drawIndirectCount_) {
+		// The actual count is read from the count buffer, capacity is only the upper bound
+		vkCmdDrawIndexedIndirectCount(cb, drawBuffer_.buffer, 0, countBuffer_.buffer, 0, capacity_, stride);
+	} else if (multiDrawIndirect_) {
+		vkCmdDrawIndexedIndirect(cb, drawBuffer_.buffer, 0, committedCount_, stride);
+	} else {
+		// Without multiDrawIndirect drawCount must be 0 or 1
+		for (uint32_t i = 0; i < committedCount_; i++) {
+			vkCmdDrawIndexedIndirect(cb, drawBuffer_.buffer, static_cast<VkDeviceSize>(i) * stride, 1, stride);
+		}
+	}
+}
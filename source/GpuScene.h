@@ -0,0 +1,124 @@
+// GpuScene.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vma/vk_mem_alloc.h>
+#include <glm/glm.hpp>
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "VulkanApp.h" // for maxFramesInFlight
+#include "PersistentBuffer.h"
+
+class DeletionQueue; // forward
+
+// Range of the shared index/vertex buffer making up one mesh
+struct MeshRange {
+    uint32_t firstIndex{ 0 };
+    uint32_t indexCount{ 0 };
+    int32_t vertexOffset{ 0 };
+    // Object space bounding sphere (center, radius)
+    glm::vec4 boundingSphere{ 0.0f, 0.0f, 0.0f, 1.0f };
+};
+
+// Per-object record as read by the shaders (ObjectRecord in shader.slang and
+// culling.slang). 96 bytes, no implicit padding, so the C++ and Slang layouts agree.
+struct ObjectRecord {
+    glm::mat4 transform{ 1.0f };
+    uint32_t firstIndex{ 0 };
+    uint32_t indexCount{ 0 };
+    int32_t vertexOffset{ 0 };
+    uint32_t materialIndex{ 0 };
+    glm::vec4 boundingSphere{ 0.0f, 0.0f, 0.0f, 1.0f };
+};
+
+// GPU side scene representation. Objects live in a persistent buffer that
+// shaders read through its device address and that only receives the records
+// that changed (see PersistentBuffer), and every object has a matching
+// VkDrawIndexedIndirectCommand whose firstInstance is the object index. The
+// whole scene is drawn with a single vkCmdDrawIndexedIndirectCount, so the
+// per-frame CPU cost of recording does not depend on the object count.
+//
+// The object count is only known at runtime. Buffers grow geometrically and
+// are reused as long as the objects fit, the draw count comes from the count
+// buffer, so recorded draws stay valid when objects are added or removed
+// within the current capacity.
+class GpuScene {
+public:
+    GpuScene() = default;
+    ~GpuScene() = default;
+
+    // drawIndirectCount/multiDrawIndirect/drawIndirectFirstInstance are the
+    // device features actually enabled; without the first two draw() falls
+    // back to plain or per-object indirect draws, without the last one (the
+    // object index can't be passed as firstInstance) to direct draws.
+    // deviceLocal keeps the object records in device-local memory, updated
+    // with copies recorded by recordUploads() (see PersistentBuffer).
+    // Buffers replaced when the scene grows are retired through deletionQueue,
+    // frames in flight may still read them.
+    bool create(VkDevice device, VmaAllocator allocator, DeletionQueue* deletionQueue, bool drawIndirectCount, bool multiDrawIndirect, bool drawIndirectFirstInstance, bool deviceLocal);
+    void destroy();
+
+    // Scene structure. Changes take effect with commit().
+    void clear();
+    uint32_t addObject(const MeshRange& mesh, uint32_t materialIndex, const glm::mat4& transform);
+    // Upload the draw commands for the current objects, growing the buffers if
+    // they don't fit. Draw commands and object records are rewritten in place,
+    // so no frame drawing the scene may be in flight.
+    bool commit();
+
+    void setTransform(uint32_t object, const glm::mat4& transform);
+    // Upload the object records changed since the slot was last updated
+    void update(uint32_t frameIndex);
+    // Record the copies of the device-local path, before anything reads the objects
+    void recordUploads(VkCommandBuffer cb, uint32_t frameIndex) const { objectBuffer_.recordCopies(cb, frameIndex); }
+    // Bytes uploaded by the last update()
+    VkDeviceSize getLastUploadSize() const { return objectBuffer_.getLastUploadSize(); }
+
+    // Record the draw of all objects. Pipeline, descriptors, vertex and index
+    // buffers have to be bound already.
+    void draw(VkCommandBuffer cb) const;
+
+    uint32_t getObjectCount() const { return static_cast<uint32_t>(objects_.size()); }
+    uint32_t getCapacity() const { return capacity_; }
+    const ObjectRecord& getObject(uint32_t object) const { return objects_[object]; }
+    VkDeviceAddress getObjectsAddress(uint32_t frameIndex) const { return objectBuffer_.getDeviceAddress(frameIndex); }
+    // Unculled draw commands and their count, as input for GPU culling
+    VkDeviceAddress getDrawsAddress() const { return drawBuffer_.deviceAddress; }
+    VkDeviceAddress getDrawCountAddress() const { return countBuffer_.deviceAddress; }
+    // Incremented by commit() whenever recorded draws become stale (buffers
+    // recreated, or a draw count change without drawIndirectCount support or
+    // with direct draws)
+    uint32_t getVersion() const { return version_; }
+
+private:
+    struct Buffer {
+        VkBuffer buffer{ VK_NULL_HANDLE };
+        VmaAllocation allocation{ VK_NULL_HANDLE };
+        VkDeviceAddress deviceAddress{ 0 };
+        void* mapped{ nullptr };
+    };
+
+    bool createBuffer(Buffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage);
+    void destroyBuffer(Buffer& buffer);
+    void destroyBuffers();
+    // Hand the buffers to the deletion queue instead of destroying them
+    void retireBuffers();
+    bool createBuffers(uint32_t capacity);
+
+    VkDevice device_{ VK_NULL_HANDLE };
+    VmaAllocator allocator_{ VK_NULL_HANDLE };
+    DeletionQueue* deletionQueue_{ nullptr };
+    bool drawIndirectCount_{ false };
+    bool multiDrawIndirect_{ false };
+    bool drawIndirectFirstInstance_{ false };
+    bool deviceLocal_{ false };
+    uint32_t version_{ 0 };
+
+    std::vector<ObjectRecord> objects_;
+    PersistentBuffer objectBuffer_;
+    Buffer drawBuffer_{};      // VkDrawIndexedIndirectCommand per object
+    Buffer countBuffer_{};     // uint32_t draw count
+    uint32_t committedCount_{ 0 };
+    uint32_t capacity_{ 0 };
+};
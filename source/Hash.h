@@ -0,0 +1,36 @@
+// Hash.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+// 64-bit FNV-1a. Unlike std::hash the results are the same across runs,
+// compilers and platforms, so they can name files on disk. Structs are hashed
+// member by member (hashValue), never as a whole, so padding bytes don't leak
+// into the result.
+constexpr uint64_t hashSeed = 0xcbf29ce484222325ull;
+
+inline uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+inline uint64_t hashString(uint64_t hash, const std::string& string)
+{
+    // Include the terminator so "ab" + "c" and "a" + "bc" differ
+    return hashBytes(hash, string.c_str(), string.size() + 1);
+}
+
+// Scalars, enums and handles
+template <typename T>
+uint64_t hashValue(uint64_t hash, const T& value)
+{
+    static_assert(std::is_scalar_v<T>, "hash structs member by member");
+    return hashBytes(hash, &value, sizeof(T));
+}
@@ -0,0 +1,75 @@
+// InputSampler.cpp
+#include "InputSampler.h"
+
+InputSampler::~InputSampler()
+{
+	stop();
+}
+
+void InputSampler::start(std::chrono::microseconds interval)
+{
+	if (running_) {
+		return;
+	}
+	interval_ = interval;
+	pending_ = {};
+	running_ = true;
+	thread_ = std::thread(&InputSampler::threadMain, this);
+}
+
+void InputSampler::stop()
+{
+	running_ = false;
+	if (thread_.joinable()) {
+		thread_.join();
+	}
+}
+
+InputSample InputSampler::sample()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	InputSample result = pending_;
+	pending_ = {};
+	return result;
+}
+
+void InputSampler::threadMain()
+{
+	sf::Vector2i lastPos = sf::Mouse::getPosition();
+	bool addDown = false;
+	bool subtractDown = false;
+	while (running_) {
+		// Read the device state outside of the lock, these calls may go to the OS
+		auto now = std::chrono::steady_clock::now();
+		sf::Vector2i pos = sf::Mouse::getPosition();
+		bool dragging = sf::Mouse::isButtonPressed(sf::Mouse::Button::Left);
+		bool add = sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Add);
+		bool subtract = sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Subtract);
+		bool focused = focused_;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			bool changed{ false };
+			if (focused && dragging && pos != lastPos) {
+				pending_.dragDelta += pos - lastPos;
+				changed = true;
+			}
+			// Count presses, not held keys
+			if (focused && add && !addDown) {
+				pending_.selectionSteps++;
+				changed = true;
+			}
+			if (focused && subtract && !subtractDown) {
+				pending_.selectionSteps--;
+				changed = true;
+			}
+			// Latency is measured from the oldest input the renderer hasn't taken yet
+			if (changed && !pending_.hasInput()) {
+				pending_.timestamp = now;
+			}
+		}
+		lastPos = pos;
+		addDown = add;
+		subtractDown = subtract;
+		std::this_thread::sleep_for(interval_);
+	}
+}
@@ -0,0 +1,66 @@
+// InputSampler.h
+#pragma once
+
+#include <SFML/Window.hpp>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+// Input gathered since the previous InputSampler::sample() call
+struct InputSample {
+    // Mouse movement while the left button was held
+    sf::Vector2i dragDelta{};
+    // +1 per press of Add, -1 per press of Subtract
+    int selectionSteps{ 0 };
+    // When the oldest input in this sample was read, unset if there is none
+    std::chrono::steady_clock::time_point timestamp{};
+
+    bool hasInput() const { return timestamp != std::chrono::steady_clock::time_point{}; }
+    // Add the input of a later sample, the older timestamp is kept
+    void append(const InputSample& later)
+    {
+        dragDelta += later.dragDelta;
+        selectionSteps += later.selectionSteps;
+        if (!hasInput()) timestamp = later.timestamp;
+    }
+};
+
+// Polls the real-time mouse and keyboard state on a dedicated thread and
+// accumulates it until the render loop consumes it. This decouples input
+// from the frame rate: the render loop can take the newest state right
+// before it builds (and again right before it submits) a frame instead of
+// using what the event queue held at the end of the previous frame.
+//
+// Window events (close, resize, focus, mouse wheel) are tied to the thread
+// that created the window in SFML and are still pumped by the render loop.
+class InputSampler {
+public:
+    InputSampler() = default;
+    ~InputSampler();
+
+    // Non-copyable
+    InputSampler(const InputSampler&) = delete;
+    InputSampler& operator=(const InputSampler&) = delete;
+
+    void start(std::chrono::microseconds interval = std::chrono::microseconds(500));
+    void stop();
+
+    // Input is only accumulated while the window has focus
+    void setFocused(bool focused) { focused_ = focused; }
+
+    // Return and clear the input accumulated since the last call
+    InputSample sample();
+
+private:
+    void threadMain();
+
+    std::thread thread_;
+    std::atomic<bool> running_{ false };
+    std::atomic<bool> focused_{ true };
+    std::chrono::microseconds interval_{ 500 };
+
+    // Accumulated input, guarded by mutex_
+    std::mutex mutex_;
+    InputSample pending_{};
+};
@@ -1,9 +1,12 @@
 // LogicalDevice.cpp
 #include "LogicalDevice.h"
 #include <volk/volk.h>
+#include <cstring>
 #include <iostream>
+#include <utility>
+#include <vector>
 
-VkDevice LogicalDevice::create(VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex) const
+VkDevice LogicalDevice::create(VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex, DeviceFeatureRequest* features) const
 {
         float queuePriority = 1.0f;
         VkDeviceQueueCreateInfo queueCreateInfo{};
@@ -18,9 +21,133 @@ VkDevice LogicalDevice::create(VkPhysicalDevice physicalDevice, uint32_t queueFa
     deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
 
     // Enable swapchain device extension so we can create a swapchain.
-    const char* deviceExtensions[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
-    deviceCreateInfo.enabledExtensionCount = 1;
-    deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions;
+    std::vector<const char*> deviceExtensions{ VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+
+    // Optional extensions are only queried (and enabled) if the device has them
+    uint32_t extensionCount{ 0 };
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+    auto hasExtension = [&](const char* name) {
+        for (const auto& extension : extensions) {
+            if (strcmp(extension.extensionName, name) == 0) return true;
+        }
+        return false;
+    };
+    const bool hasPipelineLibrary = hasExtension(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) && hasExtension(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+    const bool hasDynamicState3 = hasExtension(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+    const bool hasShaderObject = hasExtension(VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
+
+    // Optional features: only enable what the device reports as supported
+    VkPhysicalDeviceVulkan13Features supportedVk13Features{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES };
+    VkPhysicalDeviceVulkan12Features supportedVk12Features{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES, .pNext = &supportedVk13Features };
+    VkPhysicalDeviceFeatures2 supportedFeatures{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &supportedVk12Features };
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT supportedLibraryFeatures{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT };
+    VkPhysicalDeviceExtendedDynamicState3FeaturesEXT supportedDynamicState3Features{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT };
+    VkPhysicalDeviceShaderObjectFeaturesEXT supportedShaderObjectFeatures{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT };
+    if (hasPipelineLibrary) {
+        supportedLibraryFeatures.pNext = supportedFeatures.pNext;
+        supportedFeatures.pNext = &supportedLibraryFeatures;
+    }
+    if (hasDynamicState3) {
+        supportedDynamicState3Features.pNext = supportedFeatures.pNext;
+        supportedFeatures.pNext = &supportedDynamicState3Features;
+    }
+    if (hasShaderObject) {
+        supportedShaderObjectFeatures.pNext = supportedFeatures.pNext;
+        supportedFeatures.pNext = &supportedShaderObjectFeatures;
+    }
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+    // Without fast linking a link may cost as much as a monolithic build, the
+    // libraries would then only add the cost of building the parts
+    VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT libraryProperties{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT };
+    if (hasPipelineLibrary) {
+        VkPhysicalDeviceProperties2 properties{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &libraryProperties };
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+    }
+    // Features the renderer relies on unconditionally (bindless textures,
+    // shader data through buffer device address, dynamic rendering, sync2)
+    const std::pair<const char*, VkBool32> requiredFeatures[] = {
+        { "descriptorIndexing", supportedVk12Features.descriptorIndexing },
+        { "descriptorBindingVariableDescriptorCount", supportedVk12Features.descriptorBindingVariableDescriptorCount },
+        { "runtimeDescriptorArray", supportedVk12Features.runtimeDescriptorArray },
+        { "bufferDeviceAddress", supportedVk12Features.bufferDeviceAddress },
+        { "synchronization2", supportedVk13Features.synchronization2 },
+        { "dynamicRendering", supportedVk13Features.dynamicRendering }
+    };
+    bool missingFeatures{ false };
+    for (const auto& [name, supported] : requiredFeatures) {
+        if (!supported) {
+            std::cerr << "Required device feature " << name << " is not supported\n";
+            missingFeatures = true;
+        }
+    }
+    if (missingFeatures) {
+        return VK_NULL_HANDLE;
+    }
+    VkPhysicalDeviceFeatures enabledFeatures{ .samplerAnisotropy = supportedFeatures.features.samplerAnisotropy };
+    VkPhysicalDeviceVulkan12Features enabledVk12Features{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+        .descriptorIndexing = VK_TRUE,
+        .descriptorBindingVariableDescriptorCount = VK_TRUE,
+        .runtimeDescriptorArray = VK_TRUE,
+        .bufferDeviceAddress = VK_TRUE
+    };
+    VkPhysicalDeviceVulkan13Features enabledVk13Features{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+        .pNext = &enabledVk12Features,
+        .synchronization2 = VK_TRUE,
+        .dynamicRendering = VK_TRUE
+    };
+    if (features) {
+        features->pipelineStatistics = features->pipelineStatistics && supportedFeatures.features.pipelineStatisticsQuery;
+        features->inheritedQueries = features->inheritedQueries && supportedFeatures.features.inheritedQueries;
+        features->drawIndirectCount = features->drawIndirectCount && supportedVk12Features.drawIndirectCount;
+        features->multiDrawIndirect = features->multiDrawIndirect && supportedFeatures.features.multiDrawIndirect;
+        features->drawIndirectFirstInstance = features->drawIndirectFirstInstance && supportedFeatures.features.drawIndirectFirstInstance;
+        enabledFeatures.pipelineStatisticsQuery = features->pipelineStatistics ? VK_TRUE : VK_FALSE;
+        enabledFeatures.inheritedQueries = features->inheritedQueries ? VK_TRUE : VK_FALSE;
+        enabledFeatures.multiDrawIndirect = features->multiDrawIndirect ? VK_TRUE : VK_FALSE;
+        enabledFeatures.drawIndirectFirstInstance = features->drawIndirectFirstInstance ? VK_TRUE : VK_FALSE;
+        enabledVk12Features.drawIndirectCount = features->drawIndirectCount ? VK_TRUE : VK_FALSE;
+        features->graphicsPipelineLibrary = features->graphicsPipelineLibrary && hasPipelineLibrary && supportedLibraryFeatures.graphicsPipelineLibrary
+            && libraryProperties.graphicsPipelineLibraryFastLinking;
+        features->extendedDynamicState3 = features->extendedDynamicState3 && hasDynamicState3
+            && supportedDynamicState3Features.extendedDynamicState3PolygonMode
+            && supportedDynamicState3Features.extendedDynamicState3ColorBlendEnable
+            && supportedDynamicState3Features.extendedDynamicState3ColorBlendEquation
+            && supportedDynamicState3Features.extendedDynamicState3ColorWriteMask;
+        features->shaderObject = features->shaderObject && hasShaderObject && supportedShaderObjectFeatures.shaderObject;
+    }
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT enabledLibraryFeatures{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT, .graphicsPipelineLibrary = VK_TRUE };
+    VkPhysicalDeviceExtendedDynamicState3FeaturesEXT enabledDynamicState3Features{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT,
+        .extendedDynamicState3PolygonMode = VK_TRUE,
+        .extendedDynamicState3ColorBlendEnable = VK_TRUE,
+        .extendedDynamicState3ColorBlendEquation = VK_TRUE,
+        .extendedDynamicState3ColorWriteMask = VK_TRUE
+    };
+    VkPhysicalDeviceShaderObjectFeaturesEXT enabledShaderObjectFeatures{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT, .shaderObject = VK_TRUE };
+    if (features && features->graphicsPipelineLibrary) {
+        deviceExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+        deviceExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+        enabledLibraryFeatures.pNext = enabledVk13Features.pNext;
+        enabledVk13Features.pNext = &enabledLibraryFeatures;
+    }
+    if (features && features->extendedDynamicState3) {
+        deviceExtensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+        enabledDynamicState3Features.pNext = enabledVk13Features.pNext;
+        enabledVk13Features.pNext = &enabledDynamicState3Features;
+    }
+    if (features && features->shaderObject) {
+        deviceExtensions.push_back(VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
+        enabledShaderObjectFeatures.pNext = enabledVk13Features.pNext;
+        enabledVk13Features.pNext = &enabledShaderObjectFeatures;
+    }
+    deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+    deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    deviceCreateInfo.pNext = &enabledVk13Features;
+    deviceCreateInfo.pEnabledFeatures = &enabledFeatures;
 
         VkDevice device = VK_NULL_HANDLE;
         VkResult r = vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, &device);
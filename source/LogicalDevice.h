@@ -3,6 +3,29 @@
 
 #include <vulkan/vulkan.h>
 
+// Optional device features the application can ask for. create() enables the
+// ones the physical device supports and clears the others, so callers can
+// inspect the struct afterwards to see what they actually got.
+struct DeviceFeatureRequest {
+    bool pipelineStatistics = false;
+    // Needed to keep a query active while executing secondary command buffers
+    bool inheritedQueries = false;
+    // Draw counts sourced from a GPU buffer (vkCmdDrawIndexedIndirectCount)
+    bool drawIndirectCount = false;
+    bool multiDrawIndirect = false;
+    // Non-zero firstInstance in indirect draws, which carries the object index
+    bool drawIndirectFirstInstance = false;
+    // VK_EXT_graphics_pipeline_library (with VK_KHR_pipeline_library), only
+    // if the device links fast, monolithic pipelines are preferred otherwise
+    bool graphicsPipelineLibrary = false;
+    // VK_EXT_extended_dynamic_state3, only requested as a whole: polygon
+    // mode, color blend enable, equation and write mask
+    bool extendedDynamicState3 = false;
+    // VK_EXT_shader_object: graphics state without pipelines, also provides
+    // the dynamic state commands of extendedDynamicState3 and vertex input
+    bool shaderObject = false;
+};
+
 // Scaffold for a LogicalDevice wrapper
 class LogicalDevice {
 public:
@@ -11,5 +34,5 @@ public:
 
     // Create a logical device from a physical device (scaffold)
     // Create a logical device from a physical device. Returns VK_NULL_HANDLE on failure.
-    VkDevice create(VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex = 0) const;
+    VkDevice create(VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex = 0, DeviceFeatureRequest* features = nullptr) const;
 };
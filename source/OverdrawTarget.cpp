@@ -0,0 +1,73 @@
+// OverdrawTarget.cpp
+#include "OverdrawTarget.h"
+#include "DeletionQueue.h"
+#include "Descriptor.h"
+
+#include <volk/volk.h>
+#include <iostream>
+#include <vector>
+
+bool OverdrawTarget::create(VkPhysicalDevice physicalDevice, VkDevice device, VkDescriptorSetLayout setLayout)
+{
+	// Blending into 32 bit float targets is optional, 16 bit float is near universal
+	// and still counts exactly up to 2048 layers.
+	VkFormatProperties formatProps{};
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, VK_FORMAT_R32_SFLOAT, &formatProps);
+	const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BLEND_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+	format_ = ((formatProps.optimalTilingFeatures & required) == required) ? VK_FORMAT_R32_SFLOAT : VK_FORMAT_R16_SFLOAT;
+
+	VkSamplerCreateInfo samplerCI{};
+	samplerCI.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerCI.magFilter = VK_FILTER_NEAREST;
+	samplerCI.minFilter = VK_FILTER_NEAREST;
+	samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	if (vkCreateSampler(device, &samplerCI, nullptr, &sampler_) != VK_SUCCESS) {
+		std::cerr << "vkCreateSampler failed (overdraw)\n";
+		return false;
+	}
+
+	// The set is created by setImageView once the render graph has been compiled
+	setLayout_ = setLayout;
+	return setLayout_ != VK_NULL_HANDLE;
+}
+
+bool OverdrawTarget::setImageView(VkDevice device, VkImageView view, DeletionQueue& deletionQueue)
+{
+	// A set can't be updated while frames in flight may have it bound, so every
+	// image gets a set of its own
+	if (pool_ != VK_NULL_HANDLE) {
+		deletionQueue.retire([device, pool = pool_]() { vkDestroyDescriptorPool(device, pool, nullptr); });
+		pool_ = VK_NULL_HANDLE;
+		set_ = VK_NULL_HANDLE;
+	}
+	Descriptor descHelper;
+	pool_ = descHelper.createPool(device, 1);
+	if (pool_ == VK_NULL_HANDLE) {
+		return false;
+	}
+	VkDescriptorSetAllocateInfo allocInfo{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, .descriptorPool = pool_, .descriptorSetCount = 1, .pSetLayouts = &setLayout_ };
+	VkResult r = vkAllocateDescriptorSets(device, &allocInfo, &set_);
+	if (r != VK_SUCCESS) {
+		std::cerr << "vkAllocateDescriptorSets failed (overdraw): " << r << std::endl;
+		return false;
+	}
+
+	VkDescriptorImageInfo imageInfo{ .sampler = sampler_, .imageView = view, .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	VkWriteDescriptorSet writeDescSet{};
+	writeDescSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeDescSet.dstSet = set_;
+	writeDescSet.dstBinding = 0;
+	writeDescSet.descriptorCount = 1;
+	writeDescSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writeDescSet.pImageInfo = &imageInfo;
+	vkUpdateDescriptorSets(device, 1, &writeDescSet, 0, nullptr);
+	return true;
+}
+
+void OverdrawTarget::destroy(VkDevice device)
+{
+	if (sampler_ != VK_NULL_HANDLE) { vkDestroySampler(device, sampler_, nullptr); sampler_ = VK_NULL_HANDLE; }
+	if (pool_ != VK_NULL_HANDLE) { vkDestroyDescriptorPool(device, pool_, nullptr); pool_ = VK_NULL_HANDLE; set_ = VK_NULL_HANDLE; }
+}
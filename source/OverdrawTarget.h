@@ -0,0 +1,42 @@
+// OverdrawTarget.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+class DeletionQueue; // forward
+
+// Sampling side of the overdraw visualization. The fragment count image is a
+// transient render graph image (see Renderer::run): every rasterized fragment
+// adds 1.0 through additive blending, so after the counting pass each texel
+// holds the number of fragments shaded for that pixel. This helper picks the
+// image format and owns the sampler and the descriptor set used to read the
+// counts in the resolve pass (bound at set 1, binding 0 as declared in shader.slang).
+// The set's layout comes from the reflected pipeline layout.
+class OverdrawTarget {
+public:
+    OverdrawTarget() = default;
+    ~OverdrawTarget() = default;
+
+    // Pick the count format (R32_SFLOAT if the device can blend into it,
+    // R16_SFLOAT otherwise) and create the sampler. setLayout must outlive
+    // the target.
+    bool create(VkPhysicalDevice physicalDevice, VkDevice device, VkDescriptorSetLayout setLayout);
+
+    // Point a new descriptor set at the count image. Call whenever the render
+    // graph has (re)created its images. Frames in flight may still have the
+    // previous set bound, its pool is retired through deletionQueue.
+    bool setImageView(VkDevice device, VkImageView view, DeletionQueue& deletionQueue);
+
+    void destroy(VkDevice device);
+
+    // Accessors
+    VkFormat getFormat() const { return format_; }
+    VkDescriptorSet getSet() const { return set_; }
+
+private:
+    VkSampler sampler_{ VK_NULL_HANDLE };
+    VkFormat format_{ VK_FORMAT_R32_SFLOAT };
+    VkDescriptorSetLayout setLayout_{ VK_NULL_HANDLE };
+    VkDescriptorPool pool_{ VK_NULL_HANDLE };
+    VkDescriptorSet set_{ VK_NULL_HANDLE };
+};
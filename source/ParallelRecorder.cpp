@@ -0,0 +1,147 @@
+// ParallelRecorder.cpp
+#include "ParallelRecorder.h"
+
+#include <volk/volk.h>
+#include <algorithm>
+#include <iostream>
+
+ParallelRecorder::~ParallelRecorder()
+{
+	destroy();
+}
+
+bool ParallelRecorder::create(VkDevice device, uint32_t queueFamilyIndex, uint32_t threadCount, uint32_t frameCount)
+{
+	device_ = device;
+	workers_.resize(std::max(threadCount, 1u));
+	for (auto& worker : workers_) {
+		// Pools are only ever reset as a whole, so individual buffer resets are not needed
+		for (uint32_t i = 0; i < frameCount; ++i) {
+			worker.pools.emplace_back(device, queueFamilyIndex, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+			auto allocated = worker.pools.back().allocate(device, 1, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+			if (allocated.empty()) {
+				std::cerr << "Failed to allocate secondary command buffer" << std::endl;
+				destroy();
+				return false;
+			}
+			worker.buffers.push_back(allocated[0]);
+		}
+	}
+	// Start the threads only after the worker array is final, they index into it
+	for (uint32_t i = 0; i < workers_.size(); ++i) {
+		workers_[i].thread = std::thread(&ParallelRecorder::workerLoop, this, i);
+	}
+	return true;
+}
+
+void ParallelRecorder::destroy()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		quit_ = true;
+	}
+	jobReady_.notify_all();
+	for (auto& worker : workers_) {
+		if (worker.thread.joinable()) worker.thread.join();
+		for (auto& pool : worker.pools) pool.destroy();
+	}
+	workers_.clear();
+	executeList_.clear();
+	quit_ = false;
+}
+
+const std::vector<VkCommandBuffer>& ParallelRecorder::record(uint32_t frameIndex, const SecondaryRecordState& state, const std::vector<DrawItem>& draws)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		frameIndex_ = frameIndex;
+		state_ = &state;
+		draws_ = &draws;
+		pending_ = static_cast<uint32_t>(workers_.size());
+		generation_++;
+	}
+	jobReady_.notify_all();
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		jobDone_.wait(lock, [this] { return pending_ == 0; });
+	}
+
+	// Workers own consecutive slices, so worker order is draw list order
+	executeList_.clear();
+	for (auto& worker : workers_) {
+		if (worker.recorded) executeList_.push_back(worker.buffers[frameIndex]);
+	}
+	return executeList_;
+}
+
+void ParallelRecorder::workerLoop(uint32_t workerIndex)
+{
+	uint64_t seenGeneration{ 0 };
+	for (;;) {
+		uint32_t first{ 0 };
+		uint32_t count{ 0 };
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			jobReady_.wait(lock, [&] { return quit_ || generation_ != seenGeneration; });
+			if (quit_) return;
+			seenGeneration = generation_;
+			const uint32_t drawCount = static_cast<uint32_t>(draws_->size());
+			const uint32_t workerCount = static_cast<uint32_t>(workers_.size());
+			const uint32_t sliceSize = (drawCount + workerCount - 1) / workerCount;
+			first = std::min(workerIndex * sliceSize, drawCount);
+			count = std::min(sliceSize, drawCount - first);
+		}
+
+		recordSlice(workers_[workerIndex], first, count);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			pending_--;
+		}
+		jobDone_.notify_one();
+	}
+}
+
+void ParallelRecorder::recordSlice(Worker& worker, uint32_t first, uint32_t count)
+{
+	worker.recorded = false;
+	// The frame slot's fence has been waited on by the render loop, so nothing
+	// recorded from this pool is still in flight.
+	worker.pools[frameIndex_].reset();
+	if (count == 0) return;
+
+	const SecondaryRecordState& state = *state_;
+	VkCommandBuffer cb = worker.buffers[frameIndex_];
+	VkCommandBufferInheritanceRenderingInfo inheritanceRenderingInfo{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+		.colorAttachmentCount = 1,
+		.pColorAttachmentFormats = &state.colorFormat,
+		.depthAttachmentFormat = state.depthFormat,
+		.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT
+	};
+	VkCommandBufferInheritanceInfo inheritanceInfo{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+		.pNext = &inheritanceRenderingInfo,
+		.pipelineStatistics = state.pipelineStatistics
+	};
+	VkCommandBufferBeginInfo cbBI{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+		.pInheritanceInfo = &inheritanceInfo
+	};
+	vkBeginCommandBuffer(cb, &cbBI);
+	vkCmdSetViewportWithCount(cb, 1, &state.viewport);
+	vkCmdSetScissorWithCount(cb, 1, &state.scissor);
+	state.pipelineCompiler->bind(cb, state.pipeline);
+	vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, state.pipelineLayout, 0, 1, &state.descriptorSet, 0, nullptr);
+	VkDeviceSize vOffset{ 0 };
+	vkCmdBindVertexBuffers(cb, 0, 1, &state.vBuffer, &vOffset);
+	vkCmdBindIndexBuffer(cb, state.vBuffer, state.indexOffset, VK_INDEX_TYPE_UINT16);
+	vkCmdPushConstants(cb, state.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(VkDeviceAddress), &state.shaderDataAddress);
+	for (uint32_t i = first; i < first + count; ++i) {
+		const DrawItem& draw = (*draws_)[i];
+		vkCmdDrawIndexed(cb, draw.indexCount, draw.instanceCount, draw.firstIndex, draw.vertexOffset, draw.firstInstance);
+	}
+	vkEndCommandBuffer(cb);
+	worker.recorded = true;
+}
@@ -0,0 +1,86 @@
+// ParallelRecorder.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "CommandPool.h"
+#include "PipelineCompiler.h" // for PipelineHandle
+#include "VulkanApp.h" // for DrawItem
+
+// Everything a secondary command buffer needs to draw on its own. Secondary
+// buffers inherit no state from the primary, so pipeline, descriptors, vertex
+// data and dynamic state are re-bound by every worker.
+struct SecondaryRecordState {
+    VkFormat colorFormat{ VK_FORMAT_UNDEFINED };
+    VkFormat depthFormat{ VK_FORMAT_UNDEFINED };
+    // Bound through the compiler, which also sets the pipeline's dynamic state
+    const PipelineCompiler* pipelineCompiler{ nullptr };
+    PipelineHandle pipeline{ invalidPipelineHandle };
+    VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
+    VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
+    VkBuffer vBuffer{ VK_NULL_HANDLE };
+    VkDeviceSize indexOffset{ 0 };
+    VkDeviceAddress shaderDataAddress{ 0 };
+    VkViewport viewport{};
+    VkRect2D scissor{};
+    // Statistics of a query that is active in the primary while the secondaries execute
+    VkQueryPipelineStatisticFlags pipelineStatistics{ 0 };
+};
+
+// Records slices of a draw list into secondary command buffers on a set of
+// persistent worker threads. Each worker owns one command pool per frame in
+// flight; a pool is reset as a whole with vkResetCommandPool once its frame
+// slot's fence has signaled, so individual buffers are never reset.
+class ParallelRecorder {
+public:
+    ParallelRecorder() = default;
+    ~ParallelRecorder();
+
+    // Non-copyable
+    ParallelRecorder(const ParallelRecorder&) = delete;
+    ParallelRecorder& operator=(const ParallelRecorder&) = delete;
+
+    // Start threadCount workers and create their command pools and secondary buffers.
+    bool create(VkDevice device, uint32_t queueFamilyIndex, uint32_t threadCount, uint32_t frameCount);
+
+    // Stop the workers and destroy their pools. The device must be idle.
+    void destroy();
+
+    // Record draws into secondary command buffers for the given frame slot
+    // and block until all workers are done. The returned buffers (in draw list
+    // order) are to be executed inside a rendering instance begun with
+    // VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT.
+    const std::vector<VkCommandBuffer>& record(uint32_t frameIndex, const SecondaryRecordState& state, const std::vector<DrawItem>& draws);
+
+    uint32_t getThreadCount() const { return static_cast<uint32_t>(workers_.size()); }
+
+private:
+    struct Worker {
+        std::thread thread;
+        std::vector<CommandPool> pools;          // one per frame in flight
+        std::vector<VkCommandBuffer> buffers;    // one secondary per pool
+        bool recorded{ false };
+    };
+
+    void workerLoop(uint32_t workerIndex);
+    void recordSlice(Worker& worker, uint32_t first, uint32_t count);
+
+    VkDevice device_{ VK_NULL_HANDLE };
+    std::vector<Worker> workers_;
+    std::vector<VkCommandBuffer> executeList_;
+
+    // Job shared with the workers, guarded by mutex_
+    std::mutex mutex_;
+    std::condition_variable jobReady_;
+    std::condition_variable jobDone_;
+    uint64_t generation_{ 0 };
+    uint32_t pending_{ 0 };
+    bool quit_{ false };
+    uint32_t frameIndex_{ 0 };
+    const SecondaryRecordState* state_{ nullptr };
+    const std::vector<DrawItem>* draws_{ nullptr };
+};
@@ -0,0 +1,205 @@
+// PersistentBuffer.cpp
+#include "PersistentBuffer.h"
+#include "DeletionQueue.h"
+
+#include <volk/volk.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+bool PersistentBuffer::create(VkDevice device, VmaAllocator allocator, DeletionQueue* deletionQueue, VkDeviceSize size, VkBufferUsageFlags usage, bool deviceLocal)
+{
+	device_ = device;
+	allocator_ = allocator;
+	deletionQueue_ = deletionQueue;
+	deviceLocal_ = deviceLocal;
+	size_ = size;
+	shadow_.assign(size, 0);
+	usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+	if (deviceLocal_) {
+		if (!createBuffer(buffers_[0], size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 0, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE) || !reserveStaging(size)) {
+			return false;
+		}
+	} else {
+		for (auto& buffer : buffers_) {
+			if (!createBuffer(buffer, size, usage, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT, VMA_MEMORY_USAGE_AUTO)) {
+				return false;
+			}
+		}
+	}
+	// The initial contents are undefined, upload everything once
+	markDirty(0, size);
+	return true;
+}
+
+void PersistentBuffer::destroy()
+{
+	for (auto& buffer : buffers_) {
+		destroyBuffer(buffer);
+	}
+	destroyBuffer(staging_);
+	stagingSlotSize_ = 0;
+	for (auto& ranges : dirty_) {
+		ranges.clear();
+	}
+	for (auto& copies : copies_) {
+		copies.clear();
+	}
+	shadow_.clear();
+	size_ = 0;
+}
+
+bool PersistentBuffer::createBuffer(Buffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage, VmaAllocationCreateFlags flags, VmaMemoryUsage memoryUsage)
+{
+	VkBufferCreateInfo bufferCI{ .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = size, .usage = usage };
+	VmaAllocationCreateInfo allocCI{ .flags = flags, .usage = memoryUsage };
+	VmaAllocationInfo allocInfo{};
+	VkResult r = vmaCreateBuffer(allocator_, &bufferCI, &allocCI, &buffer.buffer, &buffer.allocation, &allocInfo);
+	if (r != VK_SUCCESS) {
+		std::cerr << "Failed to create persistent buffer: " << r << std::endl;
+		return false;
+	}
+	buffer.mapped = allocInfo.pMappedData;
+	VkMemoryPropertyFlags memoryFlags{ 0 };
+	vmaGetAllocationMemoryProperties(allocator_, buffer.allocation, &memoryFlags);
+	buffer.coherent = (memoryFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+	if (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
+		VkBufferDeviceAddressInfo bdaInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = buffer.buffer };
+		buffer.deviceAddress = vkGetBufferDeviceAddress(device_, &bdaInfo);
+	}
+	return true;
+}
+
+void PersistentBuffer::destroyBuffer(Buffer& buffer)
+{
+	if (buffer.buffer != VK_NULL_HANDLE) {
+		vmaDestroyBuffer(allocator_, buffer.buffer, buffer.allocation);
+	}
+	buffer = {};
+}
+
+bool PersistentBuffer::reserveStaging(VkDeviceSize slotSize)
+{
+	if (slotSize <= stagingSlotSize_) {
+		return true;
+	}
+	if (staging_.buffer != VK_NULL_HANDLE) {
+		// Regions of other slots may still be read by frames in flight
+		if (deletionQueue_ != nullptr) {
+			deletionQueue_->retireBuffer(staging_.buffer, staging_.allocation);
+			staging_ = {};
+		} else {
+			vkDeviceWaitIdle(device_);
+			destroyBuffer(staging_);
+		}
+	}
+	stagingSlotSize_ = std::max({ slotSize, stagingSlotSize_ * 2, VkDeviceSize(64 * 1024) });
+	if (!createBuffer(staging_, stagingSlotSize_ * VulkanApp::maxFramesInFlight, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT, VMA_MEMORY_USAGE_AUTO_PREFER_HOST)) {
+		stagingSlotSize_ = 0;
+		return false;
+	}
+	return true;
+}
+
+void PersistentBuffer::markDirty(VkDeviceSize offset, VkDeviceSize size)
+{
+	const size_t lists = deviceLocal_ ? 1 : dirty_.size();
+	for (size_t i = 0; i < lists; i++) {
+		auto& ranges = dirty_[i];
+		if (!ranges.empty() && offset + size + mergeDistance >= ranges.back().offset && offset <= ranges.back().offset + ranges.back().size + mergeDistance) {
+			Range& last = ranges.back();
+			const VkDeviceSize end = std::max(last.offset + last.size, offset + size);
+			last.offset = std::min(last.offset, offset);
+			last.size = end - last.offset;
+		} else {
+			ranges.push_back({ offset, size });
+		}
+	}
+}
+
+void PersistentBuffer::write(VkDeviceSize offset, const void* data, VkDeviceSize size)
+{
+	// Only the span between the first and the last changed byte is marked
+	const auto* source = static_cast<const uint8_t*>(data);
+	uint8_t* destination = shadow_.data() + offset;
+	VkDeviceSize first{ 0 };
+	while (first < size && source[first] == destination[first]) {
+		first++;
+	}
+	if (first == size) {
+		return;
+	}
+	VkDeviceSize last{ size };
+	while (last > first && source[last - 1] == destination[last - 1]) {
+		last--;
+	}
+	memcpy(destination + first, source + first, last - first);
+	markDirty(offset + first, last - first);
+}
+
+bool PersistentBuffer::upload(uint32_t frameIndex)
+{
+	lastUploadSize_ = 0;
+	if (!deviceLocal_) {
+		Buffer& buffer = buffers_[frameIndex];
+		for (const Range& range : dirty_[frameIndex]) {
+			memcpy(static_cast<uint8_t*>(buffer.mapped) + range.offset, shadow_.data() + range.offset, range.size);
+			if (!buffer.coherent) {
+				vmaFlushAllocation(allocator_, buffer.allocation, range.offset, range.size);
+			}
+			lastUploadSize_ += range.size;
+		}
+		dirty_[frameIndex].clear();
+		return true;
+	}
+
+	VkDeviceSize total{ 0 };
+	for (const Range& range : dirty_[0]) {
+		total += range.size;
+	}
+	if (!reserveStaging(total)) {
+		return false;
+	}
+	auto& copies = copies_[frameIndex];
+	copies.clear();
+	const VkDeviceSize slotOffset = frameIndex * stagingSlotSize_;
+	for (const Range& range : dirty_[0]) {
+		memcpy(static_cast<uint8_t*>(staging_.mapped) + slotOffset + lastUploadSize_, shadow_.data() + range.offset, range.size);
+		copies.push_back({ .srcOffset = slotOffset + lastUploadSize_, .dstOffset = range.offset, .size = range.size });
+		lastUploadSize_ += range.size;
+	}
+	if (!staging_.coherent && lastUploadSize_ > 0) {
+		vmaFlushAllocation(allocator_, staging_.allocation, slotOffset, lastUploadSize_);
+	}
+	dirty_[0].clear();
+	return true;
+}
+
+void PersistentBuffer::recordCopies(VkCommandBuffer cb, uint32_t frameIndex) const
+{
+	const auto& copies = copies_[frameIndex];
+	if (!deviceLocal_ || copies.empty()) {
+		return;
+	}
+	// Earlier frames may still read (or copy into) the buffer
+	VkMemoryBarrier2 beforeCopy{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+		.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+		.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+		.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+		.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT
+	};
+	VkDependencyInfo dependencyInfo{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .memoryBarrierCount = 1, .pMemoryBarriers = &beforeCopy };
+	vkCmdPipelineBarrier2(cb, &dependencyInfo);
+	vkCmdCopyBuffer(cb, staging_.buffer, buffers_[0].buffer, static_cast<uint32_t>(copies.size()), copies.data());
+	// Shaders read the buffer through its device address
+	VkMemoryBarrier2 afterCopy{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+		.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+		.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+		.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+		.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT
+	};
+	dependencyInfo.pMemoryBarriers = &afterCopy;
+	vkCmdPipelineBarrier2(cb, &dependencyInfo);
+}
@@ -0,0 +1,92 @@
+// PersistentBuffer.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vma/vk_mem_alloc.h>
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "VulkanApp.h" // for maxFramesInFlight
+
+class DeletionQueue; // forward
+
+// GPU buffer that mirrors a CPU copy and only uploads what changed. write()
+// updates the CPU copy and records the bytes that actually differ as dirty
+// ranges; upload() then transfers just those ranges. Shaders read the buffer
+// through its device address.
+//
+// Host path: one host-visible copy per frame in flight. upload() writes the
+// slot's pending ranges into its mapped memory and flushes exactly those
+// ranges if the memory isn't coherent. Ranges stay pending for the other
+// slots until they are updated in turn.
+//
+// Device path: a single device-local buffer. upload() packs the pending
+// ranges into the frame slot's region of a host-visible staging ring, and
+// recordCopies() scatters them into the buffer with one vkCmdCopyBuffer,
+// so the copies must be recorded in that frame's command buffer before any
+// reader. Writes after recording don't reach the GPU until the next frame.
+class PersistentBuffer {
+public:
+    PersistentBuffer() = default;
+    ~PersistentBuffer() = default;
+
+    // A staging ring that has to grow is retired through deletionQueue, without
+    // one the device is waited for
+    bool create(VkDevice device, VmaAllocator allocator, DeletionQueue* deletionQueue, VkDeviceSize size, VkBufferUsageFlags usage, bool deviceLocal);
+    void destroy();
+
+    void write(VkDeviceSize offset, const void* data, VkDeviceSize size);
+    template <typename T>
+    void write(VkDeviceSize offset, const T& value) { write(offset, &value, sizeof(T)); }
+
+    // Transfer the pending changes for the given frame slot (see above). Must
+    // only be called once the slot's previous frame has completed. Grows the
+    // staging ring if needed, see create().
+    bool upload(uint32_t frameIndex);
+    // Device path only, no-op for the host path
+    void recordCopies(VkCommandBuffer cb, uint32_t frameIndex) const;
+
+    VkDeviceAddress getDeviceAddress(uint32_t frameIndex) const { return deviceLocal_ ? buffers_[0].deviceAddress : buffers_[frameIndex].deviceAddress; }
+    VkDeviceSize getSize() const { return size_; }
+    bool isDeviceLocal() const { return deviceLocal_; }
+    // Bytes transferred by the last upload()
+    VkDeviceSize getLastUploadSize() const { return lastUploadSize_; }
+
+private:
+    struct Buffer {
+        VkBuffer buffer{ VK_NULL_HANDLE };
+        VmaAllocation allocation{ VK_NULL_HANDLE };
+        VkDeviceAddress deviceAddress{ 0 };
+        void* mapped{ nullptr };
+        bool coherent{ true };
+    };
+    struct Range {
+        VkDeviceSize offset{ 0 };
+        VkDeviceSize size{ 0 };
+    };
+
+    bool createBuffer(Buffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage, VmaAllocationCreateFlags flags, VmaMemoryUsage memoryUsage);
+    void destroyBuffer(Buffer& buffer);
+    bool reserveStaging(VkDeviceSize slotSize);
+    void markDirty(VkDeviceSize offset, VkDeviceSize size);
+
+    // Ranges closer than this are merged, copying the few clean bytes in
+    // between is cheaper than an extra copy region or flush
+    static constexpr VkDeviceSize mergeDistance = 64;
+
+    VkDevice device_{ VK_NULL_HANDLE };
+    VmaAllocator allocator_{ VK_NULL_HANDLE };
+    DeletionQueue* deletionQueue_{ nullptr };
+    bool deviceLocal_{ false };
+    VkDeviceSize size_{ 0 };
+    std::vector<uint8_t> shadow_;
+    // Host path: one buffer per slot, device path: buffers_[0] only
+    std::array<Buffer, VulkanApp::maxFramesInFlight> buffers_{};
+    // Host path: pending ranges per slot, device path: dirty_[0] only
+    std::array<std::vector<Range>, VulkanApp::maxFramesInFlight> dirty_{};
+    // Device path: staging ring with one region per slot, and the copies staged for each slot
+    Buffer staging_{};
+    VkDeviceSize stagingSlotSize_{ 0 };
+    std::array<std::vector<VkBufferCopy>, VulkanApp::maxFramesInFlight> copies_{};
+    VkDeviceSize lastUploadSize_{ 0 };
+};
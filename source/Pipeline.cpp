@@ -1,45 +1,82 @@
 // Pipeline.cpp
 #include "Pipeline.h"
+#include "PipelineCache.h"
 
 #include <volk/volk.h>
 #include <vector>
 #include <iostream>
 
-VkPipeline Pipeline::createGraphics(VkDevice device,
-									VkPipelineLayout layout,
-									VkShaderModule shaderModule,
-									const VkVertexInputBindingDescription& vertexBinding,
-									const std::vector<VkVertexInputAttributeDescription>& vertexAttributes,
-									VkFormat colorFormat,
-									VkFormat depthFormat) const
+VkPipeline Pipeline::createGraphics(VkDevice device, VkShaderModule shaderModule, const PipelineDesc& desc) const
 {
-	// Shader stages (use the provided module for both stages as in the original sample)
-	std::vector<VkPipelineShaderStageCreateInfo> shaderStages(2);
-	shaderStages[0] = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr, 0, VK_SHADER_STAGE_VERTEX_BIT, shaderModule, "main", nullptr };
-	shaderStages[1] = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr, 0, VK_SHADER_STAGE_FRAGMENT_BIT, shaderModule, "main", nullptr };
+	return create(device, 0, shaderModule, desc);
+}
+
+VkPipeline Pipeline::createLibrary(VkDevice device, VkGraphicsPipelineLibraryFlagsEXT parts, VkShaderModule shaderModule, const PipelineDesc& desc) const
+{
+	return create(device, parts, shaderModule, desc);
+}
+
+VkPipeline Pipeline::create(VkDevice device, VkGraphicsPipelineLibraryFlagsEXT parts, VkShaderModule shaderModule, const PipelineDesc& desc) const
+{
+	// Specialization constants, one 32 bit value each, shared by both stages
+	std::vector<VkSpecializationMapEntry> specializationEntries;
+	std::vector<uint32_t> specializationData;
+	for (const auto& constant : desc.specialization) {
+		specializationEntries.push_back({ .constantID = constant.id, .offset = static_cast<uint32_t>(specializationData.size() * sizeof(uint32_t)), .size = sizeof(uint32_t) });
+		specializationData.push_back(constant.value);
+	}
+	VkSpecializationInfo specializationInfo{
+		.mapEntryCount = static_cast<uint32_t>(specializationEntries.size()),
+		.pMapEntries = specializationEntries.data(),
+		.dataSize = specializationData.size() * sizeof(uint32_t),
+		.pData = specializationData.data()
+	};
+	const VkSpecializationInfo* specialization = desc.specialization.empty() ? nullptr : &specializationInfo;
+
+	// A library may only contain the stages of its parts
+	const bool monolithic = parts == 0;
+	std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+	if (monolithic || (parts & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT)) {
+		shaderStages.push_back({ VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr, 0, VK_SHADER_STAGE_VERTEX_BIT, shaderModule, desc.vertexEntryPoint.c_str(), specialization });
+	}
+	if (monolithic || (parts & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT)) {
+		shaderStages.push_back({ VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr, 0, VK_SHADER_STAGE_FRAGMENT_BIT, shaderModule, desc.fragmentEntryPoint.c_str(), specialization });
+	}
 
 	// Vertex input
 	VkPipelineVertexInputStateCreateInfo vertexInputState{ VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
-	vertexInputState.vertexBindingDescriptionCount = 1;
-	vertexInputState.pVertexBindingDescriptions = &vertexBinding;
-	vertexInputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexAttributes.size());
-	vertexInputState.pVertexAttributeDescriptions = vertexAttributes.data();
+	if (desc.useVertexInput) {
+		vertexInputState.vertexBindingDescriptionCount = 1;
+		vertexInputState.pVertexBindingDescriptions = &desc.vertexBinding;
+		vertexInputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.vertexAttributes.size());
+		vertexInputState.pVertexAttributeDescriptions = desc.vertexAttributes.data();
+	}
 
 	// Input assembly
 	VkPipelineInputAssemblyStateCreateInfo inputAssemblyState{ VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
-	inputAssemblyState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	inputAssemblyState.topology = desc.topology;
 
-	// Dynamic states (viewport + scissor)
-	std::vector<VkDynamicState> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	// Dynamic states, see setDynamicState()
+	std::vector<VkDynamicState> dynamicStates = {
+		VK_DYNAMIC_STATE_VIEWPORT_WITH_COUNT, VK_DYNAMIC_STATE_SCISSOR_WITH_COUNT,
+		VK_DYNAMIC_STATE_CULL_MODE, VK_DYNAMIC_STATE_FRONT_FACE,
+		VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE, VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE, VK_DYNAMIC_STATE_DEPTH_COMPARE_OP
+	};
+	if (features_.extendedDynamicState3) {
+		dynamicStates.insert(dynamicStates.end(), {
+			VK_DYNAMIC_STATE_POLYGON_MODE_EXT,
+			VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT, VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT, VK_DYNAMIC_STATE_COLOR_WRITE_MASK_EXT
+		});
+	}
 	VkPipelineDynamicStateCreateInfo dynamicState{ VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
 	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
 	dynamicState.pDynamicStates = dynamicStates.data();
 
 	// Rasterization
 	VkPipelineRasterizationStateCreateInfo rasterizationState{ VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
-	rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizationState.cullMode = VK_CULL_MODE_BACK_BIT;
-	rasterizationState.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterizationState.polygonMode = desc.polygonMode;
+	rasterizationState.cullMode = desc.cullMode;
+	rasterizationState.frontFace = desc.frontFace;
 	rasterizationState.lineWidth = 1.0f;
 
 	// Multisample
@@ -48,13 +85,21 @@ VkPipeline Pipeline::createGraphics(VkDevice device,
 
 	// Depth/stencil
 	VkPipelineDepthStencilStateCreateInfo depthStencilState{ VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
-	depthStencilState.depthTestEnable = VK_TRUE;
-	depthStencilState.depthWriteEnable = VK_TRUE;
-	depthStencilState.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+	depthStencilState.depthTestEnable = desc.depthTest ? VK_TRUE : VK_FALSE;
+	depthStencilState.depthWriteEnable = desc.depthTest && desc.depthWrite ? VK_TRUE : VK_FALSE;
+	depthStencilState.depthCompareOp = desc.depthCompareOp;
 
 	// Color blend
-	VkPipelineColorBlendAttachmentState blendAttachment{};
-	blendAttachment.colorWriteMask = 0xF;
+	VkPipelineColorBlendAttachmentState blendAttachment{
+		.blendEnable = desc.blend.enable ? VK_TRUE : VK_FALSE,
+		.srcColorBlendFactor = desc.blend.srcColor,
+		.dstColorBlendFactor = desc.blend.dstColor,
+		.colorBlendOp = desc.blend.colorOp,
+		.srcAlphaBlendFactor = desc.blend.srcAlpha,
+		.dstAlphaBlendFactor = desc.blend.dstAlpha,
+		.alphaBlendOp = desc.blend.alphaOp,
+		.colorWriteMask = desc.blend.writeMask
+	};
 	VkPipelineColorBlendStateCreateInfo colorBlendState{ VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
 	colorBlendState.attachmentCount = 1;
 	colorBlendState.pAttachments = &blendAttachment;
@@ -62,13 +107,12 @@ VkPipeline Pipeline::createGraphics(VkDevice device,
 	// Rendering info (dynamic rendering)
 	VkPipelineRenderingCreateInfo renderingCI{ VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO };
 	renderingCI.colorAttachmentCount = 1;
-	renderingCI.pColorAttachmentFormats = &colorFormat;
-	renderingCI.depthAttachmentFormat = depthFormat;
+	renderingCI.pColorAttachmentFormats = &desc.colorFormat;
+	renderingCI.depthAttachmentFormat = desc.depthFormat;
 
-	// Viewport state (no static viewport because we use dynamic state)
+	// Viewport state, counts included are dynamic: shader objects only have
+	// the WITH_COUNT states, so passes record the same commands for both backends
 	VkPipelineViewportStateCreateInfo viewportState{ VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
-	viewportState.viewportCount = 1;
-	viewportState.scissorCount = 1;
 
 	VkGraphicsPipelineCreateInfo pipelineCI{ VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
 	pipelineCI.pNext = &renderingCI;
@@ -82,14 +126,123 @@ VkPipeline Pipeline::createGraphics(VkDevice device,
 	pipelineCI.pDepthStencilState = &depthStencilState;
 	pipelineCI.pColorBlendState = &colorBlendState;
 	pipelineCI.pDynamicState = &dynamicState;
-	pipelineCI.layout = layout;
+	pipelineCI.layout = desc.layout;
+
+	// Parts are built as libraries, everything outside of them is ignored
+	VkGraphicsPipelineLibraryCreateInfoEXT libraryCI{ .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT, .flags = parts };
+	if (!monolithic) {
+		libraryCI.pNext = pipelineCI.pNext;
+		pipelineCI.pNext = &libraryCI;
+		pipelineCI.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR;
+	}
+
+	// Creation feedback tells the cache whether the driver could reuse a cached pipeline
+	VkPipelineCreationFeedback feedback{};
+	VkPipelineCreationFeedbackCreateInfo feedbackCI{ .sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO, .pPipelineCreationFeedback = &feedback };
+	if (cache_ != nullptr) {
+		feedbackCI.pNext = pipelineCI.pNext;
+		pipelineCI.pNext = &feedbackCI;
+	}
 
 	VkPipeline pipeline = VK_NULL_HANDLE;
-	VkResult r = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineCI, nullptr, &pipeline);
+	VkResult r = vkCreateGraphicsPipelines(device, cache_ ? cache_->get() : VK_NULL_HANDLE, 1, &pipelineCI, nullptr, &pipeline);
 	if (r != VK_SUCCESS) {
 		std::cerr << "vkCreateGraphicsPipelines failed: " << r << std::endl;
 		return VK_NULL_HANDLE;
 	}
+	if (cache_ != nullptr) {
+		cache_->record(feedback);
+	}
 
 	return pipeline;
 }
+
+VkPipeline Pipeline::link(VkDevice device, VkPipelineLayout layout, const VkPipeline* libraries, uint32_t libraryCount) const
+{
+	VkPipelineLibraryCreateInfoKHR libraryCI{ .sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR, .libraryCount = libraryCount, .pLibraries = libraries };
+	VkGraphicsPipelineCreateInfo pipelineCI{ .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO, .pNext = &libraryCI, .layout = layout };
+
+	VkPipelineCreationFeedback feedback{};
+	VkPipelineCreationFeedbackCreateInfo feedbackCI{ .sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO, .pPipelineCreationFeedback = &feedback };
+	if (cache_ != nullptr) {
+		libraryCI.pNext = &feedbackCI;
+	}
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkResult r = vkCreateGraphicsPipelines(device, cache_ ? cache_->get() : VK_NULL_HANDLE, 1, &pipelineCI, nullptr, &pipeline);
+	if (r != VK_SUCCESS) {
+		std::cerr << "Linking graphics pipeline failed: " << r << std::endl;
+		return VK_NULL_HANDLE;
+	}
+	if (cache_ != nullptr) {
+		cache_->record(feedback);
+	}
+
+	return pipeline;
+}
+
+VkPipeline Pipeline::createCompute(VkDevice device, VkPipelineLayout layout, VkShaderModule shaderModule, const char* entryPoint) const
+{
+	VkComputePipelineCreateInfo pipelineCI{ VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+	pipelineCI.stage = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr, 0, VK_SHADER_STAGE_COMPUTE_BIT, shaderModule, entryPoint, nullptr };
+	pipelineCI.layout = layout;
+
+	VkPipelineCreationFeedback feedback{};
+	VkPipelineCreationFeedbackCreateInfo feedbackCI{ .sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO, .pPipelineCreationFeedback = &feedback };
+	if (cache_ != nullptr) {
+		pipelineCI.pNext = &feedbackCI;
+	}
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkResult r = vkCreateComputePipelines(device, cache_ ? cache_->get() : VK_NULL_HANDLE, 1, &pipelineCI, nullptr, &pipeline);
+	if (r != VK_SUCCESS) {
+		std::cerr << "vkCreateComputePipelines failed: " << r << std::endl;
+		return VK_NULL_HANDLE;
+	}
+	if (cache_ != nullptr) {
+		cache_->record(feedback);
+	}
+
+	return pipeline;
+}
+
+PipelineDesc Pipeline::getStaticState(const PipelineDesc& desc) const
+{
+	// Keep in sync with the dynamic states in create()
+	const PipelineDesc defaults{};
+	PipelineDesc result = desc;
+	result.cullMode = defaults.cullMode;
+	result.frontFace = defaults.frontFace;
+	result.depthTest = defaults.depthTest;
+	result.depthWrite = defaults.depthWrite;
+	result.depthCompareOp = defaults.depthCompareOp;
+	if (features_.extendedDynamicState3) {
+		result.polygonMode = defaults.polygonMode;
+		result.blend = defaults.blend;
+	}
+	return result;
+}
+
+void Pipeline::setDynamicState(VkCommandBuffer cb, const PipelineDesc& desc) const
+{
+	vkCmdSetCullMode(cb, desc.cullMode);
+	vkCmdSetFrontFace(cb, desc.frontFace);
+	vkCmdSetDepthTestEnable(cb, desc.depthTest ? VK_TRUE : VK_FALSE);
+	vkCmdSetDepthWriteEnable(cb, desc.depthTest && desc.depthWrite ? VK_TRUE : VK_FALSE);
+	vkCmdSetDepthCompareOp(cb, desc.depthCompareOp);
+	if (features_.extendedDynamicState3) {
+		vkCmdSetPolygonModeEXT(cb, desc.polygonMode);
+		const VkBool32 blendEnable = desc.blend.enable ? VK_TRUE : VK_FALSE;
+		vkCmdSetColorBlendEnableEXT(cb, 0, 1, &blendEnable);
+		const VkColorBlendEquationEXT blendEquation{
+			.srcColorBlendFactor = desc.blend.srcColor,
+			.dstColorBlendFactor = desc.blend.dstColor,
+			.colorBlendOp = desc.blend.colorOp,
+			.srcAlphaBlendFactor = desc.blend.srcAlpha,
+			.dstAlphaBlendFactor = desc.blend.dstAlpha,
+			.alphaBlendOp = desc.blend.alphaOp
+		};
+		vkCmdSetColorBlendEquationEXT(cb, 0, 1, &blendEquation);
+		vkCmdSetColorWriteMaskEXT(cb, 0, 1, &desc.blend.writeMask);
+	}
+}
@@ -2,22 +2,66 @@
 #pragma once
 
 #include <vulkan/vulkan.h>
-#include <vector>
+#include "PipelineDesc.h"
+
+class PipelineCache; // forward
+
+// Optional ways of building graphics pipelines, filled in from what the
+// device supports (see DeviceFeatureRequest)
+struct PipelineFeatures {
+    // VK_EXT_graphics_pipeline_library: vertex input, pre-rasterization,
+    // fragment shader and fragment output state are built as separate parts
+    // and linked (see PipelineLibrary)
+    bool graphicsPipelineLibrary = false;
+    // VK_EXT_extended_dynamic_state3: polygon mode and blend state are set
+    // at draw time instead of being baked into the pipeline
+    bool extendedDynamicState3 = false;
+    // VK_EXT_shader_object: shader objects and dynamic state replace
+    // pipelines entirely (see ShaderObject), the options above are unused
+    bool shaderObject = false;
+};
 
 class Pipeline {
 public:
     Pipeline() = default;
+    // Create pipelines through the given cache and report their creation feedback to it
+    explicit Pipeline(PipelineCache* cache, const PipelineFeatures& features = {}) : cache_(cache), features_(features) {}
     ~Pipeline() = default;
 
-    // Create a graphics pipeline using the provided shader module (used for both
-    // vertex and fragment stages), the pipeline layout, vertex input descriptions
-    // and the color/depth formats. Returns VK_NULL_HANDLE on failure.
-    VkPipeline createGraphics(
-        VkDevice device,
-        VkPipelineLayout layout,
-        VkShaderModule shaderModule,
-        const VkVertexInputBindingDescription& vertexBinding,
-        const std::vector<VkVertexInputAttributeDescription>& vertexAttributes,
-        VkFormat colorFormat,
-        VkFormat depthFormat) const;
+    // Create a monolithic graphics pipeline from the given description, with
+    // both stages taken from shaderModule (built from desc.shaderPath). The
+    // state setDynamicState() records is left dynamic. Returns VK_NULL_HANDLE
+    // on failure.
+    VkPipeline createGraphics(VkDevice device, VkShaderModule shaderModule, const PipelineDesc& desc) const;
+
+    // Create a pipeline library holding only the given parts of desc (any
+    // combination of VkGraphicsPipelineLibraryFlagBitsEXT). shaderModule is
+    // only used for the shader parts. Returns VK_NULL_HANDLE on failure.
+    VkPipeline createLibrary(VkDevice device, VkGraphicsPipelineLibraryFlagsEXT parts, VkShaderModule shaderModule, const PipelineDesc& desc) const;
+    // Link a complete pipeline from libraries that together hold all four
+    // parts. Without link time optimization this is cheap, it mostly
+    // combines the already compiled parts. Returns VK_NULL_HANDLE on failure.
+    VkPipeline link(VkDevice device, VkPipelineLayout layout, const VkPipeline* libraries, uint32_t libraryCount) const;
+
+    // Create a compute pipeline from the given entry point of shaderModule.
+    // Returns VK_NULL_HANDLE on failure.
+    VkPipeline createCompute(VkDevice device, VkPipelineLayout layout, VkShaderModule shaderModule, const char* entryPoint) const;
+
+    // desc with everything that is dynamic state reset to the defaults.
+    // Descriptions with equal static state can share one pipeline.
+    PipelineDesc getStaticState(const PipelineDesc& desc) const;
+    // Record the dynamic state of desc. Needed after every bind of a pipeline
+    // created by this class, cull mode, front face and depth state are always
+    // dynamic (core in Vulkan 1.3), polygon mode and blending with
+    // extendedDynamicState3.
+    void setDynamicState(VkCommandBuffer cb, const PipelineDesc& desc) const;
+
+    const PipelineFeatures& getFeatures() const { return features_; }
+
+private:
+    // parts == 0 creates a monolithic pipeline
+    VkPipeline create(VkDevice device, VkGraphicsPipelineLibraryFlagsEXT parts, VkShaderModule shaderModule, const PipelineDesc& desc) const;
+
+    PipelineCache* cache_{ nullptr };
+    PipelineFeatures features_{};
 };
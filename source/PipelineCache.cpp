@@ -0,0 +1,130 @@
+// PipelineCache.cpp
+#include "PipelineCache.h"
+
+#include <volk/volk.h>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+namespace {
+
+// Returns the reason the blob can't be used on this device, or nullptr
+const char* checkHeader(const std::vector<char>& data, const VkPhysicalDeviceProperties& properties)
+{
+	VkPipelineCacheHeaderVersionOne header{};
+	if (data.size() < sizeof(header)) {
+		return "truncated";
+	}
+	memcpy(&header, data.data(), sizeof(header));
+	if (header.headerSize < sizeof(header) || header.headerSize > data.size() || header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) {
+		return "unknown header";
+	}
+	if (header.vendorID != properties.vendorID || header.deviceID != properties.deviceID) {
+		return "written for a different device";
+	}
+	if (memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+		return "written by a different driver version";
+	}
+	return nullptr;
+}
+
+} // namespace
+
+bool PipelineCache::create(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path)
+{
+	device_ = device;
+	path_ = path;
+
+	std::vector<char> data;
+	std::ifstream file(path, std::ios::binary);
+	if (file) {
+		data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		VkPhysicalDeviceProperties properties{};
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		if (const char* reason = checkHeader(data, properties)) {
+			std::cout << "Ignoring pipeline cache " << path << " (" << reason << ")\n";
+			data.clear();
+		}
+	}
+
+	VkPipelineCacheCreateInfo cacheCI{ .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO, .initialDataSize = data.size(), .pInitialData = data.data() };
+	VkResult r = vkCreatePipelineCache(device, &cacheCI, nullptr, &cache_);
+	if (r != VK_SUCCESS && !data.empty()) {
+		// The header was fine but the driver still rejects the contents
+		std::cout << "Ignoring pipeline cache " << path << " (rejected by the driver)\n";
+		cacheCI.initialDataSize = 0;
+		cacheCI.pInitialData = nullptr;
+		r = vkCreatePipelineCache(device, &cacheCI, nullptr, &cache_);
+	}
+	if (r != VK_SUCCESS) {
+		std::cerr << "vkCreatePipelineCache failed: " << r << std::endl;
+		return false;
+	}
+	if (!data.empty()) {
+		std::cout << "Loaded pipeline cache " << path << " (" << data.size() / 1024 << " KiB)\n";
+	}
+	return true;
+}
+
+void PipelineCache::destroy()
+{
+	if (cache_ == VK_NULL_HANDLE) {
+		return;
+	}
+	if (created_ > 0) {
+		std::cout << "Pipeline cache: " << hits_ << " of " << created_ << " pipelines found in the cache";
+		if (unknown_ > 0) {
+			std::cout << " (" << unknown_ << " without feedback)";
+		}
+		std::cout << ", " << static_cast<double>(durationNs_) / 1e6 << " ms spent creating pipelines\n";
+	}
+	save();
+	vkDestroyPipelineCache(device_, cache_, nullptr);
+	cache_ = VK_NULL_HANDLE;
+}
+
+void PipelineCache::record(const VkPipelineCreationFeedback& feedback)
+{
+	created_++;
+	if (!(feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT)) {
+		unknown_++;
+		return;
+	}
+	if (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT) {
+		hits_++;
+	}
+	durationNs_ += feedback.duration;
+}
+
+bool PipelineCache::save() const
+{
+	size_t size{ 0 };
+	if (vkGetPipelineCacheData(device_, cache_, &size, nullptr) != VK_SUCCESS || size == 0) {
+		return false;
+	}
+	std::vector<char> data(size);
+	if (vkGetPipelineCacheData(device_, cache_, &size, data.data()) != VK_SUCCESS) {
+		return false;
+	}
+	// Write next to the old file and swap it in, the rename replaces it atomically
+	const std::string temporaryPath = path_ + ".tmp";
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		file.write(data.data(), static_cast<std::streamsize>(size));
+		if (!file) {
+			std::cerr << "Failed to write pipeline cache " << temporaryPath << std::endl;
+			return false;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(temporaryPath, path_, error);
+	if (error) {
+		std::cerr << "Failed to replace pipeline cache " << path_ << ": " << error.message() << std::endl;
+		std::filesystem::remove(temporaryPath, error);
+		return false;
+	}
+	return true;
+}
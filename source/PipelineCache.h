@@ -0,0 +1,50 @@
+// PipelineCache.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// VkPipelineCache that persists across runs. create() loads the blob written
+// by the previous run if its header matches this device (vendor, device and
+// pipelineCacheUUID; a driver update changes the UUID), otherwise the cache
+// starts out empty. destroy() writes the current contents back, through a
+// temporary file that replaces the old one, so a crash while saving never
+// leaves a truncated cache behind.
+//
+// Pipelines created through the cache report creation feedback (core since
+// Vulkan 1.3, VK_EXT_pipeline_creation_feedback before), which tells whether
+// the driver found the pipeline in the cache. The hit rate and the time spent
+// creating pipelines are printed when the cache is destroyed.
+class PipelineCache {
+public:
+    PipelineCache() = default;
+    ~PipelineCache() = default;
+
+    bool create(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path);
+    // Saves the cache, then destroys it
+    void destroy();
+
+    VkPipelineCache get() const { return cache_; }
+
+    // Feedback of one pipeline creation, chain it into the create info's pNext
+    // and pass it to record() afterwards. Thread safe.
+    void record(const VkPipelineCreationFeedback& feedback);
+
+    uint32_t getCreatedCount() const { return created_; }
+    uint32_t getHitCount() const { return hits_; }
+
+private:
+    bool save() const;
+
+    VkDevice device_{ VK_NULL_HANDLE };
+    VkPipelineCache cache_{ VK_NULL_HANDLE };
+    std::string path_;
+    std::atomic<uint32_t> created_{ 0 };
+    // Creations the driver reported as cache hits
+    std::atomic<uint32_t> hits_{ 0 };
+    // Creations that reported no feedback
+    std::atomic<uint32_t> unknown_{ 0 };
+    std::atomic<uint64_t> durationNs_{ 0 };
+};
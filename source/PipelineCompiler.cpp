@@ -0,0 +1,411 @@
+// PipelineCompiler.cpp
+#include "PipelineCompiler.h"
+#include "DeletionQueue.h"
+#include "Hash.h"
+#include "PipelineCache.h"
+#include "ShaderCompiler.h"
+
+#include <volk/volk.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+
+PipelineCompiler::~PipelineCompiler()
+{
+	destroy();
+}
+
+bool PipelineCompiler::create(VkDevice device, PipelineCache* pipelineCache, const PipelineLayoutCache* layoutCache, const PipelineFeatures& features, const std::string& shaderCacheDirectory, bool readShaderCache, uint32_t threadCount)
+{
+	device_ = device;
+	pipelineHelper_ = Pipeline(pipelineCache, features);
+	shaderObjectHelper_ = ShaderObject(layoutCache);
+	if (features.graphicsPipelineLibrary && !features.shaderObject) {
+		library_.create(device, &pipelineHelper_);
+	}
+	shaderCacheDirectory_ = shaderCacheDirectory;
+	readShaderCache_ = readShaderCache;
+	for (uint32_t i = 0; i < std::max(threadCount, 1u); ++i) {
+		workers_.emplace_back(&PipelineCompiler::workerLoop, this);
+	}
+	return true;
+}
+
+void PipelineCompiler::destroy()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		quit_ = true;
+		jobs_.clear();
+	}
+	jobReady_.notify_all();
+	for (auto& worker : workers_) {
+		if (worker.joinable()) worker.join();
+	}
+	workers_.clear();
+	for (auto& build : builds_) {
+		destroyCompiled(build.compiled);
+		destroyCompiled(build.reloaded);
+	}
+	// Linked pipelines don't reference their parts, the order doesn't matter
+	library_.destroy();
+	builds_.clear();
+	slots_.clear();
+	registry_.clear();
+	buildRegistry_.clear();
+	reused_ = 0;
+	running_ = 0;
+	finished_ = 0;
+	reloadsReady_ = 0;
+	sourceVersion_ = 0;
+	quit_ = false;
+}
+
+PipelineHandle PipelineCompiler::request(const PipelineDesc& desc)
+{
+	PipelineHandle handle{ invalidPipelineHandle };
+	bool newBuild{ false };
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto [it, inserted] = registry_.try_emplace(desc, static_cast<PipelineHandle>(slots_.size()));
+		if (!inserted) {
+			reused_++;
+			return it->second;
+		}
+		handle = it->second;
+		// Only the static state decides whether a new pipeline is needed
+		PipelineDesc staticState = getStaticState(desc);
+		auto [buildIt, buildInserted] = buildRegistry_.try_emplace(staticState, static_cast<uint32_t>(builds_.size()));
+		if (buildInserted) {
+			builds_.push_back({ .desc = staticState });
+			jobs_.push_back({ .build = buildIt->second, .desc = std::move(staticState) });
+			newBuild = true;
+		}
+		slots_.push_back({ .build = buildIt->second, .desc = desc });
+	}
+	if (newBuild) {
+		jobReady_.notify_one();
+	}
+	return handle;
+}
+
+std::vector<PipelineHandle> PipelineCompiler::warmUp(const std::vector<PipelineDesc>& descs)
+{
+	std::vector<PipelineHandle> handles;
+	for (const auto& desc : descs) {
+		handles.push_back(request(desc));
+	}
+	std::unique_lock<std::mutex> lock(mutex_);
+	jobDone_.wait(lock, [&] {
+		return std::all_of(handles.begin(), handles.end(), [&](PipelineHandle handle) { return builds_[slots_[handle].build].state != State::Pending; });
+	});
+	return handles;
+}
+
+void PipelineCompiler::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	jobDone_.wait(lock, [this] { return jobs_.empty() && running_ == 0; });
+}
+
+bool PipelineCompiler::isReady(PipelineHandle handle) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return handle < slots_.size() && builds_[slots_[handle].build].compiled.isValid();
+}
+
+bool PipelineCompiler::bind(VkCommandBuffer cb, PipelineHandle handle) const
+{
+	const Slot* slot{ nullptr };
+	Compiled compiled;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (handle >= slots_.size()) {
+			return false;
+		}
+		slot = &slots_[handle];
+		compiled = builds_[slot->build].compiled;
+	}
+	if (!compiled.isValid()) {
+		return false;
+	}
+	if (compiled.pipeline != VK_NULL_HANDLE) {
+		vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, compiled.pipeline);
+		pipelineHelper_.setDynamicState(cb, slot->desc);
+	} else {
+		ShaderObject::bind(cb, compiled.shaders, slot->desc);
+	}
+	return true;
+}
+
+bool PipelineCompiler::isFailed(PipelineHandle handle) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return handle >= slots_.size() || builds_[slots_[handle].build].state == State::Failed;
+}
+
+uint32_t PipelineCompiler::getFinishedCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return finished_;
+}
+
+uint32_t PipelineCompiler::reload(const std::vector<std::string>& files)
+{
+	uint32_t started{ 0 };
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		sourceVersion_++;
+		for (uint32_t i = 0; i < builds_.size(); i++) {
+			Build& build = builds_[i];
+			// A first build that is still running only knows its sources once done
+			const bool affected = std::any_of(build.dependencies.begin(), build.dependencies.end(), [&](const std::string& dependency) {
+				return std::find(files.begin(), files.end(), dependency) != files.end();
+			});
+			if (build.state == State::Pending || !affected) {
+				continue;
+			}
+			// Supersedes a reload of the same build that is still running
+			build.reloadGeneration++;
+			jobs_.push_back({ .build = i, .desc = build.desc, .reloadGeneration = build.reloadGeneration, .shaderInterface = build.shaderInterface });
+			started++;
+		}
+	}
+	if (started > 0) {
+		jobReady_.notify_all();
+	}
+	return started;
+}
+
+uint32_t PipelineCompiler::swapReloaded(DeletionQueue& deletionQueue)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (reloadsReady_ == 0) {
+		return 0;
+	}
+	uint32_t swapped{ 0 };
+	for (auto& build : builds_) {
+		if (!build.reloaded.isValid()) {
+			continue;
+		}
+		if (build.compiled.pipeline != VK_NULL_HANDLE) {
+			library_.release(build.compiled.pipeline);
+			deletionQueue.retirePipeline(build.compiled.pipeline);
+		}
+		if (build.compiled.shaders[0] != VK_NULL_HANDLE) {
+			deletionQueue.retire([device = device_, shaders = build.compiled.shaders] { ShaderObject::destroy(device, shaders); });
+		}
+		build.compiled = build.reloaded;
+		build.reloaded = {};
+		// A reload may also fix a pipeline that failed to build
+		build.state = State::Ready;
+		swapped++;
+	}
+	reloadsReady_ = 0;
+	// Parts built from the old shader code (and from superseded reloads)
+	library_.purge(deletionQueue);
+	return swapped;
+}
+
+uint32_t PipelineCompiler::getPipelineCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return static_cast<uint32_t>(builds_.size());
+}
+
+uint32_t PipelineCompiler::getReusedCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return reused_;
+}
+
+uint32_t PipelineCompiler::getShaderCacheHits() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return shaderCacheHits_;
+}
+
+uint32_t PipelineCompiler::getShadersCompiled() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return shadersCompiled_;
+}
+
+void PipelineCompiler::workerLoop()
+{
+	ShaderCompiler shaderCompiler;
+	shaderCompiler.create(shaderCacheDirectory_, readShaderCache_);
+	uint32_t sourceVersion{ 0 };
+	for (;;) {
+		Job job;
+		bool sourcesChanged{ false };
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			jobReady_.wait(lock, [this] { return quit_ || !jobs_.empty(); });
+			if (quit_) {
+				break;
+			}
+			job = std::move(jobs_.front());
+			jobs_.pop_front();
+			running_++;
+			sourcesChanged = sourceVersion != sourceVersion_;
+			sourceVersion = sourceVersion_;
+		}
+
+		// Shader compile and pipeline creation run without the lock
+		const bool isReload = job.reloadGeneration > 0;
+		if (sourcesChanged) {
+			// Modules loaded before the change (imports included) are stale
+			shaderCompiler.reloadModules();
+		}
+		const uint32_t hitsBefore = shaderCompiler.getCacheHits();
+		const uint32_t compiledBefore = shaderCompiler.getCompiledCount();
+		Compiled result;
+		std::vector<uint32_t> spirv;
+		ShaderInterface shaderInterface;
+		std::string interfaceText;
+		// Sources to watch for reloads, at least the module itself if it doesn't compile
+		std::vector<std::string> dependencies;
+		const PipelineDesc& desc = job.desc;
+		const bool compiled = shaderCompiler.compile(desc.moduleName.c_str(), desc.shaderPath, spirv, &shaderInterface);
+		for (const auto& dependency : compiled ? shaderCompiler.getDependencies() : std::vector<std::string>{ desc.shaderPath }) {
+			std::error_code error;
+			const std::filesystem::path path = std::filesystem::weakly_canonical(dependency, error);
+			dependencies.push_back(error ? dependency : path.string());
+		}
+		if (compiled) {
+			interfaceText = shaderInterface.serialize();
+		}
+		if (compiled && isReload && !job.shaderInterface.empty() && interfaceText != job.shaderInterface) {
+			std::cerr << "Resources or vertex inputs of " << desc.shaderPath << " changed, restart to apply\n";
+		} else if (compiled && pipelineHelper_.getFeatures().shaderObject) {
+			// Created straight from the SPIR-V, no shader module needed
+			shaderObjectHelper_.create(device_, spirv, desc, result.shaders);
+		} else if (compiled) {
+			VkShaderModuleCreateInfo shaderModuleCI{ .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO, .codeSize = spirv.size() * sizeof(uint32_t), .pCode = spirv.data() };
+			VkShaderModule shaderModule{ VK_NULL_HANDLE };
+			if (vkCreateShaderModule(device_, &shaderModuleCI, nullptr, &shaderModule) == VK_SUCCESS) {
+				if (pipelineHelper_.getFeatures().graphicsPipelineLibrary) {
+					result.pipeline = library_.link(shaderModule, hashBytes(hashSeed, spirv.data(), shaderModuleCI.codeSize), desc);
+				} else {
+					result.pipeline = pipelineHelper_.createGraphics(device_, shaderModule, desc);
+				}
+				// Not referenced by pipelines or libraries once they are created
+				vkDestroyShaderModule(device_, shaderModule, nullptr);
+			}
+		}
+		if (!result.isValid()) {
+			std::cerr << "Failed to build pipeline from " << desc.shaderPath << " (" << desc.vertexEntryPoint << ", " << desc.fragmentEntryPoint << ")"
+				<< (isReload ? ", keeping the previous one" : "") << "\n";
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			Build& build = builds_[job.build];
+			if (!isReload) {
+				build.compiled = result;
+				build.state = result.isValid() ? State::Ready : State::Failed;
+				build.dependencies = std::move(dependencies);
+				build.shaderInterface = std::move(interfaceText);
+			} else if (job.reloadGeneration != build.reloadGeneration) {
+				// Superseded by a newer reload, never bound
+				destroyCompiled(result);
+			} else if (result.isValid()) {
+				// Replaces an earlier reload that hasn't been swapped in yet
+				if (build.reloaded.isValid()) {
+					destroyCompiled(build.reloaded);
+				} else {
+					reloadsReady_++;
+				}
+				build.reloaded = result;
+				build.dependencies = std::move(dependencies);
+			}
+			shaderCacheHits_ += shaderCompiler.getCacheHits() - hitsBefore;
+			shadersCompiled_ += shaderCompiler.getCompiledCount() - compiledBefore;
+			running_--;
+			finished_++;
+		}
+		jobDone_.notify_all();
+	}
+	shaderCompiler.destroy();
+}
+
+PipelineDesc PipelineCompiler::getStaticState(const PipelineDesc& desc) const
+{
+	return pipelineHelper_.getFeatures().shaderObject ? ShaderObject::getStaticState(desc) : pipelineHelper_.getStaticState(desc);
+}
+
+void PipelineCompiler::destroyCompiled(const Compiled& compiled)
+{
+	if (compiled.pipeline != VK_NULL_HANDLE) {
+		library_.release(compiled.pipeline);
+		vkDestroyPipeline(device_, compiled.pipeline, nullptr);
+	}
+	ShaderObject::destroy(device_, compiled.shaders);
+}
+
+void runBindBenchmark(VkDevice device, uint32_t queueFamily, PipelineCache* pipelineCache, const PipelineLayoutCache* layoutCache, const PipelineFeatures& features, const std::vector<PipelineDesc>& descs)
+{
+	using Clock = std::chrono::steady_clock;
+	using ms = std::chrono::duration<double, std::milli>;
+	using ns = std::chrono::duration<double, std::nano>;
+	constexpr uint32_t bindsPerBatch = 4096;
+	constexpr uint32_t batches = 64;
+
+	VkCommandPoolCreateInfo poolCI{ .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, .queueFamilyIndex = queueFamily };
+	VkCommandPool pool{ VK_NULL_HANDLE };
+	if (vkCreateCommandPool(device, &poolCI, nullptr, &pool) != VK_SUCCESS) {
+		std::cerr << "vkCreateCommandPool failed\n";
+		return;
+	}
+	VkCommandBufferAllocateInfo cbAI{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, .commandPool = pool, .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY, .commandBufferCount = 1 };
+	VkCommandBuffer cb{ VK_NULL_HANDLE };
+	vkAllocateCommandBuffers(device, &cbAI, &cb);
+
+	// Nanoseconds per bind, negative if the backend couldn't build every desc
+	auto measure = [&](const char* name, const PipelineFeatures& backendFeatures) {
+		PipelineCompiler compiler;
+		compiler.create(device, pipelineCache, layoutCache, backendFeatures, "shadercache", true, std::clamp(std::thread::hardware_concurrency(), 2u, 5u) - 1);
+		const auto buildStart = Clock::now();
+		const std::vector<PipelineHandle> handles = compiler.warmUp(descs);
+		const double buildTime = ms(Clock::now() - buildStart).count();
+		if (std::any_of(handles.begin(), handles.end(), [&](PipelineHandle handle) { return compiler.isFailed(handle); })) {
+			std::cerr << name << ": failed to build all " << descs.size() << " variants\n";
+			return -1.0;
+		}
+		// Binds only, no draws and nothing is submitted: the CPU side of
+		// switching shaders and state, which is what the backends differ in
+		const VkCommandBufferBeginInfo beginInfo{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT };
+		ns recordTime{ 0 };
+		for (uint32_t batch = 0; batch < batches; batch++) {
+			vkBeginCommandBuffer(cb, &beginInfo);
+			const auto start = Clock::now();
+			for (uint32_t i = 0; i < bindsPerBatch; i++) {
+				compiler.bind(cb, handles[i % handles.size()]);
+			}
+			recordTime += Clock::now() - start;
+			vkEndCommandBuffer(cb);
+			vkResetCommandBuffer(cb, 0);
+		}
+		const double perBind = recordTime.count() / (static_cast<double>(batches) * bindsPerBatch);
+		std::cout << name << ": " << compiler.getPipelineCount() << " built in " << buildTime << " ms, " << perBind << " ns per bind\n";
+		compiler.destroy();
+		return perBind;
+	};
+
+	std::cout << "Binding " << descs.size() << " variants, " << batches << " x " << bindsPerBatch << " binds\n";
+	PipelineFeatures pipelineFeatures = features;
+	pipelineFeatures.shaderObject = false;
+	const double pipelineBind = measure(features.graphicsPipelineLibrary ? "Pipelines (linked)" : "Pipelines", pipelineFeatures);
+	if (!features.shaderObject) {
+		std::cout << "Shader objects: not supported by this device\n";
+	} else {
+		const double shaderObjectBind = measure("Shader objects", features);
+		if (pipelineBind > 0.0 && shaderObjectBind > 0.0) {
+			std::cout << "Shader objects bind at " << shaderObjectBind / pipelineBind << "x the cost of pipelines\n";
+		}
+	}
+
+	vkDestroyCommandPool(device, pool, nullptr);
+}
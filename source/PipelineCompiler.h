@@ -0,0 +1,177 @@
+// PipelineCompiler.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "Pipeline.h"
+#include "PipelineDesc.h"
+#include "PipelineLibrary.h"
+#include "ShaderObject.h"
+
+class PipelineCache; // forward
+class PipelineLayoutCache; // forward
+class DeletionQueue; // forward
+
+// Index of a pipeline requested from a PipelineCompiler
+using PipelineHandle = uint32_t;
+constexpr PipelineHandle invalidPipelineHandle = UINT32_MAX;
+
+// Builds graphics pipelines on worker threads. request() returns a handle
+// right away; isReady() is false until the pipeline is built, so
+// callers skip the draws (or bind a fallback) in the meantime instead of
+// stalling the frame on a compile. warmUp() is the blocking variant for
+// pipelines that are needed before the first frame, their requests still run
+// in parallel.
+//
+// The compiler is also the registry of all graphics pipelines: requests are
+// keyed by their description, so an equal description returns the existing
+// handle (built, pending or failed) instead of building the pipeline again.
+// Materials that only differ in their resources share one pipeline.
+// Descriptions that only differ in dynamic state (see
+// Pipeline::getStaticState) get their own handles but share the VkPipeline,
+// bind() records the handle's dynamic state. With graphics pipeline
+// libraries the remaining static state is linked from shared parts (see
+// PipelineLibrary), otherwise monolithic pipelines are built.
+//
+// With PipelineFeatures::shaderObject the compiler builds shader objects
+// instead of pipelines (see ShaderObject): handles then only differ in their
+// shaders, and bind() records all of the handle's state. Callers don't see a
+// difference.
+//
+// Shader hot reload: reload() rebuilds the pipelines whose shaders depend on
+// changed files in the background, the current pipelines stay bound until
+// swapReloaded() replaces them between frames. A reload that fails to
+// compile keeps the current pipeline.
+//
+// Each worker has its own shader compiler, Slang sessions aren't thread safe.
+// Pipelines are owned by the compiler and destroyed with it.
+class PipelineCompiler {
+public:
+    PipelineCompiler() = default;
+    ~PipelineCompiler();
+
+    // Non-copyable
+    PipelineCompiler(const PipelineCompiler&) = delete;
+    PipelineCompiler& operator=(const PipelineCompiler&) = delete;
+
+    // layoutCache has to hold the layouts of all requested descriptions, it
+    // is only used for shader objects
+    bool create(VkDevice device, PipelineCache* pipelineCache, const PipelineLayoutCache* layoutCache, const PipelineFeatures& features, const std::string& shaderCacheDirectory, bool readShaderCache, uint32_t threadCount);
+    // Drops requests that haven't started, waits for the running ones and
+    // destroys all pipelines. The device must be idle.
+    void destroy();
+
+    PipelineHandle request(const PipelineDesc& desc);
+    // Request all pipelines and block until they are built (or failed)
+    std::vector<PipelineHandle> warmUp(const std::vector<PipelineDesc>& descs);
+    // Block until every request so far is done
+    void wait();
+
+    // False while the pipeline is being built or if it failed
+    bool isReady(PipelineHandle handle) const;
+    // Bind the pipeline (or shader objects) and record its dynamic state. Returns false (and
+    // binds nothing) while it is not ready. Can be called from any thread.
+    bool bind(VkCommandBuffer cb, PipelineHandle handle) const;
+    bool isFailed(PipelineHandle handle) const;
+    // Number of finished builds (built or failed), changes whenever one completes
+    uint32_t getFinishedCount() const;
+
+    // Rebuild every pipeline whose shader was built from one of files
+    // (canonical paths). Returns the number of rebuilds started.
+    uint32_t reload(const std::vector<std::string>& files);
+    // Make the finished rebuilds current. Call between frames, before
+    // recording; the replaced pipelines are retired through deletionQueue,
+    // frames in flight keep using them. Returns the number of pipelines swapped.
+    uint32_t swapReloaded(DeletionQueue& deletionQueue);
+
+    // Distinct VkPipelines, and requests answered with an existing handle
+    uint32_t getPipelineCount() const;
+    uint32_t getReusedCount() const;
+    bool usesLibraries() const { return pipelineHelper_.getFeatures().graphicsPipelineLibrary && !usesShaderObjects(); }
+    bool usesShaderObjects() const { return pipelineHelper_.getFeatures().shaderObject; }
+
+    // Shader statistics summed over the workers
+    uint32_t getShaderCacheHits() const;
+    uint32_t getShadersCompiled() const;
+
+private:
+    enum class State { Pending, Ready, Failed };
+    // Result of a build, depending on the backend either the pipeline or the shaders
+    struct Compiled {
+        VkPipeline pipeline{ VK_NULL_HANDLE };
+        ShaderObjects shaders{};
+        bool isValid() const { return pipeline != VK_NULL_HANDLE || shaders[0] != VK_NULL_HANDLE; }
+    };
+    // One per distinct static state
+    struct Build {
+        State state{ State::Pending };
+        Compiled compiled;
+        PipelineDesc desc;
+        // Canonical paths of the shader sources, and the shader's resource
+        // interface, which a reload must not change (the layout is fixed)
+        std::vector<std::string> dependencies;
+        std::string shaderInterface;
+        // Latest reload request, and its result once built, until swapReloaded()
+        uint32_t reloadGeneration{ 0 };
+        Compiled reloaded;
+    };
+    // One per handle. Never changes after request(), the deque keeps it in
+    // place, so bind() can read it without the lock.
+    struct Slot {
+        uint32_t build{ 0 };
+        PipelineDesc desc;
+    };
+    struct Job {
+        uint32_t build{ 0 };
+        PipelineDesc desc;
+        // 0 for the first build, otherwise the reload it belongs to
+        uint32_t reloadGeneration{ 0 };
+        // Interface the reloaded shader has to keep, empty if unknown
+        std::string shaderInterface;
+    };
+
+    void workerLoop();
+    PipelineDesc getStaticState(const PipelineDesc& desc) const;
+    void destroyCompiled(const Compiled& compiled);
+
+    VkDevice device_{ VK_NULL_HANDLE };
+    Pipeline pipelineHelper_;
+    PipelineLibrary library_;
+    ShaderObject shaderObjectHelper_;
+    std::string shaderCacheDirectory_;
+    bool readShaderCache_{ true };
+    std::vector<std::thread> workers_;
+
+    // Guarded by mutex_
+    mutable std::mutex mutex_;
+    std::condition_variable jobReady_;
+    std::condition_variable jobDone_;
+    std::deque<Job> jobs_;
+    std::deque<Build> builds_;
+    std::deque<Slot> slots_;
+    std::unordered_map<PipelineDesc, PipelineHandle, PipelineDescHash> registry_;
+    std::unordered_map<PipelineDesc, uint32_t, PipelineDescHash> buildRegistry_;
+    uint32_t reused_{ 0 };
+    uint32_t running_{ 0 };
+    uint32_t finished_{ 0 };
+    // Builds with a reloaded pipeline waiting for swapReloaded()
+    uint32_t reloadsReady_{ 0 };
+    // Bumped by reload(), workers then drop the modules they have loaded
+    uint32_t sourceVersion_{ 0 };
+    uint32_t shaderCacheHits_{ 0 };
+    uint32_t shadersCompiled_{ 0 };
+    bool quit_{ false };
+};
+
+// Microbenchmark (--bench-binds): builds descs with the pipeline backend and,
+// if the device supports it (features.shaderObject), with shader objects,
+// then records binds cycling through them into a command buffer and prints
+// the creation time and the CPU cost per bind of both. Nothing is submitted.
+void runBindBenchmark(VkDevice device, uint32_t queueFamily, PipelineCache* pipelineCache, const PipelineLayoutCache* layoutCache, const PipelineFeatures& features, const std::vector<PipelineDesc>& descs);
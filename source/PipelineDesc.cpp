@@ -0,0 +1,92 @@
+// PipelineDesc.cpp
+#include "PipelineDesc.h"
+#include "Hash.h"
+
+namespace {
+
+// Vertex input state that doesn't affect the pipeline is left out of hash and
+// comparison, so descriptions without vertex input match regardless of it
+bool vertexInputEqual(const PipelineDesc& a, const PipelineDesc& b)
+{
+	if (a.useVertexInput != b.useVertexInput) {
+		return false;
+	}
+	if (!a.useVertexInput) {
+		return true;
+	}
+	if (a.vertexBinding.binding != b.vertexBinding.binding || a.vertexBinding.stride != b.vertexBinding.stride || a.vertexBinding.inputRate != b.vertexBinding.inputRate) {
+		return false;
+	}
+	if (a.vertexAttributes.size() != b.vertexAttributes.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < a.vertexAttributes.size(); i++) {
+		const auto& x = a.vertexAttributes[i];
+		const auto& y = b.vertexAttributes[i];
+		if (x.location != y.location || x.binding != y.binding || x.format != y.format || x.offset != y.offset) {
+			return false;
+		}
+	}
+	return true;
+}
+
+} // namespace
+
+BlendDesc BlendDesc::additive()
+{
+	return { .enable = true, .srcColor = VK_BLEND_FACTOR_ONE, .dstColor = VK_BLEND_FACTOR_ONE, .srcAlpha = VK_BLEND_FACTOR_ONE, .dstAlpha = VK_BLEND_FACTOR_ONE };
+}
+
+uint64_t PipelineDesc::hash() const
+{
+	uint64_t h = hashString(hashSeed, moduleName);
+	h = hashString(h, shaderPath);
+	h = hashString(h, vertexEntryPoint);
+	h = hashString(h, fragmentEntryPoint);
+	h = hashValue(h, layout);
+	for (const auto& constant : specialization) {
+		h = hashValue(h, constant.id);
+		h = hashValue(h, constant.value);
+	}
+	h = hashValue(h, useVertexInput);
+	if (useVertexInput) {
+		h = hashValue(h, vertexBinding.binding);
+		h = hashValue(h, vertexBinding.stride);
+		h = hashValue(h, vertexBinding.inputRate);
+		for (const auto& attribute : vertexAttributes) {
+			h = hashValue(h, attribute.location);
+			h = hashValue(h, attribute.binding);
+			h = hashValue(h, attribute.format);
+			h = hashValue(h, attribute.offset);
+		}
+	}
+	h = hashValue(h, topology);
+	h = hashValue(h, polygonMode);
+	h = hashValue(h, cullMode);
+	h = hashValue(h, frontFace);
+	h = hashValue(h, depthTest);
+	h = hashValue(h, depthWrite);
+	h = hashValue(h, depthCompareOp);
+	h = hashValue(h, blend.enable);
+	h = hashValue(h, blend.srcColor);
+	h = hashValue(h, blend.dstColor);
+	h = hashValue(h, blend.colorOp);
+	h = hashValue(h, blend.srcAlpha);
+	h = hashValue(h, blend.dstAlpha);
+	h = hashValue(h, blend.alphaOp);
+	h = hashValue(h, blend.writeMask);
+	h = hashValue(h, colorFormat);
+	h = hashValue(h, depthFormat);
+	return h;
+}
+
+bool PipelineDesc::operator==(const PipelineDesc& other) const
+{
+	// Keep in sync with hash()
+	return moduleName == other.moduleName && shaderPath == other.shaderPath
+		&& vertexEntryPoint == other.vertexEntryPoint && fragmentEntryPoint == other.fragmentEntryPoint
+		&& layout == other.layout && specialization == other.specialization && vertexInputEqual(*this, other)
+		&& topology == other.topology && polygonMode == other.polygonMode && cullMode == other.cullMode && frontFace == other.frontFace
+		&& depthTest == other.depthTest && depthWrite == other.depthWrite && depthCompareOp == other.depthCompareOp
+		&& blend == other.blend && colorFormat == other.colorFormat && depthFormat == other.depthFormat;
+}
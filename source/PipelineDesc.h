@@ -0,0 +1,84 @@
+// PipelineDesc.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Color blend state of the single color attachment. The defaults disable
+// blending and write all channels.
+struct BlendDesc {
+    bool enable = false;
+    VkBlendFactor srcColor = VK_BLEND_FACTOR_ONE;
+    VkBlendFactor dstColor = VK_BLEND_FACTOR_ZERO;
+    VkBlendOp colorOp = VK_BLEND_OP_ADD;
+    VkBlendFactor srcAlpha = VK_BLEND_FACTOR_ONE;
+    VkBlendFactor dstAlpha = VK_BLEND_FACTOR_ZERO;
+    VkBlendOp alphaOp = VK_BLEND_OP_ADD;
+    VkColorComponentFlags writeMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+    // ONE + ONE, used to accumulate per-pixel counts
+    static BlendDesc additive();
+    bool operator==(const BlendDesc&) const = default;
+};
+
+// Value of a specialization constant, [vk::constant_id(id)] in Slang. bool,
+// int and float constants are all 32 bits wide (bools as VkBool32).
+struct SpecializationConstant {
+    uint32_t id{ 0 };
+    uint32_t value{ 0 };
+    bool operator==(const SpecializationConstant&) const = default;
+};
+
+// Everything that makes up a graphics pipeline: shaders, vertex layout,
+// fixed-function state and attachment formats. Plain value type, two equal
+// descriptions always produce interchangeable pipelines, so they can be
+// looked up by value (see PipelineCompiler). The defaults describe the lit
+// mesh pipeline of the sample.
+//
+// Both stages come from the same Slang module, named by moduleName and
+// shaderPath and picked by entry point name.
+struct PipelineDesc {
+    // Shaders
+    std::string moduleName;
+    std::string shaderPath;
+    std::string vertexEntryPoint = "main";
+    std::string fragmentEntryPoint = "main";
+    VkPipelineLayout layout{ VK_NULL_HANDLE };
+    // Applied to both stages, a stage ignores the ids it doesn't declare.
+    // Constants that aren't listed keep the default from the shader.
+    std::vector<SpecializationConstant> specialization;
+
+    // Vertex input, ignored for passes that generate their vertices in the
+    // shader (fullscreen triangle)
+    bool useVertexInput = true;
+    VkVertexInputBindingDescription vertexBinding{};
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+
+    // Rasterization
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+    // Depth, ignored without a depth attachment
+    bool depthTest = true;
+    bool depthWrite = true;
+    VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+    BlendDesc blend{};
+
+    // Attachment formats (dynamic rendering), VK_FORMAT_UNDEFINED for passes
+    // without a depth attachment
+    VkFormat colorFormat{ VK_FORMAT_UNDEFINED };
+    VkFormat depthFormat{ VK_FORMAT_UNDEFINED };
+
+    // Stable across runs for the same values, except for the layout handle
+    uint64_t hash() const;
+    bool operator==(const PipelineDesc& other) const;
+};
+
+struct PipelineDescHash {
+    size_t operator()(const PipelineDesc& desc) const { return static_cast<size_t>(desc.hash()); }
+};
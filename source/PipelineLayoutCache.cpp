@@ -0,0 +1,153 @@
+// PipelineLayoutCache.cpp
+#include "PipelineLayoutCache.h"
+#include "Hash.h"
+
+#include <volk/volk.h>
+#include <iostream>
+
+void PipelineLayoutCache::create(VkDevice device)
+{
+	device_ = device;
+}
+
+void PipelineLayoutCache::destroy()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (auto& [key, layout] : layouts_) {
+		vkDestroyPipelineLayout(device_, layout, nullptr);
+	}
+	for (auto& [key, setLayout] : setLayouts_) {
+		vkDestroyDescriptorSetLayout(device_, setLayout, nullptr);
+	}
+	layouts_.clear();
+	layoutInfos_.clear();
+	setLayouts_.clear();
+}
+
+VkPipelineLayout PipelineLayoutCache::getLayout(const ShaderInterface& shaderInterface, uint32_t maxVariableCount)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::vector<VkDescriptorSetLayout> setLayouts;
+	for (uint32_t set = 0; set < shaderInterface.getSetCount(); set++) {
+		VkDescriptorSetLayout setLayout = createSetLayout(shaderInterface.getSetBindings(set), maxVariableCount);
+		if (setLayout == VK_NULL_HANDLE) {
+			return VK_NULL_HANDLE;
+		}
+		setLayouts.push_back(setLayout);
+	}
+	// Equal set layouts are the same handle by now, hashing the handles is enough
+	uint64_t key = hashSeed;
+	for (VkDescriptorSetLayout setLayout : setLayouts) {
+		key = hashValue(key, setLayout);
+	}
+	for (const auto& range : shaderInterface.pushConstants) {
+		key = hashValue(key, range.stageFlags);
+		key = hashValue(key, range.offset);
+		key = hashValue(key, range.size);
+	}
+	auto it = layouts_.find(key);
+	if (it != layouts_.end()) {
+		return it->second;
+	}
+	VkPipelineLayoutCreateInfo layoutCI{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = static_cast<uint32_t>(setLayouts.size()),
+		.pSetLayouts = setLayouts.data(),
+		.pushConstantRangeCount = static_cast<uint32_t>(shaderInterface.pushConstants.size()),
+		.pPushConstantRanges = shaderInterface.pushConstants.data()
+	};
+	VkPipelineLayout layout{ VK_NULL_HANDLE };
+	VkResult result = vkCreatePipelineLayout(device_, &layoutCI, nullptr, &layout);
+	if (result != VK_SUCCESS) {
+		std::cerr << "vkCreatePipelineLayout failed: " << result << "\n";
+		return VK_NULL_HANDLE;
+	}
+	layouts_.emplace(key, layout);
+	layoutInfos_.emplace(layout, LayoutInfo{ .setLayouts = std::move(setLayouts), .pushConstants = shaderInterface.pushConstants });
+	return layout;
+}
+
+VkDescriptorSetLayout PipelineLayoutCache::getSetLayout(VkPipelineLayout layout, uint32_t set) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto it = layoutInfos_.find(layout);
+	if (it == layoutInfos_.end() || set >= it->second.setLayouts.size()) {
+		return VK_NULL_HANDLE;
+	}
+	return it->second.setLayouts[set];
+}
+
+std::vector<VkDescriptorSetLayout> PipelineLayoutCache::getSetLayouts(VkPipelineLayout layout) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto it = layoutInfos_.find(layout);
+	return it != layoutInfos_.end() ? it->second.setLayouts : std::vector<VkDescriptorSetLayout>{};
+}
+
+std::vector<VkPushConstantRange> PipelineLayoutCache::getPushConstantRanges(VkPipelineLayout layout) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto it = layoutInfos_.find(layout);
+	return it != layoutInfos_.end() ? it->second.pushConstants : std::vector<VkPushConstantRange>{};
+}
+
+uint32_t PipelineLayoutCache::getLayoutCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return static_cast<uint32_t>(layouts_.size());
+}
+
+uint32_t PipelineLayoutCache::getSetLayoutCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return static_cast<uint32_t>(setLayouts_.size());
+}
+
+VkDescriptorSetLayout PipelineLayoutCache::createSetLayout(const std::vector<ShaderBinding>& bindings, uint32_t maxVariableCount)
+{
+	uint64_t key = hashValue(hashSeed, maxVariableCount);
+	for (const auto& binding : bindings) {
+		key = hashValue(key, binding.binding);
+		key = hashValue(key, binding.type);
+		key = hashValue(key, binding.count);
+		key = hashValue(key, binding.stages);
+	}
+	auto it = setLayouts_.find(key);
+	if (it != setLayouts_.end()) {
+		return it->second;
+	}
+
+	std::vector<VkDescriptorSetLayoutBinding> layoutBindings;
+	std::vector<VkDescriptorBindingFlags> bindingFlags;
+	bool variableCount{ false };
+	for (const auto& binding : bindings) {
+		// Only the last binding of a set may have a variable count
+		const bool unbounded = binding.count == 0;
+		if (unbounded && &binding != &bindings.back()) {
+			std::cerr << "Unbounded descriptor array at set " << binding.set << ", binding " << binding.binding << " must be the last binding of its set\n";
+			return VK_NULL_HANDLE;
+		}
+		layoutBindings.push_back({ .binding = binding.binding, .descriptorType = binding.type, .descriptorCount = unbounded ? maxVariableCount : binding.count, .stageFlags = binding.stages });
+		bindingFlags.push_back(unbounded ? VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT : 0);
+		variableCount |= unbounded;
+	}
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsCI{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+		.bindingCount = static_cast<uint32_t>(bindingFlags.size()),
+		.pBindingFlags = bindingFlags.data()
+	};
+	VkDescriptorSetLayoutCreateInfo setLayoutCI{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.pNext = variableCount ? &bindingFlagsCI : nullptr,
+		.bindingCount = static_cast<uint32_t>(layoutBindings.size()),
+		.pBindings = layoutBindings.data()
+	};
+	VkDescriptorSetLayout setLayout{ VK_NULL_HANDLE };
+	VkResult result = vkCreateDescriptorSetLayout(device_, &setLayoutCI, nullptr, &setLayout);
+	if (result != VK_SUCCESS) {
+		std::cerr << "vkCreateDescriptorSetLayout failed: " << result << "\n";
+		return VK_NULL_HANDLE;
+	}
+	setLayouts_.emplace(key, setLayout);
+	return setLayout;
+}
@@ -0,0 +1,52 @@
+// PipelineLayoutCache.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "ShaderInterface.h"
+
+// Descriptor set layouts and pipeline layouts generated from reflected shader
+// interfaces (ShaderCompiler::compile). Both are keyed by the hash of their
+// definition, so modules that declare the same resources and push constants
+// get the very same VkPipelineLayout: switching between their pipelines keeps
+// the bound descriptor sets and push constants valid, nothing is rebound.
+//
+// Owns everything it creates. Thread safe.
+class PipelineLayoutCache {
+public:
+    PipelineLayoutCache() = default;
+    ~PipelineLayoutCache() = default;
+
+    void create(VkDevice device);
+    void destroy();
+
+    // Layout with one set layout per set of the interface and its push
+    // constant ranges. Unbounded descriptor arrays become variable count
+    // bindings of up to maxVariableCount descriptors. VK_NULL_HANDLE on failure.
+    VkPipelineLayout getLayout(const ShaderInterface& shaderInterface, uint32_t maxVariableCount);
+    // Set layout for set of a layout returned by getLayout, for allocating
+    // descriptor sets
+    VkDescriptorSetLayout getSetLayout(VkPipelineLayout layout, uint32_t set) const;
+    // What layout was created from, shader objects take these instead of the layout
+    std::vector<VkDescriptorSetLayout> getSetLayouts(VkPipelineLayout layout) const;
+    std::vector<VkPushConstantRange> getPushConstantRanges(VkPipelineLayout layout) const;
+
+    uint32_t getLayoutCount() const;
+    uint32_t getSetLayoutCount() const;
+
+private:
+    VkDescriptorSetLayout createSetLayout(const std::vector<ShaderBinding>& bindings, uint32_t maxVariableCount);
+
+    VkDevice device_{ VK_NULL_HANDLE };
+    mutable std::mutex mutex_;
+    std::unordered_map<uint64_t, VkDescriptorSetLayout> setLayouts_;
+    std::unordered_map<uint64_t, VkPipelineLayout> layouts_;
+    struct LayoutInfo {
+        std::vector<VkDescriptorSetLayout> setLayouts;
+        std::vector<VkPushConstantRange> pushConstants;
+    };
+    std::unordered_map<VkPipelineLayout, LayoutInfo> layoutInfos_;
+};
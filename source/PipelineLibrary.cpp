@@ -0,0 +1,201 @@
+// PipelineLibrary.cpp
+#include "PipelineLibrary.h"
+#include "DeletionQueue.h"
+#include "Hash.h"
+#include "Pipeline.h"
+
+#include <volk/volk.h>
+#include <array>
+
+namespace {
+
+uint64_t hashSpecialization(uint64_t h, const PipelineDesc& desc)
+{
+	for (const auto& constant : desc.specialization) {
+		h = hashValue(h, constant.id);
+		h = hashValue(h, constant.value);
+	}
+	return h;
+}
+
+// Keys of the four parts, each covers exactly the fields of PipelineDesc
+// that end up in that part. The part bit is hashed first so equal state in
+// different parts gives different keys.
+uint64_t vertexInputKey(const PipelineDesc& desc)
+{
+	uint64_t h = hashValue(hashSeed, VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT);
+	h = hashValue(h, desc.useVertexInput);
+	if (desc.useVertexInput) {
+		h = hashValue(h, desc.vertexBinding.binding);
+		h = hashValue(h, desc.vertexBinding.stride);
+		h = hashValue(h, desc.vertexBinding.inputRate);
+		for (const auto& attribute : desc.vertexAttributes) {
+			h = hashValue(h, attribute.location);
+			h = hashValue(h, attribute.binding);
+			h = hashValue(h, attribute.format);
+			h = hashValue(h, attribute.offset);
+		}
+	}
+	return hashValue(h, desc.topology);
+}
+
+uint64_t preRasterizationKey(const PipelineDesc& desc, uint64_t shaderHash)
+{
+	uint64_t h = hashValue(hashSeed, VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT);
+	h = hashValue(h, shaderHash);
+	h = hashString(h, desc.vertexEntryPoint);
+	h = hashSpecialization(h, desc);
+	h = hashValue(h, desc.layout);
+	h = hashValue(h, desc.polygonMode);
+	h = hashValue(h, desc.cullMode);
+	return hashValue(h, desc.frontFace);
+}
+
+uint64_t fragmentShaderKey(const PipelineDesc& desc, uint64_t shaderHash)
+{
+	uint64_t h = hashValue(hashSeed, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT);
+	h = hashValue(h, shaderHash);
+	h = hashString(h, desc.fragmentEntryPoint);
+	h = hashSpecialization(h, desc);
+	h = hashValue(h, desc.layout);
+	h = hashValue(h, desc.depthTest);
+	h = hashValue(h, desc.depthWrite);
+	h = hashValue(h, desc.depthCompareOp);
+	return hashValue(h, desc.depthFormat);
+}
+
+uint64_t fragmentOutputKey(const PipelineDesc& desc)
+{
+	uint64_t h = hashValue(hashSeed, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT);
+	h = hashValue(h, desc.blend.enable);
+	h = hashValue(h, desc.blend.srcColor);
+	h = hashValue(h, desc.blend.dstColor);
+	h = hashValue(h, desc.blend.colorOp);
+	h = hashValue(h, desc.blend.srcAlpha);
+	h = hashValue(h, desc.blend.dstAlpha);
+	h = hashValue(h, desc.blend.alphaOp);
+	h = hashValue(h, desc.blend.writeMask);
+	h = hashValue(h, desc.colorFormat);
+	return hashValue(h, desc.depthFormat);
+}
+
+} // namespace
+
+void PipelineLibrary::create(VkDevice device, const Pipeline* pipelineHelper)
+{
+	device_ = device;
+	pipelineHelper_ = pipelineHelper;
+}
+
+void PipelineLibrary::destroy()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (auto& [key, part] : parts_) {
+		vkDestroyPipeline(device_, part.library, nullptr);
+	}
+	parts_.clear();
+	linked_.clear();
+}
+
+VkPipeline PipelineLibrary::link(VkShaderModule shaderModule, uint64_t shaderHash, const PipelineDesc& desc)
+{
+	const std::array<VkGraphicsPipelineLibraryFlagBitsEXT, partCount> partBits{
+		VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+		VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+		VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+		VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT
+	};
+	const std::array<uint64_t, partCount> keys{
+		vertexInputKey(desc),
+		preRasterizationKey(desc, shaderHash),
+		fragmentShaderKey(desc, shaderHash),
+		fragmentOutputKey(desc)
+	};
+	std::array<VkPipeline, partCount> parts{};
+	uint32_t acquired{ 0 };
+	for (; acquired < partCount; acquired++) {
+		parts[acquired] = getPart(partBits[acquired], keys[acquired], shaderModule, desc);
+		if (parts[acquired] == VK_NULL_HANDLE) {
+			break;
+		}
+	}
+	VkPipeline pipeline{ VK_NULL_HANDLE };
+	if (acquired == partCount) {
+		pipeline = pipelineHelper_->link(device_, desc.layout, parts.data(), partCount);
+	}
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (pipeline == VK_NULL_HANDLE) {
+		// Left to the next purge() unless another pipeline uses them
+		unreference(keys.data(), acquired);
+		return VK_NULL_HANDLE;
+	}
+	linked_.emplace(pipeline, keys);
+	return pipeline;
+}
+
+void PipelineLibrary::release(VkPipeline linked)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto it = linked_.find(linked);
+	if (it == linked_.end()) {
+		return;
+	}
+	unreference(it->second.data(), partCount);
+	linked_.erase(it);
+}
+
+uint32_t PipelineLibrary::purge(DeletionQueue& deletionQueue)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	uint32_t retired{ 0 };
+	for (auto it = parts_.begin(); it != parts_.end();) {
+		if (it->second.users > 0) {
+			++it;
+			continue;
+		}
+		deletionQueue.retirePipeline(it->second.library);
+		it = parts_.erase(it);
+		retired++;
+	}
+	return retired;
+}
+
+uint32_t PipelineLibrary::getPartCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return static_cast<uint32_t>(parts_.size());
+}
+
+VkPipeline PipelineLibrary::getPart(VkGraphicsPipelineLibraryFlagBitsEXT part, uint64_t key, VkShaderModule shaderModule, const PipelineDesc& desc)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = parts_.find(key);
+		if (it != parts_.end()) {
+			it->second.users++;
+			return it->second.library;
+		}
+	}
+	// Built without the lock, other workers keep linking in the meantime
+	VkPipeline library = pipelineHelper_->createLibrary(device_, part, shaderModule, desc);
+	if (library == VK_NULL_HANDLE) {
+		return VK_NULL_HANDLE;
+	}
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto [it, inserted] = parts_.try_emplace(key, Part{ .library = library });
+	if (!inserted) {
+		vkDestroyPipeline(device_, library, nullptr);
+	}
+	it->second.users++;
+	return it->second.library;
+}
+
+void PipelineLibrary::unreference(const uint64_t* keys, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		auto it = parts_.find(keys[i]);
+		if (it != parts_.end() && it->second.users > 0) {
+			it->second.users--;
+		}
+	}
+}
@@ -0,0 +1,72 @@
+// PipelineLibrary.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include "PipelineDesc.h"
+
+class Pipeline; // forward
+class DeletionQueue; // forward
+
+// Graphics pipelines linked from separately built parts
+// (VK_EXT_graphics_pipeline_library): vertex input, pre-rasterization
+// shaders, fragment shader and fragment output. Each part is keyed by the
+// hash of just the state it contains and built once, so a pipeline that only
+// differs from an earlier one in e.g. its blend state compiles a single small
+// output part and links the rest. Linking without link time optimization
+// takes microseconds, compiling the shader parts is what takes milliseconds.
+//
+// Parts are counted by the linked pipelines built from them. Once a shader
+// reload replaces the last pipeline using a part, the part is only kept
+// until the next purge(), so the parts of old shader code don't pile up.
+//
+// Thread safe, the pipeline compiler's workers share one library. Two
+// workers may build the same part at the same time, the second one is
+// dropped.
+class PipelineLibrary {
+public:
+    PipelineLibrary() = default;
+    ~PipelineLibrary() = default;
+
+    // pipelineHelper creates parts and links, it must outlive the library
+    void create(VkDevice device, const Pipeline* pipelineHelper);
+    // Destroys the parts, linked pipelines are owned by the caller
+    void destroy();
+
+    // Link a pipeline for desc (static state only, see
+    // Pipeline::getStaticState), building the missing parts from
+    // shaderModule. shaderHash identifies the module's code, parts built from
+    // different code are never shared. Returns VK_NULL_HANDLE on failure.
+    VkPipeline link(VkShaderModule shaderModule, uint64_t shaderHash, const PipelineDesc& desc);
+    // Call before destroying (or retiring) a pipeline returned by link(), it
+    // no longer holds on to its parts
+    void release(VkPipeline linked);
+    // Retire the parts no linked pipeline uses anymore, with the pipelines
+    // they were replaced by. Returns the number of parts retired.
+    uint32_t purge(DeletionQueue& deletionQueue);
+
+    uint32_t getPartCount() const;
+
+private:
+    static constexpr uint32_t partCount = 4;
+    struct Part {
+        VkPipeline library{ VK_NULL_HANDLE };
+        // Linked pipelines (and links in progress) built from this part
+        uint32_t users{ 0 };
+    };
+
+    // Returns the part with a reference added, see unreference()
+    VkPipeline getPart(VkGraphicsPipelineLibraryFlagBitsEXT part, uint64_t key, VkShaderModule shaderModule, const PipelineDesc& desc);
+    // Drop one reference of each of the parts, mutex_ must be held
+    void unreference(const uint64_t* keys, uint32_t count);
+
+    VkDevice device_{ VK_NULL_HANDLE };
+    const Pipeline* pipelineHelper_{ nullptr };
+    mutable std::mutex mutex_;
+    std::unordered_map<uint64_t, Part> parts_;
+    // Keys of the parts each linked pipeline was built from
+    std::unordered_map<VkPipeline, std::array<uint64_t, partCount>> linked_;
+};
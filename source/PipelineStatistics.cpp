@@ -0,0 +1,70 @@
+// PipelineStatistics.cpp
+#include "PipelineStatistics.h"
+
+#include <volk/volk.h>
+#include <iostream>
+
+static constexpr VkQueryPipelineStatisticFlags statisticFlags =
+	VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+bool PipelineStatistics::create(VkDevice device, uint32_t frameCount)
+{
+	VkQueryPoolCreateInfo ci{};
+	ci.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	ci.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+	ci.queryCount = frameCount;
+	ci.pipelineStatistics = statisticFlags;
+
+	VkResult r = vkCreateQueryPool(device, &ci, nullptr, &pool_);
+	if (r != VK_SUCCESS) {
+		std::cerr << "vkCreateQueryPool failed: " << r << std::endl;
+		pool_ = VK_NULL_HANDLE;
+		return false;
+	}
+	written_.assign(frameCount, false);
+	return true;
+}
+
+void PipelineStatistics::destroy(VkDevice device)
+{
+	if (pool_ != VK_NULL_HANDLE) {
+		vkDestroyQueryPool(device, pool_, nullptr);
+		pool_ = VK_NULL_HANDLE;
+	}
+	written_.clear();
+}
+
+void PipelineStatistics::reset(VkCommandBuffer cb, uint32_t frameIndex) const
+{
+	vkCmdResetQueryPool(cb, pool_, frameIndex, 1);
+}
+
+void PipelineStatistics::begin(VkCommandBuffer cb, uint32_t frameIndex) const
+{
+	vkCmdBeginQuery(cb, pool_, frameIndex, 0);
+}
+
+void PipelineStatistics::end(VkCommandBuffer cb, uint32_t frameIndex)
+{
+	vkCmdEndQuery(cb, pool_, frameIndex);
+	written_[frameIndex] = true;
+}
+
+bool PipelineStatistics::fetch(VkDevice device, uint32_t frameIndex, PipelineStatisticsCounters& out) const
+{
+	if (pool_ == VK_NULL_HANDLE || !written_[frameIndex]) return false;
+	// The slot's fence has already been waited on, so the results are available
+	// and no WAIT flag is needed.
+	VkResult r = vkGetQueryPoolResults(device, pool_, frameIndex, 1, sizeof(PipelineStatisticsCounters), &out, sizeof(PipelineStatisticsCounters), VK_QUERY_RESULT_64_BIT);
+	return r == VK_SUCCESS;
+}
+
+VkQueryPipelineStatisticFlags PipelineStatistics::getFlags()
+{
+	return statisticFlags;
+}
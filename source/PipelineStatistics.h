@@ -0,0 +1,50 @@
+// PipelineStatistics.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+
+// Counters returned by a VK_QUERY_TYPE_PIPELINE_STATISTICS query. Members are
+// declared in the bit order of the statistic flags, which is also the order
+// the implementation writes the results in.
+struct PipelineStatisticsCounters {
+    uint64_t inputAssemblyVertices{ 0 };
+    uint64_t inputAssemblyPrimitives{ 0 };
+    uint64_t vertexShaderInvocations{ 0 };
+    uint64_t clippingInvocations{ 0 };
+    uint64_t clippingPrimitives{ 0 };
+    uint64_t fragmentShaderInvocations{ 0 };
+};
+
+// Owns a pipeline statistics query pool with one query per frame in flight.
+// Results for a slot are read back once that slot's fence has signaled, so
+// fetching never stalls the CPU.
+class PipelineStatistics {
+public:
+    PipelineStatistics() = default;
+    ~PipelineStatistics() = default;
+
+    // Create the query pool. Requires the pipelineStatisticsQuery device feature.
+    bool create(VkDevice device, uint32_t frameCount);
+    void destroy(VkDevice device);
+
+    // Record a reset of the slot's query. Must be recorded outside of a render pass.
+    void reset(VkCommandBuffer cb, uint32_t frameIndex) const;
+    void begin(VkCommandBuffer cb, uint32_t frameIndex) const;
+    void end(VkCommandBuffer cb, uint32_t frameIndex);
+
+    // Read back the counters last written to this slot. Call after waiting on
+    // the slot's fence. Returns false if the slot has not been used yet.
+    bool fetch(VkDevice device, uint32_t frameIndex, PipelineStatisticsCounters& out) const;
+
+    bool isEnabled() const { return pool_ != VK_NULL_HANDLE; }
+
+    // Statistics collected by the queries. Secondary command buffers executed
+    // while a query is active must name the same flags in their inheritance info.
+    static VkQueryPipelineStatisticFlags getFlags();
+
+private:
+    VkQueryPool pool_{ VK_NULL_HANDLE };
+    std::vector<bool> written_;
+};
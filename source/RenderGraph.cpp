@@ -0,0 +1,573 @@
+// RenderGraph.cpp
+#include "RenderGraph.h"
+#include "DeletionQueue.h"
+
+#include <volk/volk.h>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+namespace {
+
+// Synchronization scope and layout implied by a usage
+struct UsageInfo {
+	VkPipelineStageFlags2 stage;
+	VkAccessFlags2 access;
+	VkImageLayout layout;
+	bool write;
+	bool preserve;
+};
+
+UsageInfo usageInfo(RGUsage usage)
+{
+	switch (usage) {
+	case RGUsage::ColorAttachmentWrite:
+		return { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL, true, false };
+	case RGUsage::ColorAttachmentReadWrite:
+		return { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL, true, true };
+	case RGUsage::DepthAttachmentWrite:
+		return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL, true, false };
+	case RGUsage::DepthAttachmentReadWrite:
+		return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL, true, true };
+	case RGUsage::SampledRead:
+		return { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false, true };
+	case RGUsage::ComputeSampledRead:
+		return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false, true };
+	case RGUsage::ComputeSampledReadGeneral:
+		return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, false, true };
+	case RGUsage::ComputeStorageRead:
+		return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, false, true };
+	case RGUsage::ComputeStorageWrite:
+		return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, true, true };
+	case RGUsage::TransferSrc:
+		return { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false, true };
+	case RGUsage::TransferDst:
+		return { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true, true };
+	case RGUsage::IndirectRead:
+		return { VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false, true };
+	case RGUsage::VertexShaderRead:
+		return { VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false, true };
+	}
+	return { VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, true, true };
+}
+
+constexpr VkAccessFlags2 writeAccessMask =
+	VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+	VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+std::string stageNames(VkPipelineStageFlags2 stages)
+{
+	if (stages == VK_PIPELINE_STAGE_2_NONE) return "NONE";
+	static const std::pair<VkPipelineStageFlags2, const char*> names[] = {
+		{ VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, "DRAW_INDIRECT" },
+		{ VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, "VERTEX_SHADER" },
+		{ VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, "FRAGMENT_SHADER" },
+		{ VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT, "EARLY_FRAGMENT_TESTS" },
+		{ VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT, "LATE_FRAGMENT_TESTS" },
+		{ VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, "COLOR_ATTACHMENT_OUTPUT" },
+		{ VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, "COMPUTE_SHADER" },
+		{ VK_PIPELINE_STAGE_2_TRANSFER_BIT, "TRANSFER" },
+		{ VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, "ALL_COMMANDS" },
+	};
+	std::string out;
+	for (const auto& [bit, name] : names) {
+		if ((stages & bit) == bit) {
+			if (!out.empty()) out += "|";
+			out += name;
+		}
+	}
+	return out.empty() ? "OTHER" : out;
+}
+
+const char* layoutName(VkImageLayout layout)
+{
+	switch (layout) {
+	case VK_IMAGE_LAYOUT_UNDEFINED: return "UNDEFINED";
+	case VK_IMAGE_LAYOUT_GENERAL: return "GENERAL";
+	case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL: return "SHADER_READ_ONLY_OPTIMAL";
+	case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL: return "TRANSFER_SRC_OPTIMAL";
+	case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL: return "TRANSFER_DST_OPTIMAL";
+	case VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL: return "ATTACHMENT_OPTIMAL";
+	case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR: return "PRESENT_SRC";
+	default: return "OTHER";
+	}
+}
+
+const char* usageName(RGUsage usage)
+{
+	switch (usage) {
+	case RGUsage::ColorAttachmentWrite: return "color attachment write";
+	case RGUsage::ColorAttachmentReadWrite: return "color attachment read/write";
+	case RGUsage::DepthAttachmentWrite: return "depth attachment write";
+	case RGUsage::DepthAttachmentReadWrite: return "depth attachment read/write";
+	case RGUsage::SampledRead: return "sampled read";
+	case RGUsage::ComputeSampledRead: return "compute sampled read";
+	case RGUsage::ComputeSampledReadGeneral: return "compute sampled read (general)";
+	case RGUsage::ComputeStorageRead: return "compute storage read";
+	case RGUsage::ComputeStorageWrite: return "compute storage write";
+	case RGUsage::TransferSrc: return "transfer src";
+	case RGUsage::TransferDst: return "transfer dst";
+	case RGUsage::IndirectRead: return "indirect read";
+	case RGUsage::VertexShaderRead: return "vertex shader read";
+	}
+	return "unknown";
+}
+
+} // namespace
+
+RenderGraph::~RenderGraph()
+{
+	destroy();
+}
+
+RGResource RenderGraph::importImage(const std::string& name, const RGImportedImage& desc)
+{
+	Resource res{ .name = name, .isImage = true, .imported = true, .importDesc = desc };
+	resources_.push_back(res);
+	return static_cast<RGResource>(resources_.size() - 1);
+}
+
+RGResource RenderGraph::importBuffer(const std::string& name, VkPipelineStageFlags2 initialStage, VkAccessFlags2 initialAccess)
+{
+	Resource res{ .name = name, .isImage = false, .imported = true };
+	res.importDesc.initialStage = initialStage;
+	res.importDesc.initialAccess = initialAccess;
+	resources_.push_back(res);
+	return static_cast<RGResource>(resources_.size() - 1);
+}
+
+RGResource RenderGraph::createImage(const std::string& name, const RGImageDesc& desc)
+{
+	Resource res{ .name = name, .isImage = true, .imported = false, .imageDesc = desc };
+	resources_.push_back(res);
+	return static_cast<RGResource>(resources_.size() - 1);
+}
+
+void RenderGraph::markOutput(RGResource resource)
+{
+	resources_[resource].output = true;
+}
+
+void RenderGraph::addPass(const std::string& name, std::vector<RGUse> uses, ExecuteFn execute)
+{
+	passes_.push_back({ .name = name, .uses = std::move(uses), .execute = std::move(execute) });
+}
+
+bool RenderGraph::compile(VkDevice device, VmaAllocator allocator, VkExtent2D extent, DeletionQueue* deletionQueue)
+{
+	destroy(deletionQueue);
+	device_ = device;
+	allocator_ = allocator;
+	extent_ = extent;
+	cullPasses();
+	if (!createTransients()) {
+		return false;
+	}
+	buildBarriers();
+	return true;
+}
+
+void RenderGraph::setImportedImage(RGResource resource, VkImage image)
+{
+	resources_[resource].image = image;
+}
+
+void RenderGraph::setImportedBuffer(RGResource resource, VkBuffer buffer)
+{
+	resources_[resource].buffer = buffer;
+}
+
+void RenderGraph::execute(VkCommandBuffer cb) const
+{
+	for (const auto& pass : passes_) {
+		if (pass.culled) continue;
+		emitBarriers(cb, pass.barriers);
+		pass.execute(cb);
+	}
+	emitBarriers(cb, finalBarriers_);
+}
+
+void RenderGraph::destroy(DeletionQueue* deletionQueue)
+{
+	bool hasTransients = !memoryBlocks_.empty();
+	for (const auto& res : resources_) {
+		if (!res.imported && res.image != VK_NULL_HANDLE) hasTransients = true;
+	}
+	if (!hasTransients) return;
+	// Transients of the previous compile may still be referenced by frames in flight
+	if (deletionQueue != nullptr) {
+		for (auto& res : resources_) {
+			if (res.imported) continue;
+			deletionQueue->retireImageView(res.view);
+			deletionQueue->retireImage(res.image);
+			res.view = VK_NULL_HANDLE;
+			res.image = VK_NULL_HANDLE;
+			res.memoryBlock = UINT32_MAX;
+		}
+		// Queued after the images that are bound to them
+		for (auto& block : memoryBlocks_) {
+			deletionQueue->retireMemory(block.allocation);
+		}
+		memoryBlocks_.clear();
+		return;
+	}
+	vkDeviceWaitIdle(device_);
+	for (auto& res : resources_) {
+		if (res.imported) continue;
+		if (res.view != VK_NULL_HANDLE) { vkDestroyImageView(device_, res.view, nullptr); res.view = VK_NULL_HANDLE; }
+		if (res.image != VK_NULL_HANDLE) { vkDestroyImage(device_, res.image, nullptr); res.image = VK_NULL_HANDLE; }
+		res.memoryBlock = UINT32_MAX;
+	}
+	for (auto& block : memoryBlocks_) {
+		if (block.allocation != VK_NULL_HANDLE) vmaFreeMemory(allocator_, block.allocation);
+	}
+	memoryBlocks_.clear();
+}
+
+VkImage RenderGraph::getImage(RGResource resource) const
+{
+	return resources_[resource].image;
+}
+
+VkImageView RenderGraph::getImageView(RGResource resource) const
+{
+	return resources_[resource].view;
+}
+
+void RenderGraph::cullPasses()
+{
+	// Walk backwards from the outputs. A pass is live if it writes something a
+	// later live pass (or the outside world) needs. Overwriting writes end the
+	// need for earlier contents, reads and read/write usages extend it.
+	std::vector<bool> needed(resources_.size(), false);
+	for (size_t i = 0; i < resources_.size(); i++) {
+		needed[i] = resources_[i].output;
+	}
+	for (size_t p = passes_.size(); p-- > 0;) {
+		Pass& pass = passes_[p];
+		bool live = false;
+		for (const auto& use : pass.uses) {
+			if (usageInfo(use.usage).write && needed[use.resource]) live = true;
+		}
+		pass.culled = !live;
+		if (!live) continue;
+		for (const auto& use : pass.uses) {
+			UsageInfo info = usageInfo(use.usage);
+			if (info.write && !info.preserve) needed[use.resource] = false;
+		}
+		for (const auto& use : pass.uses) {
+			UsageInfo info = usageInfo(use.usage);
+			if (!info.write || info.preserve) needed[use.resource] = true;
+		}
+	}
+}
+
+bool RenderGraph::createTransients()
+{
+	// Lifetimes in terms of live pass indices
+	for (auto& res : resources_) {
+		res.firstPass = UINT32_MAX;
+		res.lastPass = 0;
+	}
+	for (uint32_t p = 0; p < passes_.size(); p++) {
+		if (passes_[p].culled) continue;
+		for (const auto& use : passes_[p].uses) {
+			Resource& res = resources_[use.resource];
+			res.firstPass = std::min(res.firstPass, p);
+			res.lastPass = std::max(res.lastPass, p);
+		}
+	}
+
+	// Create the images first so their memory requirements are known
+	std::vector<std::pair<RGResource, VkMemoryRequirements>> transients;
+	for (RGResource r = 0; r < resources_.size(); r++) {
+		Resource& res = resources_[r];
+		if (res.imported || res.firstPass == UINT32_MAX) continue;
+		VkImageCreateInfo imageCI{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = res.imageDesc.format,
+			.extent{.width = extent_.width, .height = extent_.height, .depth = 1 },
+			.mipLevels = 1,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = res.imageDesc.usage,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		};
+		VkResult result = vkCreateImage(device_, &imageCI, nullptr, &res.image);
+		if (result != VK_SUCCESS) {
+			std::cerr << "vkCreateImage failed for render graph image '" << res.name << "': " << result << std::endl;
+			return false;
+		}
+		VkMemoryRequirements req{};
+		vkGetImageMemoryRequirements(device_, res.image, &req);
+		transients.push_back({ r, req });
+	}
+
+	// Greedy placement by first use: an image joins the first block whose
+	// current occupants are all dead before it becomes live.
+	std::sort(transients.begin(), transients.end(), [this](const auto& a, const auto& b) { return resources_[a.first].firstPass < resources_[b.first].firstPass; });
+	struct Placement { uint32_t lastPass; uint32_t memoryTypeBits; VkDeviceSize alignment; };
+	std::vector<Placement> placements;
+	for (const auto& [r, req] : transients) {
+		Resource& res = resources_[r];
+		uint32_t block = UINT32_MAX;
+		for (uint32_t b = 0; b < placements.size(); b++) {
+			if (placements[b].lastPass < res.firstPass && (placements[b].memoryTypeBits & req.memoryTypeBits) != 0) {
+				block = b;
+				break;
+			}
+		}
+		if (block == UINT32_MAX) {
+			block = static_cast<uint32_t>(memoryBlocks_.size());
+			memoryBlocks_.push_back({});
+			placements.push_back({ 0, req.memoryTypeBits, req.alignment });
+		}
+		placements[block].lastPass = res.lastPass;
+		placements[block].memoryTypeBits &= req.memoryTypeBits;
+		placements[block].alignment = std::max(placements[block].alignment, req.alignment);
+		memoryBlocks_[block].size = std::max(memoryBlocks_[block].size, req.size);
+		memoryBlocks_[block].resources.push_back(r);
+		res.memoryBlock = block;
+	}
+
+	for (uint32_t b = 0; b < memoryBlocks_.size(); b++) {
+		MemoryBlock& block = memoryBlocks_[b];
+		VkMemoryRequirements req{ .size = block.size, .alignment = placements[b].alignment, .memoryTypeBits = placements[b].memoryTypeBits };
+		VmaAllocationCreateInfo allocCI{ .preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT };
+		VkResult r = vmaAllocateMemory(allocator_, &req, &allocCI, &block.allocation, nullptr);
+		if (r != VK_SUCCESS) {
+			std::cerr << "vmaAllocateMemory failed for render graph memory block " << b << ": " << r << std::endl;
+			return false;
+		}
+		for (RGResource res : block.resources) {
+			Resource& image = resources_[res];
+			if (vmaBindImageMemory(allocator_, block.allocation, image.image) != VK_SUCCESS) {
+				std::cerr << "vmaBindImageMemory failed for render graph image '" << image.name << "'" << std::endl;
+				return false;
+			}
+			VkImageViewCreateInfo viewCI{};
+			viewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewCI.image = image.image;
+			viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewCI.format = image.imageDesc.format;
+			viewCI.subresourceRange.aspectMask = image.imageDesc.aspect;
+			viewCI.subresourceRange.levelCount = 1;
+			viewCI.subresourceRange.layerCount = 1;
+			if (vkCreateImageView(device_, &viewCI, nullptr, &image.view) != VK_SUCCESS) {
+				std::cerr << "vkCreateImageView failed for render graph image '" << image.name << "'" << std::endl;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void RenderGraph::buildBarriers()
+{
+	struct State {
+		VkImageLayout layout{ VK_IMAGE_LAYOUT_UNDEFINED };
+		VkPipelineStageFlags2 writeStage{ 0 };
+		VkAccessFlags2 writeAccess{ 0 };
+		VkPipelineStageFlags2 readStages{ 0 };
+		VkPipelineStageFlags2 syncedReadStages{ 0 };
+	};
+
+	// Transients start undefined, but must wait for every earlier use of their
+	// memory: the same image in the previous frame and other images aliasing it.
+	std::vector<VkPipelineStageFlags2> blockStages(memoryBlocks_.size(), 0);
+	std::vector<VkAccessFlags2> blockWrites(memoryBlocks_.size(), 0);
+	for (const auto& pass : passes_) {
+		if (pass.culled) continue;
+		for (const auto& use : pass.uses) {
+			const Resource& res = resources_[use.resource];
+			if (res.imported || res.memoryBlock == UINT32_MAX) continue;
+			UsageInfo info = usageInfo(use.usage);
+			blockStages[res.memoryBlock] |= info.stage;
+			blockWrites[res.memoryBlock] |= info.access & writeAccessMask;
+		}
+	}
+
+	std::vector<State> states(resources_.size());
+	for (size_t i = 0; i < resources_.size(); i++) {
+		const Resource& res = resources_[i];
+		if (res.imported) {
+			states[i].layout = res.isImage ? res.importDesc.initialLayout : VK_IMAGE_LAYOUT_UNDEFINED;
+			states[i].writeStage = res.importDesc.initialStage;
+			states[i].writeAccess = res.importDesc.initialAccess;
+		} else if (res.memoryBlock != UINT32_MAX) {
+			states[i].writeStage = blockStages[res.memoryBlock];
+			states[i].writeAccess = blockWrites[res.memoryBlock];
+		}
+	}
+
+	for (auto& pass : passes_) {
+		pass.barriers.clear();
+		if (pass.culled) continue;
+		for (const auto& use : pass.uses) {
+			const Resource& res = resources_[use.resource];
+			State& st = states[use.resource];
+			UsageInfo info = usageInfo(use.usage);
+			const VkImageLayout newLayout = res.isImage ? info.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+			if (info.write) {
+				// WAW and WAR: wait for the last writer and all readers since
+				Barrier barrier{
+					.resource = use.resource,
+					.srcStage = st.writeStage | st.readStages,
+					.srcAccess = st.writeAccess,
+					.dstStage = info.stage,
+					.dstAccess = info.access,
+					.oldLayout = info.preserve ? st.layout : VK_IMAGE_LAYOUT_UNDEFINED,
+					.newLayout = newLayout
+				};
+				if (barrier.srcStage != 0 || barrier.oldLayout != barrier.newLayout) {
+					pass.barriers.push_back(barrier);
+				}
+				st.layout = newLayout;
+				st.writeStage = info.stage;
+				st.writeAccess = info.access & writeAccessMask;
+				st.readStages = 0;
+				st.syncedReadStages = 0;
+			} else if (st.layout != newLayout) {
+				// Read in a new layout: the transition also orders against earlier readers
+				pass.barriers.push_back({
+					.resource = use.resource,
+					.srcStage = st.writeStage | st.readStages,
+					.srcAccess = st.writeAccess,
+					.dstStage = info.stage,
+					.dstAccess = info.access,
+					.oldLayout = st.layout,
+					.newLayout = newLayout
+				});
+				st.layout = newLayout;
+				st.readStages = info.stage;
+				st.syncedReadStages = info.stage;
+			} else {
+				// RAW in the same layout: only needed once per reading stage
+				if ((st.syncedReadStages & info.stage) != info.stage && st.writeStage != 0) {
+					pass.barriers.push_back({
+						.resource = use.resource,
+						.srcStage = st.writeStage,
+						.srcAccess = st.writeAccess,
+						.dstStage = info.stage,
+						.dstAccess = info.access,
+						.oldLayout = st.layout,
+						.newLayout = st.layout
+					});
+					st.syncedReadStages |= info.stage;
+				}
+				st.readStages |= info.stage;
+			}
+		}
+	}
+
+	// Hand imported images over in their final layout (e.g. for presentation).
+	// Nothing in this queue uses them afterwards, so the destination scope is empty.
+	finalBarriers_.clear();
+	for (RGResource r = 0; r < resources_.size(); r++) {
+		const Resource& res = resources_[r];
+		if (!res.imported || !res.isImage || res.importDesc.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED || res.firstPass == UINT32_MAX) continue;
+		const State& st = states[r];
+		finalBarriers_.push_back({
+			.resource = r,
+			.srcStage = st.writeStage | st.readStages,
+			.srcAccess = st.writeAccess,
+			.dstStage = VK_PIPELINE_STAGE_2_NONE,
+			.dstAccess = VK_ACCESS_2_NONE,
+			.oldLayout = st.layout,
+			.newLayout = res.importDesc.finalLayout
+		});
+	}
+}
+
+void RenderGraph::emitBarriers(VkCommandBuffer cb, const std::vector<Barrier>& barriers) const
+{
+	if (barriers.empty()) return;
+	std::vector<VkImageMemoryBarrier2> imageBarriers;
+	std::vector<VkBufferMemoryBarrier2> bufferBarriers;
+	for (const auto& barrier : barriers) {
+		const Resource& res = resources_[barrier.resource];
+		if (res.isImage) {
+			if (res.image == VK_NULL_HANDLE) continue;
+			imageBarriers.push_back({
+				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+				.srcStageMask = barrier.srcStage,
+				.srcAccessMask = barrier.srcAccess,
+				.dstStageMask = barrier.dstStage,
+				.dstAccessMask = barrier.dstAccess,
+				.oldLayout = barrier.oldLayout,
+				.newLayout = barrier.newLayout,
+				.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.image = res.image,
+				.subresourceRange{.aspectMask = res.imported ? res.importDesc.aspect : res.imageDesc.aspect, .levelCount = VK_REMAINING_MIP_LEVELS, .layerCount = VK_REMAINING_ARRAY_LAYERS }
+			});
+		} else {
+			if (res.buffer == VK_NULL_HANDLE) continue;
+			bufferBarriers.push_back({
+				.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+				.srcStageMask = barrier.srcStage,
+				.srcAccessMask = barrier.srcAccess,
+				.dstStageMask = barrier.dstStage,
+				.dstAccessMask = barrier.dstAccess,
+				.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.buffer = res.buffer,
+				.size = VK_WHOLE_SIZE
+			});
+		}
+	}
+	VkDependencyInfo dependencyInfo{
+		.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+		.bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+		.pBufferMemoryBarriers = bufferBarriers.data(),
+		.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size()),
+		.pImageMemoryBarriers = imageBarriers.data()
+	};
+	vkCmdPipelineBarrier2(cb, &dependencyInfo);
+}
+
+std::string RenderGraph::dump() const
+{
+	std::ostringstream out;
+	size_t culled = std::count_if(passes_.begin(), passes_.end(), [](const Pass& p) { return p.culled; });
+	size_t transientCount = 0;
+	VkDeviceSize transientBytes = 0;
+	for (const auto& block : memoryBlocks_) {
+		transientCount += block.resources.size();
+		transientBytes += block.size;
+	}
+	out << "Render graph: " << passes_.size() << " passes (" << culled << " culled), "
+		<< transientCount << " transient images in " << memoryBlocks_.size() << " memory blocks ("
+		<< transientBytes / 1024 << " KiB), extent " << extent_.width << "x" << extent_.height << "\n";
+
+	auto printBarrier = [&](const Barrier& b) {
+		const Resource& res = resources_[b.resource];
+		out << "    barrier " << res.name << ": ";
+		if (res.isImage) out << layoutName(b.oldLayout) << " -> " << layoutName(b.newLayout) << ", ";
+		out << stageNames(b.srcStage) << " -> " << stageNames(b.dstStage) << "\n";
+	};
+	for (size_t p = 0; p < passes_.size(); p++) {
+		const Pass& pass = passes_[p];
+		out << (pass.culled ? "  [culled] " : "  [") << (pass.culled ? "" : std::to_string(p) + "] ") << pass.name << "\n";
+		if (pass.culled) continue;
+		for (const auto& b : pass.barriers) printBarrier(b);
+		for (const auto& use : pass.uses) {
+			out << "    uses " << resources_[use.resource].name << " (" << usageName(use.usage) << ")\n";
+		}
+	}
+	if (!finalBarriers_.empty()) {
+		out << "  [final]\n";
+		for (const auto& b : finalBarriers_) printBarrier(b);
+	}
+	for (size_t b = 0; b < memoryBlocks_.size(); b++) {
+		out << "  memory block " << b << " (" << memoryBlocks_[b].size / 1024 << " KiB):";
+		for (RGResource r : memoryBlocks_[b].resources) {
+			out << " " << resources_[r].name << " [" << resources_[r].firstPass << "-" << resources_[r].lastPass << "]";
+		}
+		out << "\n";
+	}
+	return out.str();
+}
@@ -0,0 +1,164 @@
+// RenderGraph.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vma/vk_mem_alloc.h>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class DeletionQueue; // forward
+
+// Handle of a resource registered with the graph
+using RGResource = uint32_t;
+static constexpr RGResource invalidRGResource = UINT32_MAX;
+
+// How a pass uses a resource. Each usage implies the pipeline stage, access
+// mask and (for images) the layout the resource must be in while the pass
+// runs. "Write" usages discard the previous contents, "ReadWrite" usages keep them.
+enum class RGUsage {
+    ColorAttachmentWrite,
+    ColorAttachmentReadWrite,
+    DepthAttachmentWrite,
+    DepthAttachmentReadWrite,
+    SampledRead,            // sampled in a fragment shader
+    ComputeSampledRead,     // sampled in a compute shader
+    ComputeSampledReadGeneral, // sampled in a compute shader, image stays in GENERAL (storage image elsewhere)
+    ComputeStorageRead,
+    ComputeStorageWrite,
+    TransferSrc,
+    TransferDst,
+    IndirectRead,           // indirect draw arguments / counts
+    VertexShaderRead,       // storage or device address reads in a vertex shader
+};
+
+struct RGUse {
+    RGResource resource{ invalidRGResource };
+    RGUsage usage{ RGUsage::SampledRead };
+};
+
+// An image owned by someone else (swapchain, depth buffer). The initial state
+// describes how the image was last used before the graph runs, e.g. the stage
+// the acquire semaphore waits on for swapchain images. If finalLayout is set
+// the graph transitions the image to it after the last pass. Images read
+// outside the graph (presented, kept for the next frame) must be marked with
+// markOutput(), or the passes writing them are culled.
+struct RGImportedImage {
+    VkImageAspectFlags aspect{ VK_IMAGE_ASPECT_COLOR_BIT };
+    VkImageLayout initialLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
+    VkPipelineStageFlags2 initialStage{ VK_PIPELINE_STAGE_2_NONE };
+    VkAccessFlags2 initialAccess{ VK_ACCESS_2_NONE };
+    VkImageLayout finalLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
+};
+
+// An image created by the graph. Transient images only live for the duration
+// of the passes using them, so images with disjoint lifetimes share memory.
+// The extent is the one passed to compile().
+struct RGImageDesc {
+    VkFormat format{ VK_FORMAT_UNDEFINED };
+    VkImageUsageFlags usage{ 0 };
+    VkImageAspectFlags aspect{ VK_IMAGE_ASPECT_COLOR_BIT };
+};
+
+// Minimal render graph. Passes declare the resources they read and write;
+// compile() culls passes whose results are never consumed, places transient
+// images into aliased memory and computes one batched barrier per pass with
+// the minimal stage/access masks and layout transitions. execute() then only
+// emits the precomputed barriers and calls the pass callbacks.
+//
+// Passes are declared once; compile() is called again when the render extent
+// changes. Imported image handles may change every frame (swapchain images)
+// and are set with setImportedImage() before execute().
+class RenderGraph {
+public:
+    using ExecuteFn = std::function<void(VkCommandBuffer)>;
+
+    RenderGraph() = default;
+    ~RenderGraph();
+
+    // Non-copyable
+    RenderGraph(const RenderGraph&) = delete;
+    RenderGraph& operator=(const RenderGraph&) = delete;
+
+    RGResource importImage(const std::string& name, const RGImportedImage& desc);
+    RGResource importBuffer(const std::string& name, VkPipelineStageFlags2 initialStage = VK_PIPELINE_STAGE_2_NONE, VkAccessFlags2 initialAccess = VK_ACCESS_2_NONE);
+    RGResource createImage(const std::string& name, const RGImageDesc& desc);
+    // Keep the producers of this resource alive even if no pass reads it
+    void markOutput(RGResource resource);
+
+    void addPass(const std::string& name, std::vector<RGUse> uses, ExecuteFn execute);
+
+    // Cull, allocate transient images for the given extent and build the
+    // barrier schedule. Images of a previous compile are retired through
+    // deletionQueue, or released after waiting for device idle without one.
+    // Returns false if a transient image could not be created.
+    bool compile(VkDevice device, VmaAllocator allocator, VkExtent2D extent, DeletionQueue* deletionQueue = nullptr);
+
+    void setImportedImage(RGResource resource, VkImage image);
+    void setImportedBuffer(RGResource resource, VkBuffer buffer);
+
+    // Record all live passes with their barriers into cb
+    void execute(VkCommandBuffer cb) const;
+
+    // Release transient images, see compile()
+    void destroy(DeletionQueue* deletionQueue = nullptr);
+
+    VkImage getImage(RGResource resource) const;
+    VkImageView getImageView(RGResource resource) const;
+    VkExtent2D getExtent() const { return extent_; }
+
+    // Human readable description of the compiled schedule
+    std::string dump() const;
+
+private:
+    struct Resource {
+        std::string name;
+        bool isImage{ true };
+        bool imported{ false };
+        bool output{ false };
+        RGImportedImage importDesc{};
+        RGImageDesc imageDesc{};
+        VkImage image{ VK_NULL_HANDLE };
+        VkImageView view{ VK_NULL_HANDLE };
+        VkBuffer buffer{ VK_NULL_HANDLE };
+        // Transient placement
+        uint32_t firstPass{ UINT32_MAX };
+        uint32_t lastPass{ 0 };
+        uint32_t memoryBlock{ UINT32_MAX };
+    };
+    struct Barrier {
+        RGResource resource{ invalidRGResource };
+        VkPipelineStageFlags2 srcStage{ 0 };
+        VkAccessFlags2 srcAccess{ 0 };
+        VkPipelineStageFlags2 dstStage{ 0 };
+        VkAccessFlags2 dstAccess{ 0 };
+        VkImageLayout oldLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
+        VkImageLayout newLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
+    };
+    struct Pass {
+        std::string name;
+        std::vector<RGUse> uses;
+        ExecuteFn execute;
+        bool culled{ false };
+        std::vector<Barrier> barriers;
+    };
+    struct MemoryBlock {
+        VmaAllocation allocation{ VK_NULL_HANDLE };
+        VkDeviceSize size{ 0 };
+        std::vector<RGResource> resources;
+    };
+
+    void cullPasses();
+    bool createTransients();
+    void buildBarriers();
+    void emitBarriers(VkCommandBuffer cb, const std::vector<Barrier>& barriers) const;
+
+    VkDevice device_{ VK_NULL_HANDLE };
+    VmaAllocator allocator_{ VK_NULL_HANDLE };
+    VkExtent2D extent_{ 0, 0 };
+    std::vector<Resource> resources_;
+    std::vector<Pass> passes_;
+    std::vector<MemoryBlock> memoryBlocks_;
+    std::vector<Barrier> finalBarriers_;
+};
@@ -9,7 +9,27 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include "Swapchain.h"
+#include "PipelineStatistics.h"
+#include "OverdrawTarget.h"
+#include "ParallelRecorder.h"
+#include "RenderGraph.h"
+#include "InputSampler.h"
+#include "CommandCache.h"
+#include "GpuScene.h"
+#include "GpuCulling.h"
+#include "CpuCulling.h"
+#include "Bvh.h"
+#include "TransformStore.h"
+#include "PersistentBuffer.h"
+#include "FrameAllocator.h"
+#include "DeletionQueue.h"
+#include "CommandPool.h"
+#include "ShaderWatcher.h"
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
 #include <cstring>
 #include <cstdlib>
 #include <optional>
@@ -27,217 +47,879 @@ static inline void chk(bool result) {
     }
 }
 
-int Renderer::run(const RenderContext& ctx)
+// Stress test scene: columns x rows copies of the mesh on a wall facing the
+// camera, each starting at its own orientation and spinning at its own rate
+static void buildStressGrid(GpuScene& scene, const MeshRange& mesh, uint32_t columns, uint32_t rows, uint32_t materialCount,
+    TransformStore& transforms, std::vector<glm::vec3>& spins)
+{
+    constexpr float spacing = 2.5f;
+    constexpr float twoPi = 6.28318531f;
+    const glm::vec2 origin{ -0.5f * spacing * (float)(columns - 1), -0.5f * spacing * (float)(rows - 1) };
+    for (uint32_t y = 0; y < rows; y++) {
+        for (uint32_t x = 0; x < columns; x++) {
+            uint32_t i = y * columns + x;
+            // Multiplicative hash, gives a stable per-instance variation
+            uint32_t h = i * 2654435761u;
+            auto unorm = [h](uint32_t shift) { return (float)((h >> shift) & 0xff) / 255.0f; };
+            const glm::vec3 position{ origin.x + spacing * (float)x, origin.y + spacing * (float)y, 0.0f };
+            transforms.add(position, glm::quat(glm::vec3(unorm(0) * twoPi, unorm(8) * twoPi, 0.0f)));
+            spins.push_back(glm::vec3(unorm(16) * 2.0f - 1.0f, unorm(24) * 2.0f - 1.0f, 0.0f));
+            scene.addObject(mesh, i % materialCount, glm::translate(glm::mat4(1.0f), position));
+        }
+    }
+}
+
+// Draw list entry of one scene object for the recording threads
+static DrawItem makeDrawItem(const GpuScene& scene, uint32_t object)
+{
+    const ObjectRecord& record = scene.getObject(object);
+    return DrawItem{ .indexCount = record.indexCount, .instanceCount = 1, .firstIndex = record.firstIndex, .vertexOffset = record.vertexOffset, .firstInstance = object };
+}
+
+template <typename... Args>
+void Renderer::log(const Args&... args) const
+{
+    if (ctx_->options.verbose) {
+        (std::cout << ... << args);
+    }
+}
+
+void Renderer::buildScene()
+{
+    auto& scene = *ctx_->scene;
+    // One object per texture side by side, or the --grid stress scene
+    const MeshRange mesh{ .firstIndex = 0, .indexCount = static_cast<uint32_t>(ctx_->indexCount), .vertexOffset = 0, .boundingSphere = ctx_->meshBounds };
+    const uint32_t materialCount{ 3 };
+    stressGrid_ = ctx_->options.gridColumns > 0 && ctx_->options.gridRows > 0;
+    scene.clear();
+    if (stressGrid_) {
+        buildStressGrid(scene, mesh, ctx_->options.gridColumns, ctx_->options.gridRows, materialCount, transforms_, objectSpins_);
+        // Pull the camera back far enough to see the whole grid
+        camPos_.z = -(3.0f + 1.25f * 2.5f * (float)std::max(ctx_->options.gridColumns, ctx_->options.gridRows));
+    } else {
+        for (uint32_t i = 0; i < materialCount; i++) {
+            const glm::vec3 position{ (float)(static_cast<int>(i) - 1) * 3.0f, 0.0f, 0.0f };
+            transforms_.add(position);
+            scene.addObject(mesh, i, glm::translate(glm::mat4(1.0f), position));
+        }
+    }
+    chk(scene.commit());
+    objectCount_ = scene.getObjectCount();
+    shaderData_.selected = std::min(shaderData_.selected, objectCount_ - 1);
+    log("Scene: ", objectCount_, " objects (buffer capacity ", scene.getCapacity(), ")\n");
+    if (culling_) {
+        chk(culling_->reserve(scene.getCapacity(), *ctx_->deletionQueue));
+    }
+    // CPU culling: world space bounds are refreshed with the transforms, the
+    // visible objects are drawn one by one
+    if (cullOnCpu_) {
+        cpuCulling_.resize(objectCount_);
+        if (ctx_->options.bvhCulling) {
+            log("CPU frustum culling (BVH)\n");
+        } else {
+            log("CPU frustum culling (", CpuCulling::getInstructionSet(), ")\n");
+        }
+    }
+    // BVH over the world space object bounds, for picking with the right mouse
+    // button (and culling with --bvh-cull). Refitted after transform updates.
+    worldSpheres_.resize(objectCount_);
+    std::vector<Aabb> initialBounds;
+    for (uint32_t i = 0; i < objectCount_; i++) {
+        updateBounds(i, scene.getObject(i).transform);
+        initialBounds.push_back(Aabb::fromSphere(glm::vec3(worldSpheres_[i]), worldSpheres_[i].w));
+    }
+    bvh_.build(initialBounds);
+    // Draw list for the recording threads, one draw per scene object (per
+    // visible object with CPU culling, rebuilt every frame). The single
+    // threaded path draws the whole scene with one indirect draw instead.
+    drawList_.clear();
+    for (uint32_t i = 0; i < objectCount_; i++) {
+        drawList_.push_back(makeDrawItem(scene, i));
+    }
+}
+
+void Renderer::updateBounds(uint32_t object, const glm::mat4& transform)
+{
+    // The radius grows with the largest axis scale, as in the cull shader
+    const glm::vec4& sphere = ctx_->scene->getObject(object).boundingSphere;
+    const float maxScale = std::sqrt(std::max({ glm::dot(glm::vec3(transform[0]), glm::vec3(transform[0])),
+        glm::dot(glm::vec3(transform[1]), glm::vec3(transform[1])), glm::dot(glm::vec3(transform[2]), glm::vec3(transform[2])) }));
+    worldSpheres_[object] = glm::vec4(glm::vec3(transform * glm::vec4(glm::vec3(sphere), 1.0f)), sphere.w * maxScale);
+    if (cullOnCpu_) {
+        cpuCulling_.setBounds(object, glm::vec3(worldSpheres_[object]), worldSpheres_[object].w);
+    }
+}
+
+// Select the nearest object under the cursor, and report how crowded its surroundings are
+void Renderer::pickObject(sf::Vector2i position)
+{
+    const sf::Vector2u size = ctx_->window->getSize();
+    const glm::mat4 inverseViewProjection = glm::inverse(shaderData_.projection * shaderData_.view);
+    const glm::vec2 ndc{ 2.0f * (float)position.x / (float)size.x - 1.0f, 2.0f * (float)position.y / (float)size.y - 1.0f };
+    const glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc, 1.0f, 1.0f);
+    const glm::vec3 origin = glm::vec3(glm::inverse(shaderData_.view)[3]);
+    const glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+    auto intersectSphere = [&](uint32_t object, float& distance) {
+        const glm::vec3 toCenter = glm::vec3(worldSpheres_[object]) - origin;
+        const float along = glm::dot(toCenter, direction);
+        const float squaredRadius = worldSpheres_[object].w * worldSpheres_[object].w;
+        const float squaredOffset = glm::dot(toCenter, toCenter) - along * along;
+        if (squaredOffset > squaredRadius) {
+            return false;
+        }
+        distance = std::max(along - std::sqrt(squaredRadius - squaredOffset), 0.0f);
+        return true;
+    };
+    uint32_t object{ 0 };
+    float distance{ 0.0f };
+    if (!bvh_.raycast(origin, direction, object, distance, intersectSphere)) {
+        return;
+    }
+    shaderData_.selected = object;
+    std::vector<uint32_t> neighbours;
+    const float range = 4.0f * worldSpheres_[object].w;
+    bvh_.queryRange(Aabb::fromSphere(glm::vec3(worldSpheres_[object]), range), neighbours);
+    // Normally includes the picked object itself, but don't count on it
+    const size_t nearby = neighbours.empty() ? 0 : neighbours.size() - 1;
+    log("Selected object ", object, " at distance ", distance, ", ", nearby, " objects nearby\n");
+}
+
+void Renderer::applyInput(const InputSample& input)
+{
+    if (input.selectionSteps != 0) {
+        const int count = static_cast<int>(objectCount_);
+        shaderData_.selected = static_cast<uint32_t>(((static_cast<int>(shaderData_.selected) + input.selectionSteps) % count + count) % count);
+    }
+    if (input.dragDelta != sf::Vector2i{}) {
+        const glm::vec3 angles{ -(float)input.dragDelta.y * 0.0005f * (float)elapsed_.asMilliseconds(), (float)input.dragDelta.x * 0.0005f * (float)elapsed_.asMilliseconds(), 0.0f };
+        transforms_.setRotation(shaderData_.selected, glm::normalize(glm::quat(angles) * transforms_.getRotation(shaderData_.selected)));
+    }
+}
+
+void Renderer::updateCamera()
+{
+    const sf::Vector2u size = ctx_->window->getSize();
+    shaderData_.projection = glm::perspective(glm::radians(45.0f), (float)size.x / (float)size.y, 0.1f, 32.0f + std::abs(camPos_.z));
+    shaderData_.view = glm::translate(glm::mat4(1.0f), camPos_);
+}
+
+void Renderer::updateShaderData()
+{
+    auto& scene = *ctx_->scene;
+    auto& shaderDataBuffer = *ctx_->shaderDataBuffer;
+    updateCamera();
+    for (uint32_t i : transforms_.update()) {
+        const glm::mat4& transform = transforms_.getMatrix(i);
+        scene.setTransform(i, transform);
+        updateBounds(i, transform);
+        bvh_.update(i, Aabb::fromSphere(glm::vec3(worldSpheres_[i]), worldSpheres_[i].w));
+    }
+    bvh_.refit();
+    scene.update(frameIndex_);
+    shaderData_.objects = scene.getObjectsAddress(frameIndex_);
+    // Only the bytes that changed are uploaded
+    shaderDataBuffer.write(0, shaderData_);
+    chk(shaderDataBuffer.upload(frameIndex_));
+}
+
+void Renderer::cullObjects()
+{
+    auto cullStart = std::chrono::steady_clock::now();
+    if (ctx_->options.bvhCulling) {
+        bvh_.cullFrustum(FrustumPlanes::fromViewProjection(shaderData_.projection * shaderData_.view), visibleObjects_);
+    } else {
+        cpuCulling_.cull(shaderData_.projection * shaderData_.view, visibleObjects_);
+    }
+    cullTimeSum_ += std::chrono::steady_clock::now() - cullStart;
+    if (recorder_) {
+        drawList_.clear();
+        for (uint32_t i : visibleObjects_) {
+            drawList_.push_back(makeDrawItem(*ctx_->scene, i));
+        }
+    }
+}
+
+// Scene draw on the main thread. The object index reaches the shaders as
+// firstInstance, as with the indirect draws.
+void Renderer::drawScene(VkCommandBuffer cb)
+{
+    if (cullOnCpu_) {
+        for (uint32_t i : visibleObjects_) {
+            const ObjectRecord& object = ctx_->scene->getObject(i);
+            vkCmdDrawIndexed(cb, object.indexCount, 1, object.firstIndex, object.vertexOffset, i);
+        }
+    } else {
+        ctx_->scene->draw(cb);
+    }
+}
+
+VkViewport Renderer::getViewport() const
+{
+    return VkViewport{ .width = static_cast<float>(ctx_->window->getSize().x), .height = static_cast<float>(ctx_->window->getSize().y), .minDepth = 0.0f, .maxDepth = 1.0f };
+}
+
+VkRect2D Renderer::getScissor() const
+{
+    return VkRect2D{ .extent{ .width = ctx_->window->getSize().x, .height = ctx_->window->getSize().y } };
+}
+
+// Render graph: passes declare which images they read and write, the graph
+// derives layout transitions and barriers from that. Passes are declared
+// once, their callbacks pick up the per-frame state (imageIndex_, frameIndex_)
+// when the graph is executed.
+void Renderer::buildGraph()
+{
+    backbuffer_ = graph_.importImage("swapchain", {
+        .aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+        // Cleared every frame; the acquire semaphore wait happens at this stage
+        .initialStage = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+        .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR });
+    depthTarget_ = graph_.importImage("depth", {
+        .aspect = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT,
+        // Cleared every frame, but the previous frame's depth writes must be done first
+        // With occlusion culling it is kept from one frame to the next (see run())
+        .initialLayout = occlusionCulling_ ? VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED,
+        .initialStage = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+        .initialAccess = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT });
+    // Presented after the graph, and with occlusion culling the depth buffer
+    // is read by the next frame's depth pyramid
+    graph_.markOutput(backbuffer_);
+    if (occlusionCulling_) {
+        graph_.markOutput(depthTarget_);
+    }
+
+    // GPU culling: the depth pyramid is built from the depth buffer as the
+    // previous frame left it, then the cull pass writes this frame's draw
+    // commands and count, which the scene pass consumes as indirect arguments.
+    // The depth buffer survives to the next frame only through the
+    // markOutput(depthTarget_) call above.
+    std::vector<RGUse> sceneUses{ { backbuffer_, RGUsage::ColorAttachmentWrite }, { depthTarget_, RGUsage::DepthAttachmentWrite } };
+    if (culling_) {
+        depthPyramid_ = graph_.importImage("depthPyramid", { .aspect = VK_IMAGE_ASPECT_COLOR_BIT, .initialStage = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT });
+        // Read as indirect arguments by the previous use of the frame slot
+        culledDraws_ = graph_.importBuffer("culledDraws", VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT);
+        culledCount_ = graph_.importBuffer("culledCount", VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT);
+        if (occlusionCulling_) {
+            graph_.addPass("depth-pyramid", { { depthTarget_, RGUsage::ComputeSampledRead }, { depthPyramid_, RGUsage::ComputeStorageWrite } }, [this](VkCommandBuffer cb) {
+                culling_->recordPyramid(cb);
+            });
+        }
+        graph_.addPass("cull", { { depthPyramid_, RGUsage::ComputeSampledReadGeneral }, { culledDraws_, RGUsage::ComputeStorageWrite }, { culledCount_, RGUsage::ComputeStorageWrite } }, [this](VkCommandBuffer cb) {
+            culling_->recordCull(cb, frameIndex_, ctx_->scene->getCapacity());
+        });
+        sceneUses.push_back({ culledDraws_, RGUsage::IndirectRead });
+        sceneUses.push_back({ culledCount_, RGUsage::IndirectRead });
+    }
+    graph_.addPass("scene", sceneUses, [this](VkCommandBuffer cb) { recordScenePass(cb); });
+
+    // Overdraw visualization. The resolve pass overwrites the swapchain image
+    // kept by markOutput(backbuffer_), so the graph culls the scene pass in
+    // this mode unless markOutput(depthTarget_) keeps it for occlusion culling.
+    if (overdraw_) {
+        overdrawCounts_ = graph_.createImage("overdrawCounts", { .format = overdraw_->getFormat(), .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT });
+        graph_.addPass("overdraw-count", { { overdrawCounts_, RGUsage::ColorAttachmentWrite } }, [this](VkCommandBuffer cb) { recordOverdrawCountPass(cb); });
+        graph_.addPass("overdraw-resolve", { { overdrawCounts_, RGUsage::SampledRead }, { backbuffer_, RGUsage::ColorAttachmentWrite } }, [this](VkCommandBuffer cb) { recordOverdrawResolvePass(cb); });
+    }
+}
+
+void Renderer::compileGraph()
+{
+    chk(graph_.compile(ctx_->device, ctx_->allocator, { ctx_->window->getSize().x, ctx_->window->getSize().y }, ctx_->deletionQueue));
+    sceneVersion_++;
+    if (overdraw_) {
+        chk(overdraw_->setImageView(ctx_->device, graph_.getImageView(overdrawCounts_), *ctx_->deletionQueue));
+    }
+    if (ctx_->options.dumpRenderGraph) {
+        std::cout << graph_.dump();
+    }
+}
+
+void Renderer::recordScenePass(VkCommandBuffer cb)
+{
+    auto& swapHelper = *ctx_->swapchain;
+    auto& shaderDataBuffer = *ctx_->shaderDataBuffer;
+    VkRenderingAttachmentInfo colorAttachmentInfo{
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+        .imageView = swapHelper.imageViews()[imageIndex_],
+        .imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .clearValue{.color{ 0.0f, 0.0f, 0.0f, 1.0f }}
+    };
+    VkRenderingAttachmentInfo depthAttachmentInfo{
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+        .imageView = swapHelper.getDepthView(),
+        .imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        // Next frame's depth pyramid is built from it
+        .storeOp = occlusionCulling_ ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .clearValue = {.depthStencil = {1.0f,  0}}
+    };
+    VkRenderingInfo renderingInfo{
+        .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+        .renderArea{.extent{.width = ctx_->window->getSize().x, .height = ctx_->window->getSize().y }},
+        .layerCount = 1,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &colorAttachmentInfo,
+        .pDepthAttachment = &depthAttachmentInfo
+    };
+    VkViewport vp = getViewport();
+    VkRect2D scissor = getScissor();
+    if (recorder_) {
+        // Workers record the draw list into secondaries, the primary only executes them
+        SecondaryRecordState recordState{
+            .colorFormat = swapHelper.getImageFormat(),
+            .depthFormat = swapHelper.getDepthFormat(),
+            .pipelineCompiler = ctx_->pipelineCompiler,
+            .pipeline = scenePipeline_,
+            .pipelineLayout = ctx_->pipelineLayout,
+            .descriptorSet = ctx_->descriptorSetTex,
+            .vBuffer = ctx_->vBuffer,
+            .indexOffset = ctx_->vBufSize,
+            .shaderDataAddress = shaderDataBuffer.getDeviceAddress(frameIndex_),
+            .viewport = vp,
+            .scissor = scissor,
+            .pipelineStatistics = pipelineStats_ ? PipelineStatistics::getFlags() : 0
+        };
+        const auto& secondaries = recorder_->record(frameIndex_, recordState, drawList_);
+        if (pipelineStats_) pipelineStats_->begin(cb, frameIndex_);
+        renderingInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+        vkCmdBeginRendering(cb, &renderingInfo);
+        if (!secondaries.empty()) {
+            vkCmdExecuteCommands(cb, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+        }
+        vkCmdEndRendering(cb);
+        if (pipelineStats_) pipelineStats_->end(cb, frameIndex_);
+        return;
+    }
+    vkCmdBeginRendering(cb, &renderingInfo);
+    vkCmdSetViewportWithCount(cb, 1, &vp);
+    ctx_->pipelineCompiler->bind(cb, scenePipeline_);
+    vkCmdSetScissorWithCount(cb, 1, &scissor);
+    vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, ctx_->pipelineLayout, 0, 1, &ctx_->descriptorSetTex, 0, nullptr);
+    VkDeviceSize vOffset{ 0 };
+    vkCmdBindVertexBuffers(cb, 0, 1, &ctx_->vBuffer, &vOffset);
+    vkCmdBindIndexBuffer(cb, ctx_->vBuffer, ctx_->vBufSize, VK_INDEX_TYPE_UINT16);
+    const VkDeviceAddress shaderDataAddress = shaderDataBuffer.getDeviceAddress(frameIndex_);
+    vkCmdPushConstants(cb, ctx_->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(VkDeviceAddress), &shaderDataAddress);
+    if (pipelineStats_) pipelineStats_->begin(cb, frameIndex_);
+    if (culling_) {
+        culling_->draw(cb, frameIndex_);
+    } else {
+        drawScene(cb);
+    }
+    if (pipelineStats_) pipelineStats_->end(cb, frameIndex_);
+    vkCmdEndRendering(cb);
+}
+
+// Accumulate one per fragment, no depth test
+void Renderer::recordOverdrawCountPass(VkCommandBuffer cb)
+{
+    VkRenderingAttachmentInfo overdrawAttachmentInfo{
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+        .imageView = graph_.getImageView(overdrawCounts_),
+        .imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .clearValue{.color{ 0.0f, 0.0f, 0.0f, 0.0f }}
+    };
+    VkRenderingInfo overdrawRenderingInfo{
+        .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+        .renderArea{.extent{.width = ctx_->window->getSize().x, .height = ctx_->window->getSize().y }},
+        .layerCount = 1,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &overdrawAttachmentInfo
+    };
+    VkViewport vp = getViewport();
+    VkRect2D scissor = getScissor();
+    vkCmdBeginRendering(cb, &overdrawRenderingInfo);
+    // Counts stay cleared until the pipeline is built
+    if (!ctx_->pipelineCompiler->bind(cb, ctx_->overdrawPipeline)) {
+        vkCmdEndRendering(cb);
+        return;
+    }
+    vkCmdSetViewportWithCount(cb, 1, &vp);
+    vkCmdSetScissorWithCount(cb, 1, &scissor);
+    VkDeviceSize vOffset{ 0 };
+    vkCmdBindVertexBuffers(cb, 0, 1, &ctx_->vBuffer, &vOffset);
+    vkCmdBindIndexBuffer(cb, ctx_->vBuffer, ctx_->vBufSize, VK_INDEX_TYPE_UINT16);
+    const VkDeviceAddress shaderDataAddress = ctx_->shaderDataBuffer->getDeviceAddress(frameIndex_);
+    vkCmdPushConstants(cb, ctx_->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(VkDeviceAddress), &shaderDataAddress);
+    if (pipelineStats_) pipelineStats_->begin(cb, frameIndex_);
+    drawScene(cb);
+    if (pipelineStats_) pipelineStats_->end(cb, frameIndex_);
+    vkCmdEndRendering(cb);
+}
+
+// Map the counts to a heat map in the swapchain image
+void Renderer::recordOverdrawResolvePass(VkCommandBuffer cb)
+{
+    VkRenderingAttachmentInfo colorAttachmentInfo{
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+        .imageView = ctx_->swapchain->imageViews()[imageIndex_],
+        .imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .clearValue{.color{ 0.0f, 0.0f, 0.0f, 1.0f }}
+    };
+    VkRenderingInfo renderingInfo{
+        .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+        .renderArea{.extent{.width = ctx_->window->getSize().x, .height = ctx_->window->getSize().y }},
+        .layerCount = 1,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &colorAttachmentInfo
+    };
+    VkViewport vp = getViewport();
+    VkRect2D scissor = getScissor();
+    vkCmdBeginRendering(cb, &renderingInfo);
+    if (!ctx_->pipelineCompiler->bind(cb, ctx_->overdrawResolvePipeline)) {
+        vkCmdEndRendering(cb);
+        return;
+    }
+    vkCmdSetViewportWithCount(cb, 1, &vp);
+    vkCmdSetScissorWithCount(cb, 1, &scissor);
+    VkDescriptorSet overdrawSet = overdraw_->getSet();
+    vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, ctx_->pipelineLayout, 1, 1, &overdrawSet, 0, nullptr);
+    vkCmdDraw(cb, 3, 1, 0, 0);
+    vkCmdEndRendering(cb);
+}
 
+void Renderer::recordDepthInit(VkCommandBuffer cb)
 {
-    // Copied render loop from previous monolithic implementation and
-    // refactored to operate on the references passed in by the app.
-    sf::Clock clock;
-    uint32_t imageIndex{ 0 };
-    uint32_t frameIndex{ 0 };
-    ShaderData shaderData{};
-    glm::vec3 camPos{ 0.0f, 0.0f, -6.0f };
-    glm::vec3 objectRotations[3]{};
-    sf::Vector2i lastMousePos{};
+    VkCommandBufferBeginInfo setupBI{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT };
+    chk(vkBeginCommandBuffer(cb, &setupBI));
+    VkImageMemoryBarrier2 depthBarrier{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+        .dstStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+        .dstAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .newLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
+        .image = ctx_->swapchain->getDepthImage(),
+        .subresourceRange{ .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT, .levelCount = 1, .layerCount = 1 }
+    };
+    VkDependencyInfo dependencyInfo{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &depthBarrier };
+    vkCmdPipelineBarrier2(cb, &dependencyInfo);
+    chk(vkEndCommandBuffer(cb));
+}
+
+// Window events have to be pumped on the render thread, mouse and keyboard
+// state comes from the input sampler
+void Renderer::handleEvent(const sf::Event& event)
+{
+    if (event.is<sf::Event::Closed>()) {
+        ctx_->window->close();
+    }
+    if (event.is<sf::Event::FocusLost>()) {
+        inputSampler_.setFocused(false);
+    }
+    if (event.is<sf::Event::FocusGained>()) {
+        inputSampler_.setFocused(true);
+    }
+    if (const auto* mouseWheelScrolled = event.getIf<sf::Event::MouseWheelScrolled>()) {
+        camPos_.z += (float)mouseWheelScrolled->delta * 0.025f * (float)elapsed_.asMilliseconds();
+    }
+    if (const auto* mouseButtonPressed = event.getIf<sf::Event::MouseButtonPressed>()) {
+        if (mouseButtonPressed->button == sf::Mouse::Button::Right) {
+            pickObject(mouseButtonPressed->position);
+        }
+    }
+    if (const auto* keyPressed = event.getIf<sf::Event::KeyPressed>()) {
+        if (keyPressed->code == sf::Keyboard::Key::V) {
+            // Cycle through all variants, starting after the newest request
+            const SceneShaderVariant& current = pendingScenePipeline_ != invalidPipelineHandle ? pendingSceneVariant_ : sceneVariant_;
+            pendingSceneVariant_ = current.getNext();
+            PipelineDesc desc = ctx_->sceneDesc;
+            desc.specialization = pendingSceneVariant_.getConstants();
+            pendingScenePipeline_ = ctx_->pipelineCompiler->request(desc);
+        }
+    }
+}
+
+void Renderer::updatePipelines()
+{
+    auto& pipelineCompiler = *ctx_->pipelineCompiler;
+    // Shader hot reload: changed sources are rebuilt in the background and
+    // swapped in here, between frames. Frames in flight keep the old
+    // pipelines until they complete.
+    if (shaderWatcher_) {
+        const auto changed = shaderWatcher_->takeChanged();
+        const uint32_t started = changed.empty() ? 0 : pipelineCompiler.reload(changed);
+        if (started > 0) {
+            log("Shader sources changed, rebuilding ", started, " pipelines\n");
+        }
+    }
+    if (const uint32_t swapped = pipelineCompiler.swapReloaded(*ctx_->deletionQueue); swapped > 0) {
+        log("Reloaded ", swapped, " pipelines\n");
+        sceneVersion_++;
+    }
+    // Passes record different commands once a background pipeline is ready
+    if (pipelineCompiler.getFinishedCount() != finishedPipelines_) {
+        finishedPipelines_ = pipelineCompiler.getFinishedCount();
+        sceneVersion_++;
+    }
+    // The scene keeps the current variant until the requested one is built
+    if (pendingScenePipeline_ != invalidPipelineHandle && pipelineCompiler.isReady(pendingScenePipeline_)) {
+        scenePipeline_ = pendingScenePipeline_;
+        sceneVariant_ = pendingSceneVariant_;
+        pendingScenePipeline_ = invalidPipelineHandle;
+        log("Scene shader variant: ", sceneVariant_.getName(), "\n");
+        sceneVersion_++;
+    } else if (pendingScenePipeline_ != invalidPipelineHandle && pipelineCompiler.isFailed(pendingScenePipeline_)) {
+        std::cerr << "Failed to build scene shader variant " << pendingSceneVariant_.getName() << ", keeping " << sceneVariant_.getName() << "\n";
+        pendingScenePipeline_ = invalidPipelineHandle;
+    }
+}
+
+void Renderer::reportFrameTime()
+{
+    frameTimeSum_ += elapsed_;
+    frameTimeFrames_++;
+    if (frameTimeSum_.asSeconds() < 1.0f) {
+        return;
+    }
+    log(objectCount_, " objects: ", frameTimeSum_.asSeconds() * 1000.0f / (float)frameTimeFrames_, " ms per frame",
+        ", ", (float)uploadSizeSum_ / 1024.0f / (float)frameTimeFrames_, " KiB scene data uploaded");
+    if (cullOnCpu_) {
+        using us = std::chrono::duration<double, std::micro>;
+        log(", ", visibleObjects_.size(), " visible, culling ", us(cullTimeSum_).count() / frameTimeFrames_, " us");
+    }
+    if (commandCache_) {
+        log(", ", commandCache_->getRecordCount(), " command buffers recorded in total");
+    }
+    log("\n");
+    frameTimeSum_ = {};
+    frameTimeFrames_ = 0;
+    cullTimeSum_ = {};
+    uploadSizeSum_ = 0;
+}
+
+void Renderer::reportInputLatency(const InputSample& input)
+{
+    auto inputLatency = std::chrono::steady_clock::now() - input.timestamp;
+    inputLatencySum_ += inputLatency;
+    inputLatencyMax_ = std::max(inputLatencyMax_, inputLatency);
+    inputLatencyFrames_++;
+    if (inputLatencyClock_.getElapsedTime().asSeconds() < 1.0f) {
+        return;
+    }
+    using us = std::chrono::duration<double, std::micro>;
+    std::cout << "Input to submit (" << (ctx_->options.lateLatch ? "late latched" : "sampled before update") << "): "
+        << "avg " << us(inputLatencySum_).count() / inputLatencyFrames_ << " us"
+        << ", max " << us(inputLatencyMax_).count() << " us"
+        << " over " << inputLatencyFrames_ << " frames\n";
+    inputLatencySum_ = {};
+    inputLatencyMax_ = {};
+    inputLatencyFrames_ = 0;
+    inputLatencyClock_.restart();
+}
+
+int Renderer::run(const RenderContext& ctx)
+{
+    ctx_ = &ctx;
+    pipelineStats_ = ctx.options.pipelineStatistics ? ctx.pipelineStats : nullptr;
+    overdraw_ = ctx.options.overdraw ? ctx.overdraw : nullptr;
+    recorder_ = ctx.options.recordingThreads > 0 ? ctx.recorder : nullptr;
+    commandCache_ = ctx.options.cachedCommands ? ctx.commandCache : nullptr;
+    culling_ = ctx.options.gpuCulling ? ctx.culling : nullptr;
+    shaderWatcher_ = ctx.options.shaderHotReload ? ctx.shaderWatcher : nullptr;
+    occlusionCulling_ = culling_ && culling_->isOcclusionEnabled();
+    cullOnCpu_ = ctx.options.cpuCulling && !culling_;
+    scenePipeline_ = ctx.scenePipeline;
+    sceneVariant_ = ctx.sceneVariant;
+    frameAllocatorVersion_ = ctx.frameAllocator->getVersion();
+    sceneBuffersVersion_ = ctx.scene->getVersion();
 
     // Local aliases to simplify access to context members
     auto& window = *ctx.window;
     auto& device = ctx.device;
     auto& queue = ctx.queue;
-    auto& allocator = ctx.allocator;
     auto& swapHelper = *ctx.swapchain;
-    auto& pipeline = ctx.pipeline;
-    auto& pipelineLayout = ctx.pipelineLayout;
-    auto& descriptorSetTex = ctx.descriptorSetTex;
-    auto& vBuffer = ctx.vBuffer;
-    auto vBufSize = ctx.vBufSize;
-    auto indexCount = ctx.indexCount;
-    auto& shaderDataBuffers = *ctx.shaderDataBuffers;
+    auto& shaderDataBuffer = *ctx.shaderDataBuffer;
+    auto& frameAllocator = *ctx.frameAllocator;
+    auto& deletionQueue = *ctx.deletionQueue;
     auto& commandBuffers = *ctx.commandBuffers;
     auto& fences = *ctx.fences;
     auto& presentSemaphores = *ctx.presentSemaphores;
     auto& renderSemaphores = *ctx.renderSemaphores;
-    auto& surfaceCaps = *ctx.surfaceCaps;
-    auto physical = ctx.physical;
-    auto queueFamily = ctx.queueFamily;
+    auto& scene = *ctx.scene;
+
+    buildScene();
+    buildGraph();
+    compileGraph();
+
+    // Depth buffer state for occlusion culling. The depth image is kept in
+    // ATTACHMENT_OPTIMAL between frames, so a new one is transitioned once,
+    // in the first frame that uses it. That frame is culled without occlusion.
+    uint32_t cullingDepthGeneration{ UINT32_MAX };
+    uint32_t preparedDepthGeneration{ UINT32_MAX };
+    bool occlusionReady{ false };
+    glm::mat4 prevViewProjection{ 1.0f };
+    // The transition goes into a small command buffer submitted ahead of the
+    // frame's commands in the same batch: those may be cached and resubmitted,
+    // the transition must only run once. One per frame slot, reused once the
+    // slot's fence has been waited on.
+    setupPool_ = CommandPool(device, ctx.queueFamily);
+    setupCbs_ = setupPool_.allocate(device, VulkanApp::maxFramesInFlight);
+    bool depthNeedsInit{ false };
+    CullStats cullStats{};
+    sf::Clock statsClock;
+    sf::Clock cullStatsClock;
+
+    // Mouse and keyboard state is sampled on its own thread; the loop takes the
+    // newest state right before it builds the frame's matrices (and again right
+    // before submit with --late-latch)
+    inputSampler_.start();
+    // Late latched input that has to wait for the next frame's update
+    InputSample deferredInput{};
 
+    bool swapchainDirty{ false };
     while (window.isOpen()) {
 
-        // Sync
-        chk(vkWaitForFences(device, 1, &fences[frameIndex], true, UINT64_MAX));
-        chk(vkResetFences(device, 1, &fences[frameIndex]));
+        // Event polling
+        while (const std::optional event = window.pollEvent()) {
+            if (event->is<sf::Event::Resized>()) {
+                swapchainDirty = true;
+            }
+            handleEvent(*event);
+        }
+        if (!window.isOpen()) {
+            break;
+        }
+        // The only place the swapchain is recreated. Resize events, acquire and
+        // present just mark it dirty, so a resize costs one recreation per
+        // frame no matter how many of them report it. Frames in flight keep
+        // presenting to the old swapchain, which is retired, not waited for.
+        if (swapchainDirty) {
+            if (window.getSize().x == 0 || window.getSize().y == 0) {
+                // Minimized, there is nothing to present to
+                sf::sleep(sf::milliseconds(10));
+                continue;
+            }
+            if (swapHelper.recreate(ctx.physical, device, ctx.surface, ctx.queueFamily, ctx.allocator, deletionQueue) == VK_NULL_HANDLE) {
+                return -1;
+            }
+            // Presents to the old swapchain may still wait on its render
+            // semaphores, so the new one gets a set of its own (one per image).
+            // The old set is retired with the old swapchain.
+            deletionQueue.retire([device, semaphores = renderSemaphores]() {
+                for (VkSemaphore semaphore : semaphores) {
+                    vkDestroySemaphore(device, semaphore, nullptr);
+                }
+            });
+            renderSemaphores.clear();
+            while (renderSemaphores.size() < swapHelper.images().size()) {
+                VkSemaphoreCreateInfo semaphoreCI{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+                VkSemaphore semaphore{ VK_NULL_HANDLE };
+                chk(vkCreateSemaphore(device, &semaphoreCI, nullptr, &semaphore));
+                renderSemaphores.push_back(semaphore);
+            }
+            swapchainDirty = false;
+        }
+
+        // Sync. The fence is only reset right before the submit, a frame
+        // skipped after this point leaves it signaled.
+        chk(vkWaitForFences(device, 1, &fences[frameIndex_], true, UINT64_MAX));
+        // Transient data of the slot's previous frame is no longer read
+        frameAllocator.reset(frameIndex_);
+        // Frames complete in submission order, so everything up to the one that
+        // last used this slot is done; only the others may still be executing
+        if (deletionQueue.getFrame() + 1 >= VulkanApp::maxFramesInFlight) {
+            deletionQueue.collect(deletionQueue.getFrame() + 1 - VulkanApp::maxFramesInFlight);
+        }
+
+        // The query of the frame that last used this slot has completed now
+        PipelineStatisticsCounters frameStats{};
+        if (pipelineStats_ && pipelineStats_->fetch(device, frameIndex_, frameStats) && statsClock.getElapsedTime().asSeconds() >= 1.0f) {
+            std::cout << "Pipeline statistics (per frame): "
+                << "IA vertices " << frameStats.inputAssemblyVertices
+                << ", IA primitives " << frameStats.inputAssemblyPrimitives
+                << ", VS invocations " << frameStats.vertexShaderInvocations
+                << ", clipping invocations " << frameStats.clippingInvocations
+                << ", clipping primitives " << frameStats.clippingPrimitives
+                << ", FS invocations " << frameStats.fragmentShaderInvocations << "\n";
+            statsClock.restart();
+        }
+        if (culling_ && culling_->fetchStats(frameIndex_, cullStats) && cullStatsClock.getElapsedTime().asSeconds() >= 1.0f) {
+            log("GPU culling: ", cullStats.visible, " visible, ",
+                cullStats.frustumCulled, " frustum culled, ",
+                cullStats.occlusionCulled, " occlusion culled\n");
+            cullStatsClock.restart();
+        }
         VkSwapchainKHR swapchain = swapHelper.get();
         auto &swapchainImages = swapHelper.images();
-        auto &swapchainImageViews = swapHelper.imageViews();
-        VkImageView depthImageView = swapHelper.getDepthView();
-        VkResult acquireRes = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, presentSemaphores[frameIndex], VK_NULL_HANDLE, &imageIndex);
-        if (acquireRes == VK_ERROR_OUT_OF_DATE_KHR || acquireRes == VK_SUBOPTIMAL_KHR) {
-            // Swapchain no longer compatible with window; recreate and skip this frame.
-            swapHelper.recreate(physical, device, ctx.surface, queueFamily, allocator);
+        VkResult acquireRes = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, presentSemaphores[frameIndex_], VK_NULL_HANDLE, &imageIndex_);
+        if (acquireRes == VK_ERROR_OUT_OF_DATE_KHR) {
+            // Nothing was acquired, skip this frame
+            swapchainDirty = true;
             continue;
+        } else if (acquireRes == VK_SUBOPTIMAL_KHR) {
+            // The image is usable (and the semaphore will be signaled), render it
+            // and recreate at the start of the next frame
+            swapchainDirty = true;
         } else if (acquireRes != VK_SUCCESS) {
             std::cerr << "vkAcquireNextImageKHR failed: " << acquireRes << std::endl;
             return -1;
         }
 
-        // Update shader data
-    shaderData.projection = glm::perspective(glm::radians(45.0f), (float)window.getSize().x / (float)window.getSize().y, 0.1f, 32.0f);
-        shaderData.view = glm::translate(glm::mat4(1.0f), camPos);
-        for (auto i = 0; i < 3; i++) {
-            auto instancePos = glm::vec3((float)(i - 1) * 3.0f, 0.0f, 0.0f);
-            shaderData.model[i] = glm::translate(glm::mat4(1.0f), instancePos) * glm::mat4_cast(glm::quat(objectRotations[i]));
-        }
-        memcpy(shaderDataBuffers[frameIndex].mapped, &shaderData, sizeof(ShaderData));
-
-        // Build command buffer
-    auto cb = commandBuffers[frameIndex];
-        vkResetCommandBuffer(cb, 0);
-        VkCommandBufferBeginInfo cbBI { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT };
-        vkBeginCommandBuffer(cb, &cbBI);
-        std::array<VkImageMemoryBarrier2, 2> outputBarriers{
-            VkImageMemoryBarrier2{
-                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
-                .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                .srcAccessMask = 0,
-                .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-                .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-                .newLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
-                .image = swapchainImages[imageIndex],
-                .subresourceRange{.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = 1, .layerCount = 1 }
-            },
-            VkImageMemoryBarrier2{
-                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
-                .srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
-                .srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-                .dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
-                .dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-                .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-                .newLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
-                .image = swapHelper.getDepthImage(),
-                .subresourceRange{.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT, .levelCount = 1, .layerCount = 1 }
+        // Update shader data from the newest input
+        elapsed_ = clock_.restart();
+        for (uint32_t i = 0; i < static_cast<uint32_t>(objectSpins_.size()); i++) {
+            transforms_.setRotation(i, glm::normalize(transforms_.getRotation(i) * glm::quat(objectSpins_[i] * elapsed_.asSeconds())));
+        }
+        if (stressGrid_) {
+            reportFrameTime();
+        }
+        // Input the previous frame's late latch left for this update goes first
+        InputSample input = deferredInput;
+        input.append(inputSampler_.sample());
+        deferredInput = {};
+        applyInput(input);
+        updateShaderData();
+        uploadSizeSum_ += scene.getLastUploadSize() + shaderDataBuffer.getLastUploadSize();
+        if (cullOnCpu_) {
+            cullObjects();
+        }
+
+        // New swapchain extent (first frame, recreation): resize the pyramid to
+        // it. Only a depth image that was actually replaced needs its initial
+        // transition, a reused one stays in ATTACHMENT_OPTIMAL.
+        if (culling_ && cullingDepthGeneration != swapHelper.getGeneration()) {
+            chk(culling_->setDepthImage(swapHelper.getDepthImage(), swapHelper.getExtent(), deletionQueue));
+            if (occlusionCulling_ && preparedDepthGeneration != swapHelper.getDepthGeneration()) {
+                depthNeedsInit = true;
+                preparedDepthGeneration = swapHelper.getDepthGeneration();
             }
-        };
-        VkDependencyInfo barrierDependencyInfo{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .imageMemoryBarrierCount = 2, .pImageMemoryBarriers = outputBarriers.data() };
-        vkCmdPipelineBarrier2(cb, &barrierDependencyInfo);
-        VkRenderingAttachmentInfo colorAttachmentInfo{
-            .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
-            .imageView = swapchainImageViews[imageIndex],
-            .imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
-            .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-            .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-            .clearValue{.color{ 0.0f, 0.0f, 0.0f, 1.0f }}
-        };
-        VkRenderingAttachmentInfo depthAttachmentInfo{
-            .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
-            .imageView = depthImageView,
-            .imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
-            .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-            .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-            .clearValue = {.depthStencil = {1.0f,  0}}
-        };
-        VkRenderingInfo renderingInfo{
-            .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
-            .renderArea{.extent{.width = window.getSize().x, .height = window.getSize().y }},
-            .layerCount = 1,
-            .colorAttachmentCount = 1,
-            .pColorAttachments = &colorAttachmentInfo,
-            .pDepthAttachment = &depthAttachmentInfo
-        };
-        vkCmdBeginRendering(cb, &renderingInfo);
-        VkViewport vp{ .width = static_cast<float>(window.getSize().x), .height = static_cast<float>(window.getSize().y), .minDepth = 0.0f, .maxDepth = 1.0f};
-        vkCmdSetViewport(cb, 0, 1, &vp);
-        VkRect2D scissor{ .extent{ .width = window.getSize().x, .height = window.getSize().y } };
-    vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-        vkCmdSetScissor(cb, 0, 1, &scissor);
-        vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSetTex, 0, nullptr);
-        VkDeviceSize vOffset{ 0 };
-        vkCmdBindVertexBuffers(cb, 0, 1, &vBuffer, &vOffset);
-        vkCmdBindIndexBuffer(cb, vBuffer, vBufSize, VK_INDEX_TYPE_UINT16);
-    vkCmdPushConstants(cb, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(VkDeviceAddress), &shaderDataBuffers[frameIndex].deviceAddress);
-    vkCmdDrawIndexed(cb, indexCount, 3, 0, 0, 0);
-        vkCmdEndRendering(cb);
-        VkImageMemoryBarrier2 barrierPresent{
-            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
-            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-            .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-            .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-            .dstAccessMask = 0,
-            .oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-            .newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-            .image = swapchainImages[imageIndex],
-            .subresourceRange{.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = 1, .layerCount = 1 }
-        };
-        VkDependencyInfo barrierPresentDependencyInfo{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &barrierPresent };
-        vkCmdPipelineBarrier2(cb, &barrierPresentDependencyInfo);
-        vkEndCommandBuffer(cb);
+            cullingDepthGeneration = swapHelper.getGeneration();
+            occlusionReady = false;
+        }
+        if (culling_) {
+            chk(culling_->update(frameAllocator, frameIndex_, prevViewProjection, shaderDataBuffer.getDeviceAddress(frameIndex_), scene.getDrawsAddress(), scene.getDrawCountAddress(), occlusionReady));
+        }
+        // A new allocator block moves transient data, cached commands recorded
+        // with the old addresses can't be reused
+        if (frameAllocator.getVersion() != frameAllocatorVersion_) {
+            frameAllocatorVersion_ = frameAllocator.getVersion();
+            sceneVersion_++;
+        }
+        // Same for recreated scene buffers, or a draw count that is baked into the commands
+        if (scene.getVersion() != sceneBuffersVersion_) {
+            sceneBuffersVersion_ = scene.getVersion();
+            sceneVersion_++;
+        }
+        updatePipelines();
+
+        // Transient images follow the render area
+        if (graph_.getExtent().width != window.getSize().x || graph_.getExtent().height != window.getSize().y) {
+            compileGraph();
+        }
+
+        // Build command buffer, or reuse the one recorded for this image and frame slot
+        auto cb = commandBuffers[frameIndex_];
+        bool record{ true };
+        if (commandCache_) {
+            commandCache_->validate((static_cast<uint64_t>(swapHelper.getGeneration()) << 32) | sceneVersion_, static_cast<uint32_t>(swapchainImages.size()));
+            cb = commandCache_->get(imageIndex_, frameIndex_, record);
+        } else {
+            vkResetCommandBuffer(cb, 0);
+        }
+        if (record) {
+            VkCommandBufferBeginInfo cbBI { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, .flags = commandCache_ ? 0u : VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT };
+            vkBeginCommandBuffer(cb, &cbBI);
+            if (pipelineStats_) {
+                pipelineStats_->reset(cb, frameIndex_);
+            }
+            graph_.setImportedImage(backbuffer_, swapchainImages[imageIndex_]);
+            graph_.setImportedImage(depthTarget_, swapHelper.getDepthImage());
+            if (culling_) {
+                graph_.setImportedImage(depthPyramid_, culling_->getPyramid());
+                graph_.setImportedBuffer(culledDraws_, culling_->getDrawBuffer(frameIndex_));
+                graph_.setImportedBuffer(culledCount_, culling_->getCountBuffer(frameIndex_));
+            }
+            // Device-local scene data: copy this frame's changes before any pass reads them
+            scene.recordUploads(cb, frameIndex_);
+            shaderDataBuffer.recordCopies(cb, frameIndex_);
+            graph_.execute(cb);
+            vkEndCommandBuffer(cb);
+        }
+
+        // Late latch: the command buffer only references the shader data through
+        // its device address, so the camera block can still be replaced with
+        // the newest state. Only the view/projection matrices and the
+        // selection are rewritten; dragging moves an object, which is
+        // per-object work (transforms, BVH, scene upload) and waits for the
+        // next frame's update.
+        if (ctx.options.lateLatch) {
+            InputSample lateInput = inputSampler_.sample();
+            if (lateInput.selectionSteps != 0) {
+                applyInput({ .selectionSteps = lateInput.selectionSteps });
+                input.append({ .timestamp = lateInput.timestamp });
+            }
+            if (lateInput.dragDelta != sf::Vector2i{}) {
+                deferredInput = { .dragDelta = lateInput.dragDelta, .timestamp = lateInput.timestamp };
+            }
+            updateCamera();
+            shaderDataBuffer.write(offsetof(ShaderData, projection), shaderData_.projection);
+            shaderDataBuffer.write(offsetof(ShaderData, view), shaderData_.view);
+            shaderDataBuffer.write(offsetof(ShaderData, selected), shaderData_.selected);
+            chk(shaderDataBuffer.upload(frameIndex_));
+        }
 
-        // Submit to graphics queue
+        frameAllocator.flush(frameIndex_);
+
+        // Submit to graphics queue, a new depth image's transition first
+        std::array<VkCommandBuffer, 2> submitCbs{};
+        uint32_t submitCbCount{ 0 };
+        if (depthNeedsInit) {
+            recordDepthInit(setupCbs_[frameIndex_]);
+            submitCbs[submitCbCount++] = setupCbs_[frameIndex_];
+            depthNeedsInit = false;
+        }
+        submitCbs[submitCbCount++] = cb;
         VkPipelineStageFlags waitStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
         VkSubmitInfo submitInfo{
             .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
             .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &presentSemaphores[frameIndex],
+            .pWaitSemaphores = &presentSemaphores[frameIndex_],
             .pWaitDstStageMask = &waitStages,
-            .commandBufferCount = 1,
-            .pCommandBuffers = &cb,
+            .commandBufferCount = submitCbCount,
+            .pCommandBuffers = submitCbs.data(),
             .signalSemaphoreCount = 1,
-            .pSignalSemaphores = &renderSemaphores[imageIndex],
+            .pSignalSemaphores = &renderSemaphores[imageIndex_],
         };
-        chk(vkQueueSubmit(queue, 1, &submitInfo, fences[frameIndex]));
-        frameIndex = (frameIndex + 1) % VulkanApp::maxFramesInFlight;
+        chk(vkResetFences(device, 1, &fences[frameIndex_]));
+        chk(vkQueueSubmit(queue, 1, &submitInfo, fences[frameIndex_]));
+        deletionQueue.nextFrame();
+        // The next frame's pyramid holds this frame's depth. The overdraw view
+        // doesn't render the lit scene pass, so it leaves no usable depth.
+        prevViewProjection = shaderData_.projection * shaderData_.view;
+        occlusionReady = occlusionCulling_ && !overdraw_;
+        // Frames without new input have no latency to report
+        if (ctx.options.reportInputLatency && input.hasInput()) {
+            reportInputLatency(input);
+        }
+        frameIndex_ = (frameIndex_ + 1) % VulkanApp::maxFramesInFlight;
         VkPresentInfoKHR presentInfo{
             .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
             .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &renderSemaphores[imageIndex],
+            .pWaitSemaphores = &renderSemaphores[imageIndex_],
             .swapchainCount = 1,
             .pSwapchains = &swapchain,
-            .pImageIndices = &imageIndex
+            .pImageIndices = &imageIndex_
         };
         VkResult presentRes = vkQueuePresentKHR(queue, &presentInfo);
         if (presentRes == VK_ERROR_OUT_OF_DATE_KHR || presentRes == VK_SUBOPTIMAL_KHR) {
-            // Present situation requires swapchain recreation
-            swapHelper.recreate(physical, device, ctx.surface, queueFamily, allocator);
-            continue;
+            swapchainDirty = true;
         } else if (presentRes != VK_SUCCESS) {
             std::cerr << "vkQueuePresentKHR failed: " << presentRes << std::endl;
             return -1;
         }
-
-        // Event polling
-        sf::Time elapsed = clock.restart();
-    while (const std::optional event = window.pollEvent()) {
-            if (event->is<sf::Event::Closed>()) {
-                window.close();
-            }
-            if (const auto* mouseMoved = event->getIf<sf::Event::MouseMoved>()) {
-                if (sf::Mouse::isButtonPressed(sf::Mouse::Button::Left)) {
-                    auto delta = lastMousePos - mouseMoved->position;
-                    objectRotations[shaderData.selected].x += (float)delta.y * 0.0005f * (float)elapsed.asMilliseconds();
-                    objectRotations[shaderData.selected].y -= (float)delta.x * 0.0005f * (float)elapsed.asMilliseconds();
-                }
-                lastMousePos = mouseMoved->position;
-            }
-            if (const auto* mouseWheelScrolled = event->getIf<sf::Event::MouseWheelScrolled>()) {
-                camPos.z += (float)mouseWheelScrolled->delta * 0.025f * (float)elapsed.asMilliseconds();
-            }
-            if (const auto* keyPressed = event->getIf<sf::Event::KeyPressed>()) {
-                if (keyPressed->code == sf::Keyboard::Key::Add) {
-                    shaderData.selected = (shaderData.selected < 2) ? shaderData.selected + 1 : 0;
-                }
-                if (keyPressed->code == sf::Keyboard::Key::Subtract) {
-                    shaderData.selected = (shaderData.selected > 0) ? shaderData.selected - 1 : 2;
-                }
-            }
-
-            // Window resize - recreate swapchain and depth image
-            if (const auto* resized = event->getIf<sf::Event::Resized>()) {
-                // Delegate full recreation to Swapchain::recreate which handles
-                // device idle and surface capability refresh internally.
-                swapHelper.recreate(physical, device, ctx.surface, queueFamily, allocator);
-            }
-        }
     }
 
+    // What the loop created goes before the caller tears down the device
+    inputSampler_.stop();
+    chk(vkDeviceWaitIdle(device));
+    graph_.destroy();
+    setupPool_.destroy();
+
     return 0;
 }
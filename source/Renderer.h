@@ -4,11 +4,74 @@
 #include <vulkan/vulkan.h>
 #include <vma/vk_mem_alloc.h>
 #include <SFML/Graphics.hpp>
-#include "VulkanApp.h" // for ShaderDataBuffer, Texture, Vertex types
+#include "VulkanApp.h" // for Texture, Vertex types
+#include "PipelineCompiler.h" // for PipelineHandle
+#include "ShaderVariant.h"
+#include "RenderGraph.h"
+#include "TransformStore.h"
+#include "CpuCulling.h"
+#include "Bvh.h"
+#include "InputSampler.h"
+#include "CommandPool.h"
 #include <vector>
 #include <array>
+#include <chrono>
 
 class Swapchain; // forward
+class PipelineStatistics; // forward
+class OverdrawTarget; // forward
+class ParallelRecorder; // forward
+class CommandCache; // forward
+class GpuScene; // forward
+class GpuCulling; // forward
+class PersistentBuffer; // forward
+class FrameAllocator; // forward
+class DeletionQueue; // forward
+class ShaderWatcher; // forward
+
+// Optional renderer features, selected on the command line (see VulkanApp::run).
+struct RenderOptions {
+    // Wrap the scene draw in a pipeline statistics query and print the counters
+    bool pipelineStatistics = false;
+    // Replace the lit scene with a per-pixel fragment count heat map
+    bool overdraw = false;
+    // Record the scene draws into secondary command buffers on this many
+    // worker threads (0 records everything on the main thread). The overdraw
+    // passes are always recorded on the main thread.
+    uint32_t recordingThreads = 0;
+    // Print the compiled render graph schedule whenever it is (re)compiled
+    bool dumpRenderGraph = false;
+    // Rebuild the shader data from the newest input right before submit
+    bool lateLatch = false;
+    // Print the time from sampling input to submitting the frame
+    bool reportInputLatency = false;
+    // Print the scene setup, GPU culling counts, stress scene frame times,
+    // picked objects and shader reload notices (--verbose)
+    bool verbose = false;
+    // Reuse pre-recorded command buffers per (swapchain image, frame slot)
+    // and only re-record when the swapchain or the scene structure changes
+    bool cachedCommands = false;
+    // Replace the three object scene with a columns x rows grid (--grid NxM)
+    uint32_t gridColumns = 0;
+    uint32_t gridRows = 0;
+    // Cull the scene in a compute pass and draw the survivors (--gpu-cull).
+    // Scene draws are recorded on the main thread in this mode.
+    bool gpuCulling = false;
+    // Also cull against a depth pyramid of the previous frame (off with --no-hiz)
+    bool occlusionCulling = true;
+    // Frustum cull the scene on the CPU and draw the visible objects one by
+    // one (--cpu-cull, also the fallback when GPU culling isn't available)
+    bool cpuCulling = false;
+    // Use the object BVH for CPU culling instead of the linear SIMD loop (--bvh-cull)
+    bool bvhCulling = false;
+    // Keep shader data and scene objects in device-local memory, updated by
+    // copies from a staging ring (--device-local-scene). Without it they are
+    // written straight into host-visible memory.
+    bool deviceLocalScene = false;
+    // Rebuild the pipelines whose Slang sources change on disk while running
+    // (off with --no-hot-reload)
+    bool shaderHotReload = true;
+};
 
 // A compact context object that collects the runtime objects the renderer
 // needs. Passing this single struct simplifies the renderer signature and
@@ -22,18 +85,45 @@ struct RenderContext {
     VkQueue queue = VK_NULL_HANDLE;
     VmaAllocator allocator = VK_NULL_HANDLE;
     Swapchain* swapchain = nullptr;
-    VkPipeline pipeline = VK_NULL_HANDLE;
     VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
     VkDescriptorSet descriptorSetTex = VK_NULL_HANDLE;
     VkBuffer vBuffer = VK_NULL_HANDLE;
     VkDeviceSize vBufSize = 0;
     VkDeviceSize indexCount = 0;
-    std::array<ShaderDataBuffer, VulkanApp::maxFramesInFlight>* shaderDataBuffers = nullptr;
+    PersistentBuffer* shaderDataBuffer = nullptr;
+    // Transient per-frame data (culling parameters etc.)
+    FrameAllocator* frameAllocator = nullptr;
+    // Resources replaced while frames are in flight are destroyed through this
+    DeletionQueue* deletionQueue = nullptr;
     std::array<VkCommandBuffer, VulkanApp::maxFramesInFlight>* commandBuffers = nullptr;
     std::array<VkFence, VulkanApp::maxFramesInFlight>* fences = nullptr;
     std::array<VkSemaphore, VulkanApp::maxFramesInFlight>* presentSemaphores = nullptr;
+    // One per swapchain image, replaced whenever the swapchain is recreated
     std::vector<VkSemaphore>* renderSemaphores = nullptr;
     VkSurfaceCapabilitiesKHR* surfaceCaps = nullptr;
+    GpuScene* scene = nullptr;
+    // Object space bounding sphere of the mesh (center, radius)
+    glm::vec4 meshBounds{ 0.0f, 0.0f, 0.0f, 1.0f };
+    RenderOptions options{};
+    // Only set when the matching option is enabled
+    PipelineStatistics* pipelineStats = nullptr;
+    OverdrawTarget* overdraw = nullptr;
+    ParallelRecorder* recorder = nullptr;
+    CommandCache* commandCache = nullptr;
+    GpuCulling* culling = nullptr;
+    ShaderWatcher* shaderWatcher = nullptr;
+    // Owns the graphics pipelines, bound through it so their dynamic state
+    // is set. Pipelines other than the scene pipeline are built in the
+    // background, the passes using them skip their draws until they are ready.
+    PipelineCompiler* pipelineCompiler = nullptr;
+    PipelineHandle scenePipeline = invalidPipelineHandle;
+    // Description and shader variant of scenePipeline. V switches to the
+    // next variant, its pipeline is built in the background and swapped in
+    // once ready.
+    PipelineDesc sceneDesc{};
+    SceneShaderVariant sceneVariant{};
+    PipelineHandle overdrawPipeline = invalidPipelineHandle;
+    PipelineHandle overdrawResolvePipeline = invalidPipelineHandle;
 };
 
 class Renderer {
@@ -44,4 +134,110 @@ public:
     // returns when the window is closed; it does not own the resources in
     // the context (ownership remains with the caller).
     int run(const RenderContext& ctx);
+
+private:
+    // Setup, once per run()
+    void buildScene();
+    void buildGraph();
+    // (Re)compile for the current render area; transient images depend on it
+    void compileGraph();
+
+    // Per frame updates
+    void handleEvent(const sf::Event& event);
+    void applyInput(const InputSample& input);
+    void updateCamera();
+    void updateShaderData();
+    void updateBounds(uint32_t object, const glm::mat4& transform);
+    void cullObjects();
+    // Hot reload and variant switches, between frames
+    void updatePipelines();
+    void pickObject(sf::Vector2i position);
+    void reportFrameTime();
+    void reportInputLatency(const InputSample& input);
+
+    // Render graph passes
+    void recordScenePass(VkCommandBuffer cb);
+    void recordOverdrawCountPass(VkCommandBuffer cb);
+    void recordOverdrawResolvePass(VkCommandBuffer cb);
+    // Scene draws of the main thread, all objects or the visible ones
+    void drawScene(VkCommandBuffer cb);
+    // Initial layout of a new depth image, see run()
+    void recordDepthInit(VkCommandBuffer cb);
+
+    // Viewport and scissor covering the window, shared by all passes
+    VkViewport getViewport() const;
+    VkRect2D getScissor() const;
+
+    // Status output, only printed with RenderOptions::verbose
+    template <typename... Args>
+    void log(const Args&... args) const;
+
+    const RenderContext* ctx_{ nullptr };
+    // Optional features, only set when the matching option is enabled
+    PipelineStatistics* pipelineStats_{ nullptr };
+    OverdrawTarget* overdraw_{ nullptr };
+    ParallelRecorder* recorder_{ nullptr };
+    CommandCache* commandCache_{ nullptr };
+    GpuCulling* culling_{ nullptr };
+    ShaderWatcher* shaderWatcher_{ nullptr };
+    bool occlusionCulling_{ false };
+    bool cullOnCpu_{ false };
+
+    uint32_t imageIndex_{ 0 };
+    uint32_t frameIndex_{ 0 };
+    sf::Clock clock_;
+    sf::Time elapsed_{};
+    ShaderData shaderData_{};
+    glm::vec3 camPos_{ 0.0f, 0.0f, -6.0f };
+
+    // Scene shader variant in use, and the one being built (see RenderContext)
+    PipelineHandle scenePipeline_{ invalidPipelineHandle };
+    SceneShaderVariant sceneVariant_{};
+    PipelineHandle pendingScenePipeline_{ invalidPipelineHandle };
+    SceneShaderVariant pendingSceneVariant_{};
+    uint32_t finishedPipelines_{ 0 };
+
+    // Bumped whenever the recorded commands of a frame would change for the
+    // same swapchain image (draw list, render graph resources)
+    uint32_t sceneVersion_{ 0 };
+    uint32_t frameAllocatorVersion_{ 0 };
+    uint32_t sceneBuffersVersion_{ 0 };
+
+    // Object transforms; only objects that moved are pushed to the scene each frame
+    TransformStore transforms_;
+    std::vector<glm::vec3> objectSpins_;
+    uint32_t objectCount_{ 0 };
+    bool stressGrid_{ false };
+    // World space bounds, for CPU culling and the BVH
+    std::vector<glm::vec4> worldSpheres_;
+    CpuCulling cpuCulling_;
+    std::vector<uint32_t> visibleObjects_;
+    Bvh bvh_;
+    // Draws for the recording threads, see buildScene()
+    std::vector<DrawItem> drawList_;
+
+    RenderGraph graph_;
+    RGResource backbuffer_{ invalidRGResource };
+    RGResource depthTarget_{ invalidRGResource };
+    RGResource depthPyramid_{ invalidRGResource };
+    RGResource culledDraws_{ invalidRGResource };
+    RGResource culledCount_{ invalidRGResource };
+    RGResource overdrawCounts_{ invalidRGResource };
+
+    // Depth transitions for occlusion culling, one command buffer per frame slot
+    CommandPool setupPool_;
+    std::vector<VkCommandBuffer> setupCbs_;
+
+    InputSampler inputSampler_;
+
+    // CPU frame time, reported once per second for the stress scene
+    sf::Time frameTimeSum_{};
+    uint32_t frameTimeFrames_{ 0 };
+    std::chrono::steady_clock::duration cullTimeSum_{};
+    VkDeviceSize uploadSizeSum_{ 0 };
+    // Time from reading the input a frame is based on to handing the frame to the queue
+    std::chrono::steady_clock::duration inputLatencySum_{};
+    std::chrono::steady_clock::duration inputLatencyMax_{};
+    uint32_t inputLatencyFrames_{ 0 };
+    sf::Clock inputLatencyClock_;
 };
@@ -0,0 +1,488 @@
+// ShaderCompiler.cpp
+#include "ShaderCompiler.h"
+#include "Hash.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+// Bump when the layout of the cache files changes
+constexpr uint32_t cacheVersion = 3;
+
+std::string toHex(uint64_t value)
+{
+	std::ostringstream stream;
+	stream << std::hex;
+	stream.width(16);
+	stream.fill('0');
+	stream << value;
+	return stream.str();
+}
+
+// Unique per call, so workers writing the same entry don't share a temporary file
+std::string temporarySuffix()
+{
+	static std::atomic<uint64_t> counter{ 0 };
+	const uint64_t threadId = std::hash<std::thread::id>{}(std::this_thread::get_id());
+	return "." + toHex(threadId) + "." + std::to_string(counter.fetch_add(1, std::memory_order_relaxed)) + ".tmp";
+}
+
+bool readFile(const std::string& path, std::string& contents)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+	contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return true;
+}
+
+VkShaderStageFlags toStageFlags(SlangStage stage)
+{
+	switch (stage) {
+	case SLANG_STAGE_VERTEX: return VK_SHADER_STAGE_VERTEX_BIT;
+	case SLANG_STAGE_FRAGMENT: return VK_SHADER_STAGE_FRAGMENT_BIT;
+	case SLANG_STAGE_COMPUTE: return VK_SHADER_STAGE_COMPUTE_BIT;
+	default: return 0;
+	}
+}
+
+bool toDescriptorType(slang::BindingType type, VkDescriptorType& out)
+{
+	switch (type) {
+	case slang::BindingType::CombinedTextureSampler: out = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER; return true;
+	case slang::BindingType::Texture: out = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE; return true;
+	case slang::BindingType::MutableTexture: out = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE; return true;
+	case slang::BindingType::Sampler: out = VK_DESCRIPTOR_TYPE_SAMPLER; return true;
+	case slang::BindingType::ConstantBuffer: out = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER; return true;
+	case slang::BindingType::RawBuffer:
+	case slang::BindingType::MutableRawBuffer:
+	case slang::BindingType::TypedBuffer:
+	case slang::BindingType::MutableTypedBuffer: out = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER; return true;
+	default: return false;
+	}
+}
+
+// 32 bit scalars and vectors, the only attribute types the shaders use
+bool toVertexFormat(slang::TypeReflection* type, VkFormat& format, uint32_t& size)
+{
+	const uint32_t components = type->getKind() == slang::TypeReflection::Kind::Vector ? static_cast<uint32_t>(type->getElementCount()) : 1;
+	if (components < 1 || components > 4) {
+		return false;
+	}
+	static const VkFormat floatFormats[] = { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+	static const VkFormat intFormats[] = { VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+	static const VkFormat uintFormats[] = { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+	switch (type->getScalarType()) {
+	case slang::TypeReflection::ScalarType::Float32: format = floatFormats[components - 1]; break;
+	case slang::TypeReflection::ScalarType::Int32: format = intFormats[components - 1]; break;
+	case slang::TypeReflection::ScalarType::UInt32: format = uintFormats[components - 1]; break;
+	default: return false;
+	}
+	size = components * 4;
+	return true;
+}
+
+// System values (SV_VulkanInstanceID etc.) are varying inputs to Slang, but
+// not vertex attributes
+bool isSystemValue(slang::VariableLayoutReflection* variable)
+{
+	const char* semantic = variable->getSemanticName();
+	return semantic && std::toupper(semantic[0]) == 'S' && std::toupper(semantic[1]) == 'V' && semantic[2] == '_';
+}
+
+} // namespace
+
+bool ShaderCompiler::create(const std::string& cacheDirectory, bool readCache)
+{
+	cacheDirectory_ = cacheDirectory;
+	readCache_ = readCache;
+	if (!cacheDirectory_.empty()) {
+		std::error_code error;
+		std::filesystem::create_directories(cacheDirectory_, error);
+		if (error) {
+			std::cerr << "Can't create shader cache directory " << cacheDirectory_ << ": " << error.message() << ", caching disabled\n";
+			cacheDirectory_.clear();
+		}
+	}
+	return true;
+}
+
+void ShaderCompiler::destroy()
+{
+	session_ = nullptr;
+	globalSession_ = nullptr;
+	irModules_.clear();
+}
+
+void ShaderCompiler::reloadModules()
+{
+	// Loaded modules belong to the session, the global session is kept
+	session_ = nullptr;
+	irModules_.clear();
+}
+
+bool ShaderCompiler::createSession()
+{
+	if (session_) {
+		return true;
+	}
+	if (!globalSession_ && SLANG_FAILED(slang::createGlobalSession(globalSession_.writeRef()))) {
+		std::cerr << "Failed to create the Slang global session\n";
+		return false;
+	}
+	// Keep in sync with the options hashed in configurationHash()
+	auto targets{ std::to_array<slang::TargetDesc>({ {.format{SLANG_SPIRV}, .profile{globalSession_->findProfile(profile)} } }) };
+	auto options{ std::to_array<slang::CompilerOptionEntry>({ { slang::CompilerOptionName::EmitSpirvDirectly, {slang::CompilerOptionValueKind::Int, 1} } }) };
+	slang::SessionDesc sessionDesc{ .targets{targets.data()}, .targetCount{SlangInt(targets.size())}, .defaultMatrixLayoutMode = SLANG_MATRIX_LAYOUT_COLUMN_MAJOR, .compilerOptionEntries{options.data()}, .compilerOptionEntryCount{uint32_t(options.size())} };
+	if (SLANG_FAILED(globalSession_->createSession(sessionDesc, session_.writeRef()))) {
+		std::cerr << "Failed to create a Slang session\n";
+		return false;
+	}
+	return true;
+}
+
+uint64_t ShaderCompiler::configurationHash() const
+{
+	// Keep in sync with the options in createSession()
+	uint64_t hash = hashBytes(hashSeed, &cacheVersion, sizeof(cacheVersion));
+	hash = hashString(hash, spGetBuildTagString());
+	hash = hashString(hash, profile);
+	return hashString(hash, "EmitSpirvDirectly=1;matrixLayout=column");
+}
+
+std::string ShaderCompiler::modulePath(const std::string& sourcePath) const
+{
+	return cacheDirectory_ + "/" + toHex(hashString(configurationHash(), sourcePath)) + ".slang-module";
+}
+
+slang::IModule* ShaderCompiler::findLoadedModule(const char* moduleName) const
+{
+	for (SlangInt i = 0; i < session_->getLoadedModuleCount(); i++) {
+		slang::IModule* module = session_->getLoadedModule(i);
+		if (strcmp(module->getName(), moduleName) == 0) {
+			return module;
+		}
+	}
+	return nullptr;
+}
+
+slang::IModule* ShaderCompiler::loadModule(const char* moduleName, const std::string& path, const std::string& manifestPath)
+{
+	// Loaded by an earlier compile, sources haven't changed since (see reloadModules)
+	if (slang::IModule* module = findLoadedModule(moduleName)) {
+		return module;
+	}
+	Slang::ComPtr<slang::IBlob> diagnostics;
+	if (!cacheDirectory_.empty() && readCache_) {
+		// Modules the last compile loaded, imports before the modules importing
+		// them, so the imports resolve to the already loaded IR. Stale or
+		// missing IR leaves a module to be compiled from source.
+		std::ifstream manifest(manifestPath);
+		for (std::string name, file; std::getline(manifest, name, '\t') && std::getline(manifest, file);) {
+			std::string ir;
+			if (findLoadedModule(name.c_str()) || !readFile(modulePath(file), ir)) {
+				continue;
+			}
+			Slang::ComPtr<slang::IBlob> blob{ slang_createBlob(ir.data(), ir.size()) };
+			if (!session_->isBinaryModuleUpToDate(file.c_str(), blob)) {
+				continue;
+			}
+			if (session_->loadModuleFromIRBlob(name.c_str(), file.c_str(), blob, diagnostics.writeRef())) {
+				irModules_.insert(file);
+			}
+		}
+		if (slang::IModule* module = findLoadedModule(moduleName)) {
+			return module;
+		}
+	}
+
+	slang::IModule* module = session_->loadModuleFromSource(moduleName, path.c_str(), nullptr, diagnostics.writeRef());
+	if (diagnostics) {
+		std::cerr << static_cast<const char*>(diagnostics->getBufferPointer());
+	}
+	if (!module || cacheDirectory_.empty()) {
+		return module;
+	}
+	// Store the IR of every module parsed from source for the next compile,
+	// which then only links and generates code
+	std::string manifest;
+	for (SlangInt i = 0; i < session_->getLoadedModuleCount(); i++) {
+		slang::IModule* loaded = session_->getLoadedModule(i);
+		const char* file = loaded->getFilePath();
+		if (!file || !*file) {
+			continue;
+		}
+		manifest += std::string(loaded->getName()) + "\t" + file + "\n";
+		Slang::ComPtr<slang::IBlob> ir;
+		if (irModules_.contains(file) || SLANG_FAILED(loaded->serialize(ir.writeRef()))) {
+			continue;
+		}
+		if (writeFile(modulePath(file), ir->getBufferPointer(), ir->getBufferSize())) {
+			irModules_.insert(file);
+		}
+	}
+	if (!writeFile(manifestPath, manifest.data(), manifest.size())) {
+		std::cerr << "Failed to store the modules of " << path << " in the shader cache\n";
+	}
+	return module;
+}
+
+std::string ShaderCompiler::contentKey(uint64_t baseHash, const std::vector<std::string>& dependencies) const
+{
+	uint64_t hash = baseHash;
+	std::string contents;
+	for (const auto& dependency : dependencies) {
+		if (!readFile(dependency, contents)) {
+			return {};
+		}
+		hash = hashString(hash, dependency);
+		hash = hashBytes(hash, contents.data(), contents.size());
+	}
+	return toHex(hash);
+}
+
+bool ShaderCompiler::writeFile(const std::string& path, const void* data, size_t size) const
+{
+	// Readers never see a partially written entry
+	const std::string temporaryPath = path + temporarySuffix();
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+		if (!file) {
+			return false;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(temporaryPath, path, error);
+	if (error) {
+		std::filesystem::remove(temporaryPath, error);
+		return false;
+	}
+	return true;
+}
+
+bool ShaderCompiler::reflect(slang::IModule* module, ShaderInterface& out)
+{
+	// The module alone only lays out its global parameters, entry point
+	// parameters (push constants, vertex inputs) need a program with all
+	// entry points
+	std::vector<Slang::ComPtr<slang::IEntryPoint>> entryPoints(module->getDefinedEntryPointCount());
+	std::vector<slang::IComponentType*> components{ module };
+	for (int32_t i = 0; i < module->getDefinedEntryPointCount(); i++) {
+		if (SLANG_FAILED(module->getDefinedEntryPoint(i, entryPoints[i].writeRef()))) {
+			return false;
+		}
+		components.push_back(entryPoints[i]);
+	}
+	Slang::ComPtr<slang::IComponentType> program;
+	Slang::ComPtr<slang::IBlob> diagnostics;
+	if (SLANG_FAILED(session_->createCompositeComponentType(components.data(), SlangInt(components.size()), program.writeRef(), diagnostics.writeRef()))) {
+		return false;
+	}
+	slang::ProgramLayout* layout = program->getLayout(0, diagnostics.writeRef());
+	if (!layout) {
+		return false;
+	}
+
+	out = {};
+	VkShaderStageFlags moduleStages{ 0 };
+	for (unsigned i = 0; i < layout->getEntryPointCount(); i++) {
+		moduleStages |= toStageFlags(layout->getEntryPointByIndex(i)->getStage());
+	}
+
+	// Global resources. Which entry points use which resource isn't tracked,
+	// they are visible to all stages of the module.
+	for (unsigned i = 0; i < layout->getParameterCount(); i++) {
+		slang::VariableLayoutReflection* parameter = layout->getParameterByIndex(i);
+		if (parameter->getCategory() != slang::ParameterCategory::DescriptorTableSlot) {
+			continue;
+		}
+		slang::TypeLayoutReflection* typeLayout = parameter->getTypeLayout();
+		ShaderBinding binding{ .set = parameter->getBindingSpace(), .binding = parameter->getBindingIndex(), .stages = moduleStages };
+		if (typeLayout->getKind() == slang::TypeReflection::Kind::Array) {
+			const size_t elements = typeLayout->getElementCount();
+			binding.count = (elements == 0 || elements == SLANG_UNBOUNDED_SIZE) ? 0 : static_cast<uint32_t>(elements);
+			typeLayout = typeLayout->getElementTypeLayout();
+		}
+		if (typeLayout->getBindingRangeCount() < 1 || !toDescriptorType(typeLayout->getBindingRangeType(0), binding.type)) {
+			std::cerr << "Unsupported resource type of shader parameter " << parameter->getName() << "\n";
+			return false;
+		}
+		out.bindings.push_back(binding);
+	}
+	std::sort(out.bindings.begin(), out.bindings.end(), [](const ShaderBinding& a, const ShaderBinding& b) {
+		return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+	});
+
+	for (unsigned i = 0; i < layout->getEntryPointCount(); i++) {
+		slang::EntryPointReflection* entryPoint = layout->getEntryPointByIndex(i);
+		const VkShaderStageFlags stage = toStageFlags(entryPoint->getStage());
+		// Uniform entry point parameters are push constants on Vulkan
+		uint32_t pushBegin{ UINT32_MAX };
+		uint32_t pushEnd{ 0 };
+		// Vertex attributes as (location, format, size)
+		struct Attribute { uint32_t location; VkFormat format; uint32_t size; };
+		std::vector<Attribute> attributes;
+		for (unsigned j = 0; j < entryPoint->getParameterCount(); j++) {
+			slang::VariableLayoutReflection* parameter = entryPoint->getParameterByIndex(j);
+			slang::TypeLayoutReflection* typeLayout = parameter->getTypeLayout();
+			const size_t uniformSize = typeLayout->getSize(slang::ParameterCategory::Uniform);
+			if (uniformSize > 0) {
+				const uint32_t offset = static_cast<uint32_t>(parameter->getOffset(slang::ParameterCategory::Uniform));
+				pushBegin = std::min(pushBegin, offset);
+				pushEnd = std::max(pushEnd, offset + static_cast<uint32_t>(uniformSize));
+			}
+			if (stage != VK_SHADER_STAGE_VERTEX_BIT || isSystemValue(parameter) || typeLayout->getSize(slang::ParameterCategory::VaryingInput) == 0) {
+				continue;
+			}
+			// Either a struct of attributes or a single attribute
+			std::vector<slang::VariableLayoutReflection*> inputs;
+			if (typeLayout->getKind() == slang::TypeReflection::Kind::Struct) {
+				for (unsigned k = 0; k < typeLayout->getFieldCount(); k++) {
+					inputs.push_back(typeLayout->getFieldByIndex(k));
+				}
+			} else {
+				inputs.push_back(parameter);
+			}
+			const uint32_t baseLocation = static_cast<uint32_t>(parameter->getOffset(slang::ParameterCategory::VaryingInput));
+			for (slang::VariableLayoutReflection* input : inputs) {
+				if (isSystemValue(input)) {
+					continue;
+				}
+				Attribute attribute{ .location = baseLocation };
+				if (input != parameter) {
+					attribute.location += static_cast<uint32_t>(input->getOffset(slang::ParameterCategory::VaryingInput));
+				}
+				if (!toVertexFormat(input->getTypeLayout()->getType(), attribute.format, attribute.size)) {
+					std::cerr << "Unsupported vertex attribute type of " << input->getName() << " in " << entryPoint->getName() << "\n";
+					return false;
+				}
+				attributes.push_back(attribute);
+			}
+		}
+		if (pushEnd > 0) {
+			// A stage may only appear in one range, entry points of the same stage share it
+			auto range = std::find_if(out.pushConstants.begin(), out.pushConstants.end(), [stage](const VkPushConstantRange& r) { return r.stageFlags == stage; });
+			if (range == out.pushConstants.end()) {
+				out.pushConstants.push_back({ .stageFlags = stage, .offset = pushBegin, .size = pushEnd - pushBegin });
+			} else {
+				const uint32_t end = std::max(range->offset + range->size, pushEnd);
+				range->offset = std::min(range->offset, pushBegin);
+				range->size = end - range->offset;
+			}
+		}
+		if (!attributes.empty()) {
+			std::sort(attributes.begin(), attributes.end(), [](const Attribute& a, const Attribute& b) { return a.location < b.location; });
+			ShaderVertexInput vertexInput{ .entryPoint = entryPoint->getName() };
+			for (const auto& attribute : attributes) {
+				vertexInput.attributes.push_back({ .location = attribute.location, .binding = 0, .format = attribute.format, .offset = vertexInput.stride });
+				vertexInput.stride += attribute.size;
+			}
+			out.vertexInputs.push_back(vertexInput);
+		}
+	}
+	// Stages pushing the same range share one entry, sorted so equal
+	// interfaces produce equal layout keys
+	std::vector<VkPushConstantRange> ranges;
+	for (const auto& range : out.pushConstants) {
+		auto same = std::find_if(ranges.begin(), ranges.end(), [&range](const VkPushConstantRange& r) { return r.offset == range.offset && r.size == range.size; });
+		if (same == ranges.end()) {
+			ranges.push_back(range);
+		} else {
+			same->stageFlags |= range.stageFlags;
+		}
+	}
+	std::sort(ranges.begin(), ranges.end(), [](const VkPushConstantRange& a, const VkPushConstantRange& b) {
+		return a.offset != b.offset ? a.offset < b.offset : a.size < b.size;
+	});
+	out.pushConstants = std::move(ranges);
+	return true;
+}
+
+bool ShaderCompiler::compile(const char* moduleName, const std::string& path, std::vector<uint32_t>& spirv, ShaderInterface* shaderInterface)
+{
+	// Path and compiler configuration select the dependency list, the file
+	// contents then select the SPIR-V
+	uint64_t baseHash = hashString(configurationHash(), moduleName);
+	baseHash = hashString(baseHash, path);
+	const std::string dependencyPath = cacheDirectory_ + "/" + toHex(baseHash) + ".deps";
+
+	if (!cacheDirectory_.empty() && readCache_) {
+		std::ifstream dependencyFile(dependencyPath);
+		std::vector<std::string> dependencies;
+		for (std::string line; std::getline(dependencyFile, line);) {
+			dependencies.push_back(line);
+		}
+		const std::string key = dependencies.empty() ? std::string() : contentKey(baseHash, dependencies);
+		std::string code;
+		std::string interfaceText;
+		if (!key.empty() && readFile(cacheDirectory_ + "/" + key + ".spv", code) && !code.empty() && code.size() % sizeof(uint32_t) == 0 &&
+			(!shaderInterface || (readFile(cacheDirectory_ + "/" + key + ".interface", interfaceText) && ShaderInterface::deserialize(interfaceText, *shaderInterface)))) {
+			spirv.resize(code.size() / sizeof(uint32_t));
+			memcpy(spirv.data(), code.data(), code.size());
+			dependencies_ = std::move(dependencies);
+			cacheHits_++;
+			return true;
+		}
+	}
+
+	if (!createSession()) {
+		return false;
+	}
+	Slang::ComPtr<slang::IBlob> diagnostics;
+	const std::string manifestPath = cacheDirectory_ + "/" + toHex(baseHash) + ".modules";
+	slang::IModule* module = loadModule(moduleName, path, manifestPath);
+	Slang::ComPtr<ISlangBlob> code;
+	if (!module || SLANG_FAILED(module->getTargetCode(0, code.writeRef(), diagnostics.writeRef()))) {
+		if (diagnostics) {
+			std::cerr << static_cast<const char*>(diagnostics->getBufferPointer());
+		}
+		return false;
+	}
+	spirv.resize(code->getBufferSize() / sizeof(uint32_t));
+	memcpy(spirv.data(), code->getBufferPointer(), spirv.size() * sizeof(uint32_t));
+	// Always reflected, so the cache entry serves callers with and without interest in it
+	ShaderInterface reflected;
+	if (!reflect(module, reflected)) {
+		std::cerr << "Failed to reflect the interface of " << path << "\n";
+		return false;
+	}
+	if (shaderInterface) {
+		*shaderInterface = reflected;
+	}
+	compiled_++;
+
+	// The module's own file is among its dependencies
+	dependencies_.clear();
+	for (int32_t i = 0; i < module->getDependencyFileCount(); i++) {
+		dependencies_.push_back(module->getDependencyFilePath(i));
+	}
+	if (dependencies_.empty()) {
+		dependencies_.push_back(path);
+	}
+	if (!cacheDirectory_.empty()) {
+		const std::string key = contentKey(baseHash, dependencies_);
+		std::string dependencyList;
+		for (const auto& dependency : dependencies_) {
+			dependencyList += dependency + "\n";
+		}
+		const std::string interfaceText = reflected.serialize();
+		if (key.empty() || !writeFile(cacheDirectory_ + "/" + key + ".spv", code->getBufferPointer(), code->getBufferSize()) ||
+			!writeFile(cacheDirectory_ + "/" + key + ".interface", interfaceText.data(), interfaceText.size()) ||
+			!writeFile(dependencyPath, dependencyList.data(), dependencyList.size())) {
+			std::cerr << "Failed to store " << path << " in the shader cache\n";
+		}
+	}
+	return true;
+}
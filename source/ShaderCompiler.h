@@ -0,0 +1,80 @@
+// ShaderCompiler.h
+#pragma once
+
+#include "slang/slang-com-ptr.h"
+#include "slang/slang.h"
+#include "ShaderInterface.h"
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Compiles Slang modules to SPIR-V, with a content-addressed cache on disk.
+//
+// A lookup first hashes the module path together with everything that
+// affects code generation (compiler build, target profile, options) and reads
+// the list of files the module depended on when it was last compiled. The
+// contents of all of them are hashed into the key of the SPIR-V file, so
+// editing the module or any file it imports is a miss, and a hit never needs
+// a Slang session. The global session and session are only created for the
+// first miss. The reflected resource interface (ShaderInterface) is stored
+// next to the SPIR-V, so hits return it as well.
+//
+// A miss doesn't necessarily parse everything again: the Slang IR of every
+// module compiled from source, imports included, is serialized into the cache
+// (.slang-module) and loaded instead of the source as long as Slang considers
+// it up to date, so a miss caused by one edited file only parses that file,
+// then links and generates code. The global session lives as long as the
+// compiler (it is expensive to create and, like sessions, not thread safe,
+// so there is one per compiling thread); the session is recreated when
+// sources change (reloadModules).
+class ShaderCompiler {
+public:
+    ShaderCompiler() = default;
+    ~ShaderCompiler() = default;
+
+    // An empty cacheDirectory disables the cache. With readCache false results
+    // are compiled and stored, but existing entries are ignored (cold start).
+    bool create(const std::string& cacheDirectory, bool readCache = true);
+    void destroy();
+
+    // SPIR-V of all entry points of the module at path, and optionally its
+    // descriptors, push constants and vertex inputs
+    bool compile(const char* moduleName, const std::string& path, std::vector<uint32_t>& spirv, ShaderInterface* shaderInterface = nullptr);
+
+    // Files the last compiled module was built from, the module's own file included
+    const std::vector<std::string>& getDependencies() const { return dependencies_; }
+    // Forget the modules loaded so far, the next compile reads every source
+    // file again (the session keeps imported modules loaded otherwise)
+    void reloadModules();
+
+    uint32_t getCacheHits() const { return cacheHits_; }
+    uint32_t getCompiledCount() const { return compiled_; }
+
+private:
+    bool createSession();
+    uint64_t configurationHash() const;
+    // Cache file holding the IR of the module at sourcePath
+    std::string modulePath(const std::string& sourcePath) const;
+    slang::IModule* findLoadedModule(const char* moduleName) const;
+    // Load the module and its imports into the session, from cached IR where
+    // it is up to date. manifestPath lists the modules of the last compile.
+    slang::IModule* loadModule(const char* moduleName, const std::string& path, const std::string& manifestPath);
+    bool reflect(slang::IModule* module, ShaderInterface& out);
+    // Key of the SPIR-V for the given dependencies, empty if one can't be read
+    std::string contentKey(uint64_t baseHash, const std::vector<std::string>& dependencies) const;
+    bool writeFile(const std::string& path, const void* data, size_t size) const;
+
+    // Everything that changes the generated code besides the sources
+    static constexpr const char* profile = "spirv_1_4";
+
+    Slang::ComPtr<slang::IGlobalSession> globalSession_;
+    Slang::ComPtr<slang::ISession> session_;
+    std::string cacheDirectory_;
+    bool readCache_{ true };
+    std::vector<std::string> dependencies_;
+    // Source paths of the session's modules whose IR is in the cache
+    std::unordered_set<std::string> irModules_;
+    uint32_t cacheHits_{ 0 };
+    uint32_t compiled_{ 0 };
+};
@@ -0,0 +1,96 @@
+// ShaderInterface.cpp
+#include "ShaderInterface.h"
+
+#include <algorithm>
+#include <sstream>
+
+uint32_t ShaderInterface::getSetCount() const
+{
+	uint32_t count{ 0 };
+	for (const auto& binding : bindings) {
+		count = std::max(count, binding.set + 1);
+	}
+	return count;
+}
+
+std::vector<ShaderBinding> ShaderInterface::getSetBindings(uint32_t set) const
+{
+	std::vector<ShaderBinding> result;
+	for (const auto& binding : bindings) {
+		if (binding.set == set) {
+			result.push_back(binding);
+		}
+	}
+	return result;
+}
+
+const ShaderVertexInput* ShaderInterface::getVertexInput(const std::string& entryPoint) const
+{
+	for (const auto& input : vertexInputs) {
+		if (input.entryPoint == entryPoint) {
+			return &input;
+		}
+	}
+	return nullptr;
+}
+
+// One record per line, the first word names the record:
+//   binding <set> <binding> <type> <count> <stages>
+//   push <stages> <offset> <size>
+//   vertex <entry point> <stride>
+//   attribute <location> <format> <offset>   (belongs to the last vertex record)
+std::string ShaderInterface::serialize() const
+{
+	std::ostringstream stream;
+	for (const auto& binding : bindings) {
+		stream << "binding " << binding.set << " " << binding.binding << " " << binding.type << " " << binding.count << " " << binding.stages << "\n";
+	}
+	for (const auto& range : pushConstants) {
+		stream << "push " << range.stageFlags << " " << range.offset << " " << range.size << "\n";
+	}
+	for (const auto& input : vertexInputs) {
+		stream << "vertex " << input.entryPoint << " " << input.stride << "\n";
+		for (const auto& attribute : input.attributes) {
+			stream << "attribute " << attribute.location << " " << attribute.format << " " << attribute.offset << "\n";
+		}
+	}
+	return stream.str();
+}
+
+bool ShaderInterface::deserialize(const std::string& text, ShaderInterface& out)
+{
+	out = {};
+	std::istringstream stream(text);
+	for (std::string line; std::getline(stream, line);) {
+		std::istringstream record(line);
+		std::string kind;
+		record >> kind;
+		if (kind == "binding") {
+			ShaderBinding binding{};
+			uint32_t type{ 0 };
+			record >> binding.set >> binding.binding >> type >> binding.count >> binding.stages;
+			binding.type = static_cast<VkDescriptorType>(type);
+			out.bindings.push_back(binding);
+		} else if (kind == "push") {
+			VkPushConstantRange range{};
+			record >> range.stageFlags >> range.offset >> range.size;
+			out.pushConstants.push_back(range);
+		} else if (kind == "vertex") {
+			ShaderVertexInput input{};
+			record >> input.entryPoint >> input.stride;
+			out.vertexInputs.push_back(input);
+		} else if (kind == "attribute" && !out.vertexInputs.empty()) {
+			VkVertexInputAttributeDescription attribute{};
+			uint32_t format{ 0 };
+			record >> attribute.location >> format >> attribute.offset;
+			attribute.format = static_cast<VkFormat>(format);
+			out.vertexInputs.back().attributes.push_back(attribute);
+		} else {
+			return false;
+		}
+		if (record.fail()) {
+			return false;
+		}
+	}
+	return true;
+}
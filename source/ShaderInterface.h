@@ -0,0 +1,48 @@
+// ShaderInterface.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A descriptor the shaders declare
+struct ShaderBinding {
+    uint32_t set{ 0 };
+    uint32_t binding{ 0 };
+    VkDescriptorType type{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER };
+    // 0 for unbounded (runtime sized) arrays
+    uint32_t count{ 1 };
+    VkShaderStageFlags stages{ 0 };
+};
+
+// Vertex attributes read by a vertex entry point. Reflection only knows the
+// locations and types, the offsets assume the attributes are packed in
+// location order, which callers check against their vertex struct.
+struct ShaderVertexInput {
+    std::string entryPoint;
+    uint32_t stride{ 0 };
+    std::vector<VkVertexInputAttributeDescription> attributes;
+};
+
+// Resource interface of a Slang module as reported by reflection
+// (ShaderCompiler::compile), everything needed to build descriptor set
+// layouts, push constant ranges and vertex input state without restating
+// them on the C++ side. Plain data so the shader cache can store it next to
+// the SPIR-V (serialize/deserialize).
+struct ShaderInterface {
+    // Sorted by set and binding
+    std::vector<ShaderBinding> bindings;
+    // One range per stage that has uniform entry point parameters
+    std::vector<VkPushConstantRange> pushConstants;
+    std::vector<ShaderVertexInput> vertexInputs;
+
+    // Number of descriptor sets, including empty ones below the highest used set
+    uint32_t getSetCount() const;
+    std::vector<ShaderBinding> getSetBindings(uint32_t set) const;
+    // nullptr if the entry point doesn't exist or reads no vertex attributes
+    const ShaderVertexInput* getVertexInput(const std::string& entryPoint) const;
+
+    std::string serialize() const;
+    static bool deserialize(const std::string& text, ShaderInterface& out);
+};
@@ -0,0 +1,136 @@
+// ShaderObject.cpp
+#include "ShaderObject.h"
+#include "PipelineLayoutCache.h"
+
+#include <volk/volk.h>
+#include <algorithm>
+#include <iostream>
+
+bool ShaderObject::create(VkDevice device, const std::vector<uint32_t>& spirv, const PipelineDesc& desc, ShaderObjects& shaders) const
+{
+	const std::vector<VkDescriptorSetLayout> setLayouts = layoutCache_->getSetLayouts(desc.layout);
+	const std::vector<VkPushConstantRange> pushConstants = layoutCache_->getPushConstantRanges(desc.layout);
+
+	// Specialization constants, laid out as in Pipeline::create
+	std::vector<VkSpecializationMapEntry> specializationEntries;
+	std::vector<uint32_t> specializationData;
+	for (const auto& constant : desc.specialization) {
+		specializationEntries.push_back({ .constantID = constant.id, .offset = static_cast<uint32_t>(specializationData.size() * sizeof(uint32_t)), .size = sizeof(uint32_t) });
+		specializationData.push_back(constant.value);
+	}
+	VkSpecializationInfo specializationInfo{
+		.mapEntryCount = static_cast<uint32_t>(specializationEntries.size()),
+		.pMapEntries = specializationEntries.data(),
+		.dataSize = specializationData.size() * sizeof(uint32_t),
+		.pData = specializationData.data()
+	};
+
+	// Linked, both stages are always used together, which lets the driver
+	// optimize across them like it would for a pipeline
+	VkShaderCreateInfoEXT shaderCI{
+		.sType = VK_STRUCTURE_TYPE_SHADER_CREATE_INFO_EXT,
+		.flags = VK_SHADER_CREATE_LINK_STAGE_BIT_EXT,
+		.codeType = VK_SHADER_CODE_TYPE_SPIRV_EXT,
+		.codeSize = spirv.size() * sizeof(uint32_t),
+		.pCode = spirv.data(),
+		.setLayoutCount = static_cast<uint32_t>(setLayouts.size()),
+		.pSetLayouts = setLayouts.data(),
+		.pushConstantRangeCount = static_cast<uint32_t>(pushConstants.size()),
+		.pPushConstantRanges = pushConstants.data(),
+		.pSpecializationInfo = desc.specialization.empty() ? nullptr : &specializationInfo
+	};
+	std::array<VkShaderCreateInfoEXT, 2> shaderCIs{ shaderCI, shaderCI };
+	shaderCIs[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	shaderCIs[0].nextStage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	shaderCIs[0].pName = desc.vertexEntryPoint.c_str();
+	shaderCIs[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	shaderCIs[1].pName = desc.fragmentEntryPoint.c_str();
+
+	shaders = {};
+	VkResult r = vkCreateShadersEXT(device, static_cast<uint32_t>(shaderCIs.size()), shaderCIs.data(), nullptr, shaders.data());
+	if (r != VK_SUCCESS) {
+		std::cerr << "vkCreateShadersEXT failed: " << r << std::endl;
+		// Linked creation either returns all shaders or none, but be safe
+		destroy(device, shaders);
+		shaders = {};
+		return false;
+	}
+	return true;
+}
+
+void ShaderObject::destroy(VkDevice device, const ShaderObjects& shaders)
+{
+	for (VkShaderEXT shader : shaders) {
+		if (shader != VK_NULL_HANDLE) vkDestroyShaderEXT(device, shader, nullptr);
+	}
+}
+
+PipelineDesc ShaderObject::getStaticState(const PipelineDesc& desc)
+{
+	// Only what goes into vkCreateShadersEXT
+	PipelineDesc result{};
+	result.moduleName = desc.moduleName;
+	result.shaderPath = desc.shaderPath;
+	result.vertexEntryPoint = desc.vertexEntryPoint;
+	result.fragmentEntryPoint = desc.fragmentEntryPoint;
+	result.layout = desc.layout;
+	result.specialization = desc.specialization;
+	return result;
+}
+
+void ShaderObject::bind(VkCommandBuffer cb, const ShaderObjects& shaders, const PipelineDesc& desc)
+{
+	const std::array<VkShaderStageFlagBits, 2> stages{ VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT };
+	vkCmdBindShadersEXT(cb, static_cast<uint32_t>(stages.size()), stages.data(), shaders.data());
+
+	// Vertex input
+	std::array<VkVertexInputAttributeDescription2EXT, 16> attributes{};
+	const uint32_t attributeCount = desc.useVertexInput ? static_cast<uint32_t>(std::min(desc.vertexAttributes.size(), attributes.size())) : 0;
+	for (uint32_t i = 0; i < attributeCount; i++) {
+		const auto& attribute = desc.vertexAttributes[i];
+		attributes[i] = { .sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_ATTRIBUTE_DESCRIPTION_2_EXT, .location = attribute.location, .binding = attribute.binding, .format = attribute.format, .offset = attribute.offset };
+	}
+	const VkVertexInputBindingDescription2EXT binding{
+		.sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_BINDING_DESCRIPTION_2_EXT,
+		.binding = desc.vertexBinding.binding,
+		.stride = desc.vertexBinding.stride,
+		.inputRate = desc.vertexBinding.inputRate,
+		.divisor = 1
+	};
+	vkCmdSetVertexInputEXT(cb, desc.useVertexInput ? 1 : 0, &binding, attributeCount, attributes.data());
+	vkCmdSetPrimitiveTopology(cb, desc.topology);
+	vkCmdSetPrimitiveRestartEnable(cb, VK_FALSE);
+
+	// Rasterization, fixed to what Pipeline::create bakes in
+	vkCmdSetRasterizerDiscardEnable(cb, VK_FALSE);
+	vkCmdSetPolygonModeEXT(cb, desc.polygonMode);
+	vkCmdSetCullMode(cb, desc.cullMode);
+	vkCmdSetFrontFace(cb, desc.frontFace);
+	vkCmdSetLineWidth(cb, 1.0f);
+	vkCmdSetDepthBiasEnable(cb, VK_FALSE);
+	vkCmdSetRasterizationSamplesEXT(cb, VK_SAMPLE_COUNT_1_BIT);
+	const VkSampleMask sampleMask{ ~0u };
+	vkCmdSetSampleMaskEXT(cb, VK_SAMPLE_COUNT_1_BIT, &sampleMask);
+	vkCmdSetAlphaToCoverageEnableEXT(cb, VK_FALSE);
+
+	// Depth and stencil
+	vkCmdSetDepthTestEnable(cb, desc.depthTest ? VK_TRUE : VK_FALSE);
+	vkCmdSetDepthWriteEnable(cb, desc.depthTest && desc.depthWrite ? VK_TRUE : VK_FALSE);
+	vkCmdSetDepthCompareOp(cb, desc.depthCompareOp);
+	vkCmdSetDepthBoundsTestEnable(cb, VK_FALSE);
+	vkCmdSetStencilTestEnable(cb, VK_FALSE);
+
+	// Blending of the single color attachment
+	const VkBool32 blendEnable = desc.blend.enable ? VK_TRUE : VK_FALSE;
+	vkCmdSetColorBlendEnableEXT(cb, 0, 1, &blendEnable);
+	const VkColorBlendEquationEXT blendEquation{
+		.srcColorBlendFactor = desc.blend.srcColor,
+		.dstColorBlendFactor = desc.blend.dstColor,
+		.colorBlendOp = desc.blend.colorOp,
+		.srcAlphaBlendFactor = desc.blend.srcAlpha,
+		.dstAlphaBlendFactor = desc.blend.dstAlpha,
+		.alphaBlendOp = desc.blend.alphaOp
+	};
+	vkCmdSetColorBlendEquationEXT(cb, 0, 1, &blendEquation);
+	vkCmdSetColorWriteMaskEXT(cb, 0, 1, &desc.blend.writeMask);
+}
@@ -0,0 +1,43 @@
+// ShaderObject.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "PipelineDesc.h"
+
+class PipelineLayoutCache; // forward
+
+// Linked vertex and fragment shader objects, index 0 is the vertex shader
+using ShaderObjects = std::array<VkShaderEXT, 2>;
+
+// Graphics without pipeline objects (VK_EXT_shader_object): a PipelineDesc
+// becomes two shader objects created straight from the SPIR-V, and
+// everything else in the description is recorded as dynamic state each time
+// they are bound. Switching shaders then costs a bind instead of a pipeline
+// per combination of shaders and state. The counterpart of Pipeline for the
+// shader object backend of PipelineCompiler.
+class ShaderObject {
+public:
+    ShaderObject() = default;
+    // Shader objects take set layouts and push constant ranges instead of a
+    // pipeline layout, they are looked up in layoutCache by desc.layout
+    explicit ShaderObject(const PipelineLayoutCache* layoutCache) : layoutCache_(layoutCache) {}
+    ~ShaderObject() = default;
+
+    // Shader objects for the entry points of desc in spirv. Returns false
+    // (and creates nothing) on failure.
+    bool create(VkDevice device, const std::vector<uint32_t>& spirv, const PipelineDesc& desc, ShaderObjects& shaders) const;
+    static void destroy(VkDevice device, const ShaderObjects& shaders);
+
+    // desc without the state that is recorded at bind time, descriptions
+    // with equal shaders share their shader objects
+    static PipelineDesc getStaticState(const PipelineDesc& desc);
+    // Bind the shaders and record all graphics state of desc except viewport
+    // and scissor, which the renderer sets per pass
+    static void bind(VkCommandBuffer cb, const ShaderObjects& shaders, const PipelineDesc& desc);
+
+private:
+    const PipelineLayoutCache* layoutCache_{ nullptr };
+};
@@ -0,0 +1,130 @@
+// ShaderVariant.cpp
+#include "ShaderVariant.h"
+
+#include <sstream>
+
+namespace {
+
+// [vk::constant_id] of the switches in shader.slang
+constexpr uint32_t specularId = 0;
+constexpr uint32_t lightingId = 1;
+constexpr uint32_t textureId = 2;
+constexpr uint32_t highlightId = 3;
+
+bool parseBool(const std::string& value, bool& out)
+{
+	if (value == "1" || value == "on") {
+		out = true;
+	} else if (value == "0" || value == "off") {
+		out = false;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+} // namespace
+
+uint32_t SceneShaderVariant::getKey() const
+{
+	// Mixed radix: specular (2), lighting (3), texture (2), highlight (2)
+	const SceneShaderVariant variant = normalized();
+	uint32_t key = static_cast<uint32_t>(variant.highlightSelected);
+	key = key * 2 + static_cast<uint32_t>(variant.texture);
+	key = key * 3 + static_cast<uint32_t>(variant.lighting);
+	return key * 2 + static_cast<uint32_t>(variant.specular);
+}
+
+SceneShaderVariant SceneShaderVariant::fromKey(uint32_t key)
+{
+	SceneShaderVariant variant;
+	variant.specular = key % 2 != 0;
+	key /= 2;
+	variant.lighting = static_cast<LightingModel>(key % 3);
+	key /= 3;
+	variant.texture = static_cast<TextureMode>(key % 2);
+	key /= 2;
+	variant.highlightSelected = key % 2 != 0;
+	return variant.normalized();
+}
+
+SceneShaderVariant SceneShaderVariant::normalized() const
+{
+	SceneShaderVariant variant = *this;
+	variant.specular = specular && lighting == LightingModel::Phong;
+	return variant;
+}
+
+SceneShaderVariant SceneShaderVariant::getNext() const
+{
+	// Keys of non-Phong variants with the specular bit set name the variant
+	// before them, skip those
+	uint32_t key = getKey();
+	do {
+		key = (key + 1) % count;
+	} while (fromKey(key).getKey() != key);
+	return fromKey(key);
+}
+
+std::vector<SpecializationConstant> SceneShaderVariant::getConstants() const
+{
+	return {
+		{ .id = specularId, .value = normalized().specular ? 1u : 0u },
+		{ .id = lightingId, .value = static_cast<uint32_t>(lighting) },
+		{ .id = textureId, .value = static_cast<uint32_t>(texture) },
+		{ .id = highlightId, .value = highlightSelected ? 1u : 0u }
+	};
+}
+
+std::string SceneShaderVariant::getName() const
+{
+	static const char* lightingNames[] = { "unlit", "lambert", "phong" };
+	std::string name = lightingNames[static_cast<uint32_t>(lighting)];
+	// Specular only exists in the Phong model
+	if (lighting == LightingModel::Phong) {
+		name += specular ? ", specular" : ", no specular";
+	}
+	name += texture == TextureMode::Sampled ? ", textured" : ", untextured";
+	name += highlightSelected ? ", highlight" : ", no highlight";
+	return name;
+}
+
+bool SceneShaderVariant::parse(const std::string& text, SceneShaderVariant& variant)
+{
+	std::istringstream stream(text);
+	std::string item;
+	while (std::getline(stream, item, ',')) {
+		const auto separator = item.find('=');
+		if (separator == std::string::npos) {
+			return false;
+		}
+		const std::string key = item.substr(0, separator);
+		const std::string value = item.substr(separator + 1);
+		if (key == "specular") {
+			if (!parseBool(value, variant.specular)) return false;
+		} else if (key == "highlight") {
+			if (!parseBool(value, variant.highlightSelected)) return false;
+		} else if (key == "lighting") {
+			if (value == "unlit") {
+				variant.lighting = LightingModel::Unlit;
+			} else if (value == "lambert") {
+				variant.lighting = LightingModel::Lambert;
+			} else if (value == "phong") {
+				variant.lighting = LightingModel::Phong;
+			} else {
+				return false;
+			}
+		} else if (key == "texture") {
+			if (value == "sampled") {
+				variant.texture = TextureMode::Sampled;
+			} else if (value == "none") {
+				variant.texture = TextureMode::Untextured;
+			} else {
+				return false;
+			}
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
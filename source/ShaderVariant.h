@@ -0,0 +1,43 @@
+// ShaderVariant.h
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "PipelineDesc.h" // for SpecializationConstant
+
+enum class LightingModel : uint32_t { Unlit = 0, Lambert = 1, Phong = 2 };
+enum class TextureMode : uint32_t { Sampled = 0, Untextured = 1 };
+
+// Feature switches of the scene shader (assets/shader.slang). Each one is a
+// specialization constant, so instead of branching at runtime every variant
+// gets its own pipeline and the driver compiles out the code it doesn't use.
+// Keep the constant ids in sync with the shader.
+struct SceneShaderVariant {
+    // Specular highlight of the Phong model
+    bool specular = true;
+    LightingModel lighting = LightingModel::Phong;
+    TextureMode texture = TextureMode::Sampled;
+    // Brighten the object picked with the right mouse button
+    bool highlightSelected = true;
+
+    // Range of the keys, 0 .. count - 1. Keys with the specular bit set but
+    // without Phong lighting don't name a variant of their own, see normalized().
+    static constexpr uint32_t count = 2 * 3 * 2 * 2;
+    uint32_t getKey() const;
+    static SceneShaderVariant fromKey(uint32_t key);
+    // Switches without effect cleared: specular only exists in the Phong
+    // model. Keys and constants are those of the normalized variant, so
+    // variants that compile to the same shader share one pipeline.
+    SceneShaderVariant normalized() const;
+    // The next distinct variant in key order, wrapping around
+    SceneShaderVariant getNext() const;
+
+    std::vector<SpecializationConstant> getConstants() const;
+    // e.g. "phong, specular, textured, highlight"
+    std::string getName() const;
+    // Comma separated switches on top of the defaults: specular=0|1,
+    // lighting=unlit|lambert|phong, texture=sampled|none, highlight=0|1.
+    // Returns false for unknown switches or values.
+    static bool parse(const std::string& text, SceneShaderVariant& variant);
+};
@@ -0,0 +1,148 @@
+// ShaderWatcher.cpp
+#include "ShaderWatcher.h"
+
+#include <chrono>
+#include <iostream>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+bool isShaderSource(const std::filesystem::path& path)
+{
+	return path.extension() == ".slang";
+}
+
+} // namespace
+
+ShaderWatcher::~ShaderWatcher()
+{
+	destroy();
+}
+
+bool ShaderWatcher::create(const std::vector<std::string>& directories)
+{
+	for (const auto& directory : directories) {
+		std::error_code error;
+		directories_.push_back(std::filesystem::canonical(directory, error));
+		if (error) {
+			std::cerr << "Can't watch shader directory " << directory << ": " << error.message() << "\n";
+			return false;
+		}
+	}
+#ifdef __linux__
+	inotify_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotify_ < 0) {
+		std::cerr << "inotify_init1 failed, shader hot reload disabled\n";
+		return false;
+	}
+	for (const auto& directory : directories_) {
+		const int watch = inotify_add_watch(inotify_, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (watch < 0) {
+			std::cerr << "inotify_add_watch failed for " << directory << ", shader hot reload disabled\n";
+			destroy();
+			return false;
+		}
+		watches_[watch] = directory;
+	}
+#else
+	// Baseline, only later modifications count
+	for (const auto& directory : directories_) {
+		std::error_code error;
+		for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+			if (isShaderSource(entry.path())) {
+				writeTimes_[entry.path().string()] = entry.last_write_time(error);
+			}
+		}
+	}
+#endif
+	thread_ = std::thread(&ShaderWatcher::watchLoop, this);
+	return true;
+}
+
+void ShaderWatcher::destroy()
+{
+	quit_ = true;
+	if (thread_.joinable()) {
+		thread_.join();
+	}
+#ifdef __linux__
+	if (inotify_ >= 0) {
+		close(inotify_);
+		inotify_ = -1;
+	}
+	watches_.clear();
+#endif
+	directories_.clear();
+	quit_ = false;
+}
+
+std::vector<std::string> ShaderWatcher::takeChanged()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::vector<std::string> changed(changed_.begin(), changed_.end());
+	changed_.clear();
+	return changed;
+}
+
+void ShaderWatcher::addChanged(const std::filesystem::path& path)
+{
+	std::error_code error;
+	const std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+	std::lock_guard<std::mutex> lock(mutex_);
+	changed_.insert(error ? path.string() : canonical.string());
+}
+
+void ShaderWatcher::watchLoop()
+{
+#ifdef __linux__
+	// Woken up regularly to notice quit_
+	alignas(inotify_event) char buffer[4096];
+	while (!quit_) {
+		pollfd descriptor{ .fd = inotify_, .events = POLLIN, .revents = 0 };
+		if (poll(&descriptor, 1, 100) <= 0) {
+			continue;
+		}
+		for (;;) {
+			const ssize_t length = read(inotify_, buffer, sizeof(buffer));
+			if (length <= 0) {
+				break;
+			}
+			for (ssize_t offset = 0; offset < length;) {
+				const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+				offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+				auto it = watches_.find(event->wd);
+				if (event->len == 0 || it == watches_.end()) {
+					continue;
+				}
+				const std::filesystem::path path = it->second / event->name;
+				if (isShaderSource(path)) {
+					addChanged(path);
+				}
+			}
+		}
+	}
+#else
+	while (!quit_) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+		for (const auto& directory : directories_) {
+			std::error_code error;
+			for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+				if (!isShaderSource(entry.path())) {
+					continue;
+				}
+				const auto writeTime = entry.last_write_time(error);
+				auto [it, inserted] = writeTimes_.try_emplace(entry.path().string(), writeTime);
+				if (inserted || it->second != writeTime) {
+					it->second = writeTime;
+					addChanged(entry.path());
+				}
+			}
+		}
+	}
+#endif
+}
@@ -0,0 +1,49 @@
+// ShaderWatcher.h
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Watches directories for changed Slang sources on a background thread, for
+// shader hot reload (see PipelineCompiler::reload). Uses inotify on Linux and
+// compares modification times every few hundred milliseconds elsewhere.
+// Directories are watched rather than files: editors often save by writing a
+// new file and renaming it over the old one.
+class ShaderWatcher {
+public:
+    ShaderWatcher() = default;
+    ~ShaderWatcher();
+
+    // Non-copyable
+    ShaderWatcher(const ShaderWatcher&) = delete;
+    ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+    bool create(const std::vector<std::string>& directories);
+    void destroy();
+
+    // Canonical paths of the .slang files changed since the last call
+    std::vector<std::string> takeChanged();
+
+private:
+    void watchLoop();
+    void addChanged(const std::filesystem::path& path);
+
+    std::vector<std::filesystem::path> directories_;
+    std::thread thread_;
+    std::atomic<bool> quit_{ false };
+    std::mutex mutex_;
+    std::set<std::string> changed_;
+#ifdef __linux__
+    int inotify_{ -1 };
+    // Watch descriptor to directory
+    std::unordered_map<int, std::filesystem::path> watches_;
+#else
+    std::unordered_map<std::string, std::filesystem::file_time_type> writeTimes_;
+#endif
+};
@@ -1,5 +1,6 @@
 // Swapchain.cpp
 #include "Swapchain.h"
+#include "DeletionQueue.h"
 #include <volk/volk.h>
 #include <vector>
 #include <iostream>
@@ -12,7 +13,7 @@ static inline void chk(VkResult r) {
 	}
 }
 
-VkSwapchainKHR Swapchain::create(VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, uint32_t queueFamilyIndex, VmaAllocator allocator)
+VkSwapchainKHR Swapchain::create(VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, uint32_t queueFamilyIndex, VmaAllocator allocator, DeletionQueue* deletionQueue)
 {
 	// create - no debug prints in production
 
@@ -97,44 +98,63 @@ VkSwapchainKHR Swapchain::create(VkPhysicalDevice physicalDevice, VkDevice devic
 		chk(vkCreateImageView(device, &viewCI, nullptr, &newImageViews[i]));
 	}
 
-	// Create a new depth image for the new extent
-	VkImage newDepthImage = VK_NULL_HANDLE;
-	VmaAllocation newDepthAlloc = VK_NULL_HANDLE;
-	VkImageView newDepthView = VK_NULL_HANDLE;
-	VkImageCreateInfo depthImageCI{
-		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-		.imageType = VK_IMAGE_TYPE_2D,
-		.format = depthFormat_,
-		.extent{.width = extent.width, .height = extent.height, .depth = 1 },
-		.mipLevels = 1,
-		.arrayLayers = 1,
-		.samples = VK_SAMPLE_COUNT_1_BIT,
-		.tiling = VK_IMAGE_TILING_OPTIMAL,
-		.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-	};
-	VmaAllocationCreateInfo allocCI{ .flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT, .usage = VMA_MEMORY_USAGE_AUTO };
-	chk(vmaCreateImage(allocator, &depthImageCI, &allocCI, &newDepthImage, &newDepthAlloc, nullptr));
-	VkImageViewCreateInfo depthViewCI{};
-	depthViewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	depthViewCI.image = newDepthImage;
-	depthViewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	depthViewCI.format = depthFormat_;
-	depthViewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
-	depthViewCI.subresourceRange.levelCount = 1;
-	depthViewCI.subresourceRange.layerCount = 1;
-	chk(vkCreateImageView(device, &depthViewCI, nullptr, &newDepthView));
+	// The depth image only has to cover the render area, so it is kept if it
+	// is large enough. Growing it rounds up to whole tiles, which lets a
+	// window that is dragged larger go without a new image most frames.
+	const bool reuseDepth = depthImage_ != VK_NULL_HANDLE && extent.width <= depthExtent_.width && extent.height <= depthExtent_.height;
+	VkImage newDepthImage = depthImage_;
+	VmaAllocation newDepthAlloc = depthAlloc_;
+	VkImageView newDepthView = depthView_;
+	VkExtent2D newDepthExtent = depthExtent_;
+	if (!reuseDepth) {
+		newDepthExtent = extent;
+		if (depthImage_ != VK_NULL_HANDLE) {
+			newDepthExtent = { (extent.width + depthGrowth - 1) / depthGrowth * depthGrowth, (extent.height + depthGrowth - 1) / depthGrowth * depthGrowth };
+		}
+		VkImageCreateInfo depthImageCI{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = depthFormat_,
+			.extent{.width = newDepthExtent.width, .height = newDepthExtent.height, .depth = 1 },
+			.mipLevels = 1,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			// Sampled by the depth pyramid build of GPU occlusion culling
+			.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		};
+		VmaAllocationCreateInfo allocCI{ .flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT, .usage = VMA_MEMORY_USAGE_AUTO };
+		chk(vmaCreateImage(allocator, &depthImageCI, &allocCI, &newDepthImage, &newDepthAlloc, nullptr));
+		VkImageViewCreateInfo depthViewCI{};
+		depthViewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		depthViewCI.image = newDepthImage;
+		depthViewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		depthViewCI.format = depthFormat_;
+		depthViewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+		depthViewCI.subresourceRange.levelCount = 1;
+		depthViewCI.subresourceRange.layerCount = 1;
+		chk(vkCreateImageView(device, &depthViewCI, nullptr, &newDepthView));
+	}
 
 	// At this point the new swapchain and its images/views/depth exist. Now
-	// we can safely destroy old resources (if any) and update our members.
-	if (oldSwap != VK_NULL_HANDLE) {
+	// the old resources (if any) can be released and our members updated.
+	if (oldSwap != VK_NULL_HANDLE && deletionQueue != nullptr) {
+		// Frames in flight may still render to the old images or present them
+		for (auto &iv : imageViews_) { deletionQueue->retireImageView(iv); }
+		if (!reuseDepth) {
+			deletionQueue->retireImageView(depthView_);
+			deletionQueue->retireImage(depthImage_, depthAlloc_);
+		}
+		deletionQueue->retireSwapchain(oldSwap);
+	} else if (oldSwap != VK_NULL_HANDLE) {
 		// Destroy old image views
 		for (auto &iv : imageViews_) { if (iv != VK_NULL_HANDLE) vkDestroyImageView(device, iv, nullptr); }
 		// Destroy old depth resources
-		if (depthView_ != VK_NULL_HANDLE) { vkDestroyImageView(device, depthView_, nullptr); depthView_ = VK_NULL_HANDLE; }
-		if (depthImage_ != VK_NULL_HANDLE) { vmaDestroyImage(allocator, depthImage_, depthAlloc_); depthImage_ = VK_NULL_HANDLE; depthAlloc_ = VK_NULL_HANDLE; }
+		if (!reuseDepth && depthView_ != VK_NULL_HANDLE) { vkDestroyImageView(device, depthView_, nullptr); }
+		if (!reuseDepth && depthImage_ != VK_NULL_HANDLE) { vmaDestroyImage(allocator, depthImage_, depthAlloc_); }
 		// Destroy old swapchain handle
-		if (swapchain_ != VK_NULL_HANDLE) { vkDestroySwapchainKHR(device, swapchain_, nullptr); }
+		vkDestroySwapchainKHR(device, oldSwap, nullptr);
 	}
 
 	// Update internal state to the newly created resources
@@ -146,32 +166,30 @@ VkSwapchainKHR Swapchain::create(VkPhysicalDevice physicalDevice, VkDevice devic
 	depthImage_ = newDepthImage;
 	depthAlloc_ = newDepthAlloc;
 	depthView_ = newDepthView;
+	if (!reuseDepth) {
+		depthExtent_ = newDepthExtent;
+		depthGeneration_++;
+	}
+	generation_++;
 
 	// creation succeeded
 	return swapchain_;
 }
 
-VkSwapchainKHR Swapchain::recreate(VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, uint32_t queueFamilyIndex, VmaAllocator allocator)
+VkSwapchainKHR Swapchain::recreate(VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, uint32_t queueFamilyIndex, VmaAllocator allocator, DeletionQueue& deletionQueue)
 {
-	// Centralized recreation flow:
-	//  1. Wait for device idle to ensure no commands reference swapchain resources.
-	//  2. Query surface capabilities (create() will also query internally but
-	//     keeping the wait and capability refresh here keeps caller simpler).
-	//  3. Call create() which will create the new swapchain and swap resources.
-	// The create() implementation already handles passing the old swapchain
-	// through the create-info, and replaces resources after the new ones are
-	// successfully created.
-	vkDeviceWaitIdle(device);
-	VkSurfaceCapabilitiesKHR caps{};
-	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &caps);
-	(void)caps; // currently unused here but helpful for future policies
-	return create(physicalDevice, device, surface, queueFamilyIndex, allocator);
+	// No device wait: create() passes the current swapchain as oldSwapchain,
+	// which retires it, and hands the old images, views and depth buffer to
+	// the deletion queue. Frames still in flight finish with them and present
+	// their images; the new swapchain is used from the next acquire on.
+	return create(physicalDevice, device, surface, queueFamilyIndex, allocator, &deletionQueue);
 }
 
 void Swapchain::destroy(VkDevice device, VmaAllocator allocator)
 {
 	if (depthView_ != VK_NULL_HANDLE) { vkDestroyImageView(device, depthView_, nullptr); depthView_ = VK_NULL_HANDLE; }
 	if (depthImage_ != VK_NULL_HANDLE) { vmaDestroyImage(allocator, depthImage_, depthAlloc_); depthImage_ = VK_NULL_HANDLE; depthAlloc_ = VK_NULL_HANDLE; }
+	depthExtent_ = { 0, 0 };
 	for (auto &iv : imageViews_) { if (iv != VK_NULL_HANDLE) vkDestroyImageView(device, iv, nullptr); }
 	imageViews_.clear();
 	images_.clear();
@@ -5,6 +5,8 @@
 #include <vma/vk_mem_alloc.h>
 #include <vector>
 
+class DeletionQueue; // forward
+
 class Swapchain {
 public:
     Swapchain() = default;
@@ -12,12 +14,14 @@ public:
 
     // Create the swapchain and associated image views and depth buffer.
     // Returns the created VkSwapchainKHR or VK_NULL_HANDLE on failure.
-    VkSwapchainKHR create(VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, uint32_t queueFamilyIndex, VmaAllocator allocator);
+    // Resources of a previous swapchain are handed to deletionQueue if given,
+    // otherwise they are destroyed right away and must no longer be in use.
+    VkSwapchainKHR create(VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, uint32_t queueFamilyIndex, VmaAllocator allocator, DeletionQueue* deletionQueue = nullptr);
 
-    // Recreate the swapchain (destroys previous images/views/depth and creates new ones).
-    // Recreate the swapchain: waits for device idle, refreshes surface caps,
-    // creates a new swapchain and replaces internal resources safely.
-    VkSwapchainKHR recreate(VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, uint32_t queueFamilyIndex, VmaAllocator allocator);
+    // Recreate the swapchain without waiting for the device: the current one
+    // is passed as oldSwapchain, and it, its image views and the depth buffer
+    // are retired through deletionQueue once the frames using them completed.
+    VkSwapchainKHR recreate(VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, uint32_t queueFamilyIndex, VmaAllocator allocator, DeletionQueue& deletionQueue);
 
     // Destroy all resources owned by this helper.
     void destroy(VkDevice device, VmaAllocator allocator);
@@ -26,12 +30,20 @@ public:
     VkSwapchainKHR get() const { return swapchain_; }
     std::vector<VkImage>& images() { return images_; }
     std::vector<VkImageView>& imageViews() { return imageViews_; }
+    // The depth image can be larger than the swapchain extent (see getDepthExtent)
     VkImage getDepthImage() const { return depthImage_; }
     VmaAllocation getDepthAllocation() const { return depthAlloc_; }
     VkImageView getDepthView() const { return depthView_; }
     VkFormat getImageFormat() const { return imageFormat_; }
     VkFormat getDepthFormat() const { return depthFormat_; }
     VkExtent2D getExtent() const { return extent_; }
+    // Size of the depth image, at least getExtent(). It is kept across
+    // recreations as long as the new extent fits.
+    VkExtent2D getDepthExtent() const { return depthExtent_; }
+    // Incremented on every successful (re)creation, lets users of the images detect changes
+    uint32_t getGeneration() const { return generation_; }
+    // Incremented only when the depth image is replaced
+    uint32_t getDepthGeneration() const { return depthGeneration_; }
 
 private:
     VkSwapchainKHR swapchain_{ VK_NULL_HANDLE };
@@ -43,4 +55,10 @@ private:
     VkFormat imageFormat_{ VK_FORMAT_B8G8R8A8_SRGB };
     VkFormat depthFormat_{ VK_FORMAT_D24_UNORM_S8_UINT };
     VkExtent2D extent_{ 0, 0 };
+    VkExtent2D depthExtent_{ 0, 0 };
+    uint32_t generation_{ 0 };
+    uint32_t depthGeneration_{ 0 };
+
+    // A depth image that has to grow is rounded up to multiples of this
+    static constexpr uint32_t depthGrowth = 256;
 };
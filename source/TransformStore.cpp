@@ -0,0 +1,155 @@
+// TransformStore.cpp
+#include "TransformStore.h"
+
+#include <algorithm>
+#include <bit>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <xmmintrin.h>
+#define TRANSFORM_STORE_SSE2
+#endif
+
+namespace {
+
+constexpr uint32_t wordBits = 64;
+
+} // namespace
+
+void TransformStore::clear()
+{
+	for (auto* array : { &positionX_, &positionY_, &positionZ_, &rotationX_, &rotationY_, &rotationZ_, &rotationW_, &scaleX_, &scaleY_, &scaleZ_ }) {
+		array->clear();
+	}
+	matrices_.clear();
+	dirtyBits_.clear();
+	dirtyWords_.clear();
+	changed_.clear();
+	count_ = 0;
+}
+
+uint32_t TransformStore::add(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+{
+	if (count_ % wordBits == 0) {
+		// Padding objects are identity transforms, so whole groups can be computed
+		const size_t size = static_cast<size_t>(count_) + wordBits;
+		for (auto* array : { &positionX_, &positionY_, &positionZ_, &rotationX_, &rotationY_, &rotationZ_ }) {
+			array->resize(size, 0.0f);
+		}
+		for (auto* array : { &rotationW_, &scaleX_, &scaleY_, &scaleZ_ }) {
+			array->resize(size, 1.0f);
+		}
+		matrices_.resize(size, glm::mat4(1.0f));
+		dirtyBits_.push_back(0);
+	}
+	const uint32_t object = count_++;
+	setPosition(object, position);
+	setRotation(object, rotation);
+	setScale(object, scale);
+	return object;
+}
+
+void TransformStore::markDirty(uint32_t object)
+{
+	uint64_t& word = dirtyBits_[object / wordBits];
+	if (word == 0) {
+		dirtyWords_.push_back(object / wordBits);
+	}
+	word |= uint64_t(1) << (object % wordBits);
+}
+
+void TransformStore::setPosition(uint32_t object, const glm::vec3& position)
+{
+	positionX_[object] = position.x;
+	positionY_[object] = position.y;
+	positionZ_[object] = position.z;
+	markDirty(object);
+}
+
+void TransformStore::setRotation(uint32_t object, const glm::quat& rotation)
+{
+	rotationX_[object] = rotation.x;
+	rotationY_[object] = rotation.y;
+	rotationZ_[object] = rotation.z;
+	rotationW_[object] = rotation.w;
+	markDirty(object);
+}
+
+void TransformStore::setScale(uint32_t object, const glm::vec3& scale)
+{
+	scaleX_[object] = scale.x;
+	scaleY_[object] = scale.y;
+	scaleZ_[object] = scale.z;
+	markDirty(object);
+}
+
+const std::vector<uint32_t>& TransformStore::update()
+{
+	changed_.clear();
+	std::sort(dirtyWords_.begin(), dirtyWords_.end());
+	for (uint32_t word : dirtyWords_) {
+		uint64_t bits = dirtyBits_[word];
+		const uint32_t base = word * wordBits;
+		// Groups of four with at least one dirty object are recomputed as a whole
+		for (uint32_t group = 0; group < wordBits; group += 4) {
+			if ((bits >> group) & 0xf) {
+				updateGroup(base + group);
+			}
+		}
+		while (bits != 0) {
+			changed_.push_back(base + static_cast<uint32_t>(std::countr_zero(bits)));
+			bits &= bits - 1;
+		}
+		dirtyBits_[word] = 0;
+	}
+	dirtyWords_.clear();
+	return changed_;
+}
+
+void TransformStore::updateGroup(uint32_t first)
+{
+	// Same terms as glm::mat4_cast, with the rotation columns scaled and the
+	// position in the last column
+#if defined(TRANSFORM_STORE_SSE2)
+	const __m128 x = _mm_loadu_ps(&rotationX_[first]);
+	const __m128 y = _mm_loadu_ps(&rotationY_[first]);
+	const __m128 z = _mm_loadu_ps(&rotationZ_[first]);
+	const __m128 w = _mm_loadu_ps(&rotationW_[first]);
+	const __m128 x2 = _mm_add_ps(x, x);
+	const __m128 y2 = _mm_add_ps(y, y);
+	const __m128 z2 = _mm_add_ps(z, z);
+	const __m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+	const __m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+	const __m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 sx = _mm_loadu_ps(&scaleX_[first]);
+	const __m128 sy = _mm_loadu_ps(&scaleY_[first]);
+	const __m128 sz = _mm_loadu_ps(&scaleZ_[first]);
+	// columns[c][r] holds element [c][r] of the four matrices
+	__m128 columns[4][4] = {
+		{ _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx), _mm_mul_ps(_mm_add_ps(xy, wz), sx), _mm_mul_ps(_mm_sub_ps(xz, wy), sx), zero },
+		{ _mm_mul_ps(_mm_sub_ps(xy, wz), sy), _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy), _mm_mul_ps(_mm_add_ps(yz, wx), sy), zero },
+		{ _mm_mul_ps(_mm_add_ps(xz, wy), sz), _mm_mul_ps(_mm_sub_ps(yz, wx), sz), _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz), zero },
+		{ _mm_loadu_ps(&positionX_[first]), _mm_loadu_ps(&positionY_[first]), _mm_loadu_ps(&positionZ_[first]), one },
+	};
+	for (int c = 0; c < 4; c++) {
+		// After the transpose register k holds column c of matrix k
+		_MM_TRANSPOSE4_PS(columns[c][0], columns[c][1], columns[c][2], columns[c][3]);
+		for (int k = 0; k < 4; k++) {
+			_mm_storeu_ps(&matrices_[first + k][c][0], columns[c][k]);
+		}
+	}
+#else
+	for (uint32_t i = first; i < first + 4; i++) {
+		const float x = rotationX_[i], y = rotationY_[i], z = rotationZ_[i], w = rotationW_[i];
+		const float xx = 2.0f * x * x, yy = 2.0f * y * y, zz = 2.0f * z * z;
+		const float xy = 2.0f * x * y, xz = 2.0f * x * z, yz = 2.0f * y * z;
+		const float wx = 2.0f * w * x, wy = 2.0f * w * y, wz = 2.0f * w * z;
+		glm::mat4& m = matrices_[i];
+		m[0] = glm::vec4(1.0f - (yy + zz), xy + wz, xz - wy, 0.0f) * scaleX_[i];
+		m[1] = glm::vec4(xy - wz, 1.0f - (xx + zz), yz + wx, 0.0f) * scaleY_[i];
+		m[2] = glm::vec4(xz + wy, yz - wx, 1.0f - (xx + yy), 0.0f) * scaleZ_[i];
+		m[3] = glm::vec4(positionX_[i], positionY_[i], positionZ_[i], 1.0f);
+	}
+#endif
+}
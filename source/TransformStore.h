@@ -0,0 +1,57 @@
+// TransformStore.h
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cstdint>
+#include <vector>
+
+// Object transforms (position, rotation, scale) stored as structure of
+// arrays, with a dirty bit per object. update() rebuilds the world matrices
+// of the dirty objects only, four at a time with SSE2 where available, and
+// returns their indices so callers can forward just those to the GPU scene,
+// culling structures etc. The cost of a frame therefore depends on the number
+// of objects that changed, not on the number of objects.
+class TransformStore {
+public:
+    TransformStore() = default;
+    ~TransformStore() = default;
+
+    void clear();
+    // New objects start out dirty
+    uint32_t add(const glm::vec3& position, const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), const glm::vec3& scale = glm::vec3(1.0f));
+    uint32_t getCount() const { return count_; }
+
+    glm::vec3 getPosition(uint32_t object) const { return { positionX_[object], positionY_[object], positionZ_[object] }; }
+    glm::quat getRotation(uint32_t object) const { return glm::quat(rotationW_[object], rotationX_[object], rotationY_[object], rotationZ_[object]); }
+    glm::vec3 getScale(uint32_t object) const { return { scaleX_[object], scaleY_[object], scaleZ_[object] }; }
+
+    void setPosition(uint32_t object, const glm::vec3& position);
+    // The rotation has to be normalized
+    void setRotation(uint32_t object, const glm::quat& rotation);
+    void setScale(uint32_t object, const glm::vec3& scale);
+
+    // Rebuild the matrices of all dirty objects and clear their dirty bits.
+    // Returns the changed objects in ascending order, valid until the next call.
+    const std::vector<uint32_t>& update();
+
+    // translate(position) * mat4_cast(rotation) * scale(scale), as of the last update()
+    const glm::mat4& getMatrix(uint32_t object) const { return matrices_[object]; }
+
+private:
+    void markDirty(uint32_t object);
+    void updateGroup(uint32_t first);
+
+    // Arrays are padded to whole dirty words (64 objects), so groups of four
+    // can always be loaded
+    std::vector<float> positionX_, positionY_, positionZ_;
+    std::vector<float> rotationX_, rotationY_, rotationZ_, rotationW_;
+    std::vector<float> scaleX_, scaleY_, scaleZ_;
+    std::vector<glm::mat4> matrices_;
+    std::vector<uint64_t> dirtyBits_;
+    // Indices of the words in dirtyBits_ that have bits set, so update()
+    // doesn't scan clean words
+    std::vector<uint32_t> dirtyWords_;
+    std::vector<uint32_t> changed_;
+    uint32_t count_{ 0 };
+};
@@ -4,20 +4,23 @@
 #include <SFML/Graphics.hpp>
 #include <vulkan/vulkan.h>
 #define VOLK_IMPLEMENTATION
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <charconv>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 #include <volk/volk.h>
 #define VMA_IMPLEMENTATION
 #include <vma/vk_mem_alloc.h>
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
-#include "slang/slang-com-ptr.h"
-#include "slang/slang.h"
 #include <ktx.h>
 #include <ktxvulkan.h>
 #include <glm/glm.hpp>
@@ -27,12 +30,28 @@
 #include <tiny_obj_loader.h>
 
 #include "CommandPool.h"
+#include "CommandCache.h"
+#include "CpuCulling.h"
+#include "GpuScene.h"
+#include "GpuCulling.h"
 #include "Descriptor.h"
 #include "InstanceWrapper.h"
 #include "LogicalDevice.h"
+#include "OverdrawTarget.h"
+#include "ParallelRecorder.h"
+#include "PersistentBuffer.h"
+#include "FrameAllocator.h"
+#include "DeletionQueue.h"
+#include "PipelineCache.h"
+#include "ShaderCompiler.h"
+#include "PipelineCompiler.h"
+#include "PipelineLayoutCache.h"
 #include "PhysicalDevice.h"
 #include "Pipeline.h"
+#include "PipelineStatistics.h"
 #include "Renderer.h"
+#include "ShaderVariant.h"
+#include "ShaderWatcher.h"
 #include "Swapchain.h"
 #include "TextureImage.h"
 
@@ -49,6 +68,30 @@ static inline void chk(bool result) {
     }
 }
 
+// Whole string as a decimal number, no sign or trailing characters
+static bool parseUint(std::string_view text, uint32_t& value) {
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return error == std::errc{} && end == text.data() + text.size() && !text.empty();
+}
+
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [device index] [options]\n"
+        << "  --pipeline-stats         pipeline statistics queries\n"
+        << "  --overdraw               overdraw heat map\n"
+        << "  --dump-graph             print the render graph\n"
+        << "  --late-latch             update the camera right before submit\n"
+        << "  --input-latency          report input to submit latency\n"
+        << "  --verbose                scene setup, culling and frame statistics, picks, reloads\n"
+        << "  --cached-commands        reuse recorded command buffers\n"
+        << "  --grid <columns>x<rows>  stress scene size\n"
+        << "  --gpu-cull, --cpu-cull, --bvh-cull, --no-hiz\n"
+        << "  --device-local-scene     scene data in device-local memory\n"
+        << "  --record-threads <n>     record the scene on n threads\n"
+        << "  --shader-variant <list>  e.g. lighting=lambert,texture=none,highlight=0\n"
+        << "  --no-hot-reload, --no-shader-cache, --monolithic-pipelines, --no-shader-objects\n"
+        << "  --bench-cull, --bench-binds\n";
+}
+
 VulkanApp::VulkanApp(int argc, char* argv[])
     : argc_(argc), argv_(argc ? argv : nullptr) {}
 
@@ -61,11 +104,90 @@ int VulkanApp::run()
     InstanceWrapper inst("How to Vulkan");
     VkInstance instance = inst.get();
 
-    // Choose a physical device via helper
+    // Command line: an optional device index plus feature flags
     uint32_t deviceIndex{ 0 };
-    if (argc_ > 1) {
-        deviceIndex = std::stoi(argv_[1]);
+    RenderOptions options{};
+    bool benchmarkCulling{ false };
+    bool useShaderCache{ true };
+    bool usePipelineLibraries{ true };
+    bool useShaderObjects{ true };
+    bool benchmarkBinds{ false };
+    SceneShaderVariant sceneVariant{};
+    for (int i = 1; i < argc_; i++) {
+        const std::string arg{ argv_[i] };
+        if (arg == "--pipeline-stats") {
+            options.pipelineStatistics = true;
+        } else if (arg == "--overdraw") {
+            options.overdraw = true;
+        } else if (arg == "--dump-graph") {
+            options.dumpRenderGraph = true;
+        } else if (arg == "--late-latch") {
+            options.lateLatch = true;
+        } else if (arg == "--input-latency") {
+            options.reportInputLatency = true;
+        } else if (arg == "--verbose") {
+            options.verbose = true;
+        } else if (arg == "--cached-commands") {
+            options.cachedCommands = true;
+        } else if (arg == "--grid" && i + 1 < argc_) {
+            const std::string_view grid{ argv_[++i] };
+            const auto separator = grid.find('x');
+            uint32_t columns{ 0 };
+            uint32_t rows{ 0 };
+            if (separator == std::string_view::npos || !parseUint(grid.substr(0, separator), columns) || !parseUint(grid.substr(separator + 1), rows) || columns == 0 || rows == 0) {
+                std::cerr << "Invalid grid " << grid << ", expected <columns>x<rows>, e.g. 10x10\n";
+                printUsage(argv_[0]);
+                return 1;
+            }
+            options.gridColumns = columns;
+            options.gridRows = rows;
+        } else if (arg == "--gpu-cull") {
+            options.gpuCulling = true;
+        } else if (arg == "--no-hiz") {
+            options.occlusionCulling = false;
+        } else if (arg == "--device-local-scene") {
+            options.deviceLocalScene = true;
+        } else if (arg == "--cpu-cull") {
+            options.cpuCulling = true;
+        } else if (arg == "--bvh-cull") {
+            options.cpuCulling = true;
+            options.bvhCulling = true;
+        } else if (arg == "--no-hot-reload") {
+            options.shaderHotReload = false;
+        } else if (arg == "--no-shader-cache") {
+            useShaderCache = false;
+        } else if (arg == "--shader-variant" && i + 1 < argc_) {
+            if (!SceneShaderVariant::parse(argv_[++i], sceneVariant)) {
+                std::cerr << "Invalid shader variant " << argv_[i] << ", expected e.g. lighting=lambert,texture=none,highlight=0\n";
+                return 1;
+            }
+        } else if (arg == "--monolithic-pipelines") {
+            usePipelineLibraries = false;
+        } else if (arg == "--no-shader-objects") {
+            useShaderObjects = false;
+        } else if (arg == "--bench-binds") {
+            benchmarkBinds = true;
+        } else if (arg == "--bench-cull") {
+            benchmarkCulling = true;
+        } else if (arg == "--record-threads" && i + 1 < argc_) {
+            if (!parseUint(argv_[++i], options.recordingThreads)) {
+                std::cerr << "Invalid thread count " << argv_[i] << "\n";
+                printUsage(argv_[0]);
+                return 1;
+            }
+        } else if (!parseUint(arg, deviceIndex)) {
+            // Only a plain number is a device index; unknown flags and flags missing their value end up here
+            std::cerr << "Unknown or incomplete argument " << arg << "\n";
+            printUsage(argv_[0]);
+            return 1;
+        }
     }
+    if (benchmarkCulling) {
+        runCullingBenchmark();
+        return 0;
+    }
+
+    // Choose a physical device via helper
     PhysicalDevice physHelper;
     VkPhysicalDevice physical = physHelper.choose(instance, deviceIndex);
     VkPhysicalDeviceProperties2 deviceProperties{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
@@ -87,7 +209,20 @@ int VulkanApp::run()
 
     // Create logical device via helper
     LogicalDevice logicalHelper;
-    VkDevice device = logicalHelper.create(physical, queueFamily);
+    DeviceFeatureRequest featureRequest{ .pipelineStatistics = options.pipelineStatistics, .inheritedQueries = options.pipelineStatistics && options.recordingThreads > 0, .drawIndirectCount = true, .multiDrawIndirect = true, .drawIndirectFirstInstance = true, .graphicsPipelineLibrary = usePipelineLibraries, .extendedDynamicState3 = usePipelineLibraries, .shaderObject = useShaderObjects };
+    VkDevice device = logicalHelper.create(physical, queueFamily, &featureRequest);
+    if (device == VK_NULL_HANDLE) {
+        std::cerr << "Failed to create a logical device on " << deviceProperties.properties.deviceName << "\n";
+        return 1;
+    }
+    if (options.pipelineStatistics && !featureRequest.pipelineStatistics) {
+        std::cerr << "Pipeline statistics queries are not supported by this device, disabling\n";
+        options.pipelineStatistics = false;
+    }
+    if (options.pipelineStatistics && options.recordingThreads > 0 && !featureRequest.inheritedQueries) {
+        std::cerr << "Inherited queries are not supported by this device, disabling pipeline statistics\n";
+        options.pipelineStatistics = false;
+    }
     VkQueue queue{ VK_NULL_HANDLE };
     vkGetDeviceQueue(device, queueFamily, 0, &queue);
 
@@ -131,6 +266,18 @@ int VulkanApp::run()
         vertices.push_back(v);
         indices.push_back(indices.size());
     }
+    // Bounding sphere for culling: centered on the bounding box, enclosing all vertices
+    glm::vec3 boundsMin{ vertices[0].pos };
+    glm::vec3 boundsMax{ vertices[0].pos };
+    for (const Vertex& v : vertices) {
+        boundsMin = glm::min(boundsMin, v.pos);
+        boundsMax = glm::max(boundsMax, v.pos);
+    }
+    const glm::vec3 boundsCenter{ (boundsMin + boundsMax) * 0.5f };
+    float boundsRadius{ 0.0f };
+    for (const Vertex& v : vertices) {
+        boundsRadius = std::max(boundsRadius, glm::length(v.pos - boundsCenter));
+    }
     VkDeviceSize vBufSize{ sizeof(Vertex) * vertices.size() };
     VkDeviceSize iBufSize{ sizeof(uint16_t) * indices.size() };
     VkBuffer vBuffer{ VK_NULL_HANDLE };
@@ -144,17 +291,29 @@ int VulkanApp::run()
     memcpy(((char*)bufferPtr) + vBufSize, indices.data(), iBufSize);
     vmaUnmapMemory(allocator, vBufferAllocation);
 
-    // Shader data buffers
-    std::array<ShaderDataBuffer, VulkanApp::maxFramesInFlight> shaderDataBuffers{};
-    for (auto i = 0; i < VulkanApp::maxFramesInFlight; i++) {
-        VkBufferCreateInfo uBufferCI{ .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = sizeof(ShaderData), .usage = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT };
-        VmaAllocationCreateInfo uBufferAllocCI{ .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT, .usage = VMA_MEMORY_USAGE_AUTO };
-        chk(vmaCreateBuffer(allocator, &uBufferCI, &uBufferAllocCI, &shaderDataBuffers[i].buffer, &shaderDataBuffers[i].allocation, nullptr));
-        vmaMapMemory(allocator, shaderDataBuffers[i].allocation, &shaderDataBuffers[i].mapped);
-        VkBufferDeviceAddressInfo uBufferBdaInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = shaderDataBuffers[i].buffer };
-        shaderDataBuffers[i].deviceAddress = vkGetBufferDeviceAddress(device, &uBufferBdaInfo);
+    // Device-local scene data is updated by copies recorded into each frame's
+    // command buffer, so it can be neither late latched nor pre-recorded
+    if (options.deviceLocalScene && options.cachedCommands) {
+        std::cerr << "Cached command buffers can't carry the per-frame scene uploads, ignoring --device-local-scene\n";
+        options.deviceLocalScene = false;
+    }
+    if (options.deviceLocalScene && options.lateLatch) {
+        std::cerr << "Late latching needs host-visible shader data, ignoring --late-latch\n";
+        options.lateLatch = false;
     }
 
+    // Resources replaced while frames are in flight (swapchain, render targets)
+    DeletionQueue deletionQueue;
+    deletionQueue.create(device, allocator);
+
+    // Shader data buffer
+    PersistentBuffer shaderDataBuffer;
+    chk(shaderDataBuffer.create(device, allocator, &deletionQueue, sizeof(ShaderData), 0, options.deviceLocalScene));
+
+    // Transient per-frame data
+    FrameAllocator frameAllocator;
+    chk(frameAllocator.create(device, allocator));
+
     // Sync objects
     std::array<VkFence, VulkanApp::maxFramesInFlight> fences{};
     std::array<VkSemaphore, VulkanApp::maxFramesInFlight> presentSemaphores{};
@@ -190,9 +349,58 @@ int VulkanApp::run()
         textureDescriptors.push_back({ .sampler = textures[i].sampler, .imageView = textures[i].view, .imageLayout = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL });
     }
 
-    // Descriptor (indexing) - use helper to create layout, pool and allocate/update set
+    // Compile the shaders, or load them from the SPIR-V cache. The time until
+    // everything the first frame needs is ready is reported to compare cold
+    // (--no-shader-cache) and warm starts.
+    auto shaderStart = std::chrono::steady_clock::now();
+    // Compute shaders for GPU culling. Graphics pipelines are built by the
+    // pipeline compiler's workers.
+    ShaderCompiler shaderCompiler;
+    shaderCompiler.create("shadercache", useShaderCache);
+    VkShaderModule cullingShaderModule{ VK_NULL_HANDLE };
+    if (options.gpuCulling) {
+        std::vector<uint32_t> cullingSpirv;
+        if (!shaderCompiler.compile("culling", "assets/culling.slang", cullingSpirv)) {
+            std::cerr << "Failed to compile assets/culling.slang, GPU culling disabled\n";
+            options.gpuCulling = false;
+        } else {
+            VkShaderModuleCreateInfo cullingModuleCI{ .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO, .codeSize = cullingSpirv.size() * sizeof(uint32_t), .pCode = cullingSpirv.data() };
+            chk(vkCreateShaderModule(device, &cullingModuleCI, nullptr, &cullingShaderModule));
+        }
+    }
+    // The pipeline layout is generated from the scene shader's interface, so
+    // it is compiled here first. The workers then find it in the cache.
+    std::vector<uint32_t> sceneSpirv;
+    ShaderInterface sceneInterface;
+    if (!shaderCompiler.compile("triangle", "assets/shader.slang", sceneSpirv, &sceneInterface)) {
+        std::cerr << "Failed to compile assets/shader.slang" << '\n';
+        chk(VK_ERROR_INITIALIZATION_FAILED);
+    }
+    // Nothing else is compiled on this thread, release the Slang sessions (if they were needed at all)
+    shaderCompiler.destroy();
+
+    // Pipeline layout: descriptor set layouts and push constant ranges as the
+    // shader declares them. Set 0 is the texture array (descriptor indexing),
+    // set 1 the overdraw count image.
+    PipelineLayoutCache layoutCache;
+    layoutCache.create(device);
+    VkPipelineLayout pipelineLayout = layoutCache.getLayout(sceneInterface, static_cast<uint32_t>(textures.size()));
+    if (pipelineLayout == VK_NULL_HANDLE) {
+        std::cerr << "Failed to create the pipeline layout for assets/shader.slang" << '\n';
+        chk(VK_ERROR_INITIALIZATION_FAILED);
+    }
+    // The renderer pushes the ShaderData address to the vertex stage
+    const bool pushesAddress = std::any_of(sceneInterface.pushConstants.begin(), sceneInterface.pushConstants.end(), [](const VkPushConstantRange& range) {
+        return (range.stageFlags & VK_SHADER_STAGE_VERTEX_BIT) && range.offset == 0 && range.size == sizeof(VkDeviceAddress);
+    });
+    if (!pushesAddress || sceneInterface.getSetCount() < (options.overdraw ? 2u : 1u)) {
+        std::cerr << "Interface of assets/shader.slang doesn't match the renderer" << '\n';
+        chk(VK_ERROR_INITIALIZATION_FAILED);
+    }
+
+    // Descriptor (indexing) - allocate/update the texture set from the helper's pool
     Descriptor descHelper;
-    VkDescriptorSetLayout descriptorSetLayoutTex = descHelper.createLayout(device, static_cast<uint32_t>(textures.size()));
+    VkDescriptorSetLayout descriptorSetLayoutTex = layoutCache.getSetLayout(pipelineLayout, 0);
     VkDescriptorPool descriptorPool = descHelper.createPool(device, static_cast<uint32_t>(textures.size()));
     if (descriptorPool == VK_NULL_HANDLE) {
         std::cerr << "Failed to create descriptor pool" << '\n';
@@ -204,44 +412,163 @@ int VulkanApp::run()
         chk(VK_ERROR_INITIALIZATION_FAILED);
     }
 
-    // Initialize Slang shader compiler
-    Slang::ComPtr<slang::IGlobalSession> slangGlobalSession;
-    slang::createGlobalSession(slangGlobalSession.writeRef());
-    auto slangTargets{ std::to_array<slang::TargetDesc>({ {.format{SLANG_SPIRV}, .profile{slangGlobalSession->findProfile("spirv_1_4")} } }) };
-    auto slangOptions{ std::to_array<slang::CompilerOptionEntry>({ { slang::CompilerOptionName::EmitSpirvDirectly, {slang::CompilerOptionValueKind::Int, 1} } }) };
-    slang::SessionDesc slangSessionDesc{ .targets{slangTargets.data()}, .targetCount{SlangInt(slangTargets.size())}, .defaultMatrixLayoutMode = SLANG_MATRIX_LAYOUT_COLUMN_MAJOR, .compilerOptionEntries{slangOptions.data()}, .compilerOptionEntryCount{uint32_t(slangOptions.size())} };
-
-    // Load shader
-    Slang::ComPtr<slang::ISession> slangSession;
-    slangGlobalSession->createSession(slangSessionDesc, slangSession.writeRef());
-    Slang::ComPtr<slang::IModule> slangModule{ slangSession->loadModuleFromSource("triangle", "assets/shader.slang", nullptr, nullptr) };
-    Slang::ComPtr<ISlangBlob> spirv;
-    slangModule->getTargetCode(0, spirv.writeRef());
-    VkShaderModuleCreateInfo shaderModuleCI{ .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO, .codeSize = spirv->getBufferSize(), .pCode = (uint32_t*)spirv->getBufferPointer() };
-    VkShaderModule shaderModule{};
-    vkCreateShaderModule(device, &shaderModuleCI, nullptr, &shaderModule);
-
-    // Pipeline layout (push constant for device address)
-    VkPushConstantRange pushConstantRange{ .stageFlags = VK_SHADER_STAGE_VERTEX_BIT, .size = sizeof(VkDeviceAddress) };
-    VkPipelineLayoutCreateInfo pipelineLayoutCI{ .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, .setLayoutCount = 1, .pSetLayouts = &descriptorSetLayoutTex, .pushConstantRangeCount = 1, .pPushConstantRanges = &pushConstantRange };
-    VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
-    chk(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipelineLayout));
-
-    // Vertex input description
-    VkVertexInputBindingDescription vertexBinding{ .binding = 0, .stride = sizeof(Vertex), .inputRate = VK_VERTEX_INPUT_RATE_VERTEX };
-    std::vector<VkVertexInputAttributeDescription> vertexAttributes{
-        { .location = 0, .binding = 0, .format = VK_FORMAT_R32G32B32_SFLOAT, .offset = offsetof(Vertex, pos) },
-        { .location = 1, .binding = 0, .format = VK_FORMAT_R32G32B32_SFLOAT, .offset = offsetof(Vertex, normal) },
-        { .location = 2, .binding = 0, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(Vertex, uv) },
+    // Overdraw target (set 1 of the pipeline layout when enabled)
+    OverdrawTarget overdrawTarget;
+    if (options.overdraw && !overdrawTarget.create(physical, device, layoutCache.getSetLayout(pipelineLayout, 1))) {
+        std::cerr << "Failed to create overdraw target" << '\n';
+        chk(VK_ERROR_INITIALIZATION_FAILED);
+    }
+
+    // Pipeline statistics queries, one per frame in flight
+    PipelineStatistics pipelineStats;
+    if (options.pipelineStatistics && !pipelineStats.create(device, VulkanApp::maxFramesInFlight)) {
+        options.pipelineStatistics = false;
+    }
+
+    // Vertex input description, reflected attributes are packed in location
+    // order, which has to be the layout of Vertex
+    const ShaderVertexInput* sceneVertexInput = sceneInterface.getVertexInput("main");
+    if (!sceneVertexInput || sceneVertexInput->stride != sizeof(Vertex)) {
+        std::cerr << "Vertex inputs of assets/shader.slang don't match the Vertex struct" << '\n';
+        chk(VK_ERROR_INITIALIZATION_FAILED);
+    }
+    VkVertexInputBindingDescription vertexBinding{ .binding = 0, .stride = sceneVertexInput->stride, .inputRate = VK_VERTEX_INPUT_RATE_VERTEX };
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes = sceneVertexInput->attributes;
+
+    // Pipelines are created through a cache that is kept on disk between runs
+    PipelineCache pipelineCache;
+    chk(pipelineCache.create(physical, device, "pipelines.cache"));
+
+    // Graphics pipelines are built on worker threads, shader compile included
+    PipelineCompiler pipelineCompiler;
+    const PipelineFeatures pipelineFeatures{ .graphicsPipelineLibrary = featureRequest.graphicsPipelineLibrary, .extendedDynamicState3 = featureRequest.extendedDynamicState3, .shaderObject = featureRequest.shaderObject };
+    if (pipelineFeatures.shaderObject) {
+        std::cout << "Graphics pipelines: shader objects, all state dynamic\n";
+    } else {
+        std::cout << "Graphics pipelines: " << (pipelineFeatures.graphicsPipelineLibrary ? "linked from libraries" : "monolithic")
+            << (pipelineFeatures.extendedDynamicState3 ? ", dynamic blend state" : "") << "\n";
+    }
+    chk(pipelineCompiler.create(device, &pipelineCache, &layoutCache, pipelineFeatures, "shadercache", useShaderCache, std::clamp(std::thread::hardware_concurrency(), 2u, 5u) - 1));
+    PipelineDesc sceneDesc{
+        .moduleName = "triangle",
+        .shaderPath = "assets/shader.slang",
+        .layout = pipelineLayout,
+        .specialization = sceneVariant.getConstants(),
+        .vertexBinding = vertexBinding,
+        .vertexAttributes = vertexAttributes,
+        .colorFormat = imageFormat,
+        .depthFormat = depthFormat
     };
 
-    // Use Pipeline wrapper to create the graphics pipeline
-    Pipeline pipelineHelper;
-    VkPipeline pipeline = pipelineHelper.createGraphics(device, pipelineLayout, shaderModule, vertexBinding, vertexAttributes, imageFormat, depthFormat);
-    if (pipeline == VK_NULL_HANDLE) {
+    // Overdraw visualization: fragment counting pass and heat map resolve.
+    // Not needed to get going, the renderer skips these passes' draws until
+    // they are ready.
+    PipelineHandle overdrawPipeline{ invalidPipelineHandle };
+    PipelineHandle overdrawResolvePipeline{ invalidPipelineHandle };
+    if (options.overdraw) {
+        PipelineDesc countDesc = sceneDesc;
+        countDesc.fragmentEntryPoint = "overdrawMain";
+        countDesc.depthTest = false;
+        countDesc.blend = BlendDesc::additive();
+        countDesc.colorFormat = overdrawTarget.getFormat();
+        countDesc.depthFormat = VK_FORMAT_UNDEFINED;
+        overdrawPipeline = pipelineCompiler.request(countDesc);
+        PipelineDesc resolveDesc = sceneDesc;
+        resolveDesc.vertexEntryPoint = "fullscreenMain";
+        resolveDesc.fragmentEntryPoint = "overdrawResolveMain";
+        resolveDesc.useVertexInput = false;
+        resolveDesc.depthTest = false;
+        resolveDesc.cullMode = VK_CULL_MODE_NONE;
+        resolveDesc.depthFormat = VK_FORMAT_UNDEFINED;
+        overdrawResolvePipeline = pipelineCompiler.request(resolveDesc);
+    }
+
+    // The scene pipeline is needed for the first frame, wait for it
+    PipelineHandle scenePipeline = pipelineCompiler.warmUp({ sceneDesc })[0];
+    if (pipelineCompiler.isFailed(scenePipeline)) {
         std::cerr << "Failed to create graphics pipeline" << '\n';
         chk(VK_ERROR_INITIALIZATION_FAILED);
     }
+    using ms = std::chrono::duration<double, std::milli>;
+    std::cout << "Shaders and scene pipeline ready in " << ms(std::chrono::steady_clock::now() - shaderStart).count() << " ms ("
+        << shaderCompiler.getCacheHits() + pipelineCompiler.getShaderCacheHits() << " shaders from cache, "
+        << shaderCompiler.getCompiledCount() + pipelineCompiler.getShadersCompiled() << " compiled)\n";
+    std::cout << "Scene shader variant: " << sceneVariant.getName() << " (V switches)\n";
+    if (benchmarkBinds) {
+        // Every scene shader variant, bound in turn with both backends
+        std::vector<PipelineDesc> variantDescs;
+        for (uint32_t key = 0; key < SceneShaderVariant::count; key++) {
+            // Keys that normalize to another one are the same pipeline
+            if (SceneShaderVariant::fromKey(key).getKey() != key) {
+                continue;
+            }
+            PipelineDesc desc = sceneDesc;
+            desc.specialization = SceneShaderVariant::fromKey(key).getConstants();
+            variantDescs.push_back(desc);
+        }
+        runBindBenchmark(device, queueFamily, &pipelineCache, &layoutCache, pipelineFeatures, variantDescs);
+    }
+
+    // Shader hot reload, edits to the sources in assets are picked up while running
+    ShaderWatcher shaderWatcher;
+    if (options.shaderHotReload && !shaderWatcher.create({ "assets" })) {
+        options.shaderHotReload = false;
+    }
+
+    // Worker threads for parallel command recording
+    if (options.gpuCulling && !(featureRequest.drawIndirectCount && featureRequest.drawIndirectFirstInstance)) {
+        std::cerr << "GPU culling needs drawIndirectCount and drawIndirectFirstInstance, which this device doesn't support, culling on the CPU\n";
+        options.gpuCulling = false;
+        options.cpuCulling = true;
+    }
+    if (options.gpuCulling && options.recordingThreads > 0) {
+        std::cerr << "GPU culled draws are recorded on the main thread, ignoring --record-threads\n";
+        options.recordingThreads = 0;
+    }
+    if (options.gpuCulling) {
+        options.cpuCulling = false;
+    }
+    // The visible set changes from frame to frame, so CPU culled draws can't be pre-recorded
+    if (options.cpuCulling && options.cachedCommands) {
+        std::cerr << "CPU culled draws are recorded every frame, ignoring --cached-commands\n";
+        options.cachedCommands = false;
+    }
+    if (options.cachedCommands && options.recordingThreads > 0) {
+        std::cerr << "Cached command buffers are recorded on the main thread, ignoring --record-threads\n";
+        options.recordingThreads = 0;
+    }
+    ParallelRecorder recorder;
+    if (options.recordingThreads > 0 && !recorder.create(device, queueFamily, options.recordingThreads, VulkanApp::maxFramesInFlight)) {
+        std::cerr << "Failed to create recording threads, recording on the main thread\n";
+        options.recordingThreads = 0;
+    }
+
+    // GPU scene, populated by the renderer
+    GpuScene scene;
+    if (!featureRequest.drawIndirectCount) {
+        std::cerr << "drawIndirectCount is not supported by this device, drawing the scene with plain indirect draws\n";
+    }
+    if (!featureRequest.drawIndirectFirstInstance) {
+        std::cerr << "drawIndirectFirstInstance is not supported by this device, drawing the scene with direct draws\n";
+    }
+    scene.create(device, allocator, &deletionQueue, featureRequest.drawIndirectCount, featureRequest.multiDrawIndirect, featureRequest.drawIndirectFirstInstance, options.deviceLocalScene);
+
+    // Compute culling of the scene, fills the indirect draws the scene pass executes
+    GpuCulling culling;
+    if (options.gpuCulling && !culling.create(physical, device, allocator, &pipelineCache, cullingShaderModule, depthFormat, options.occlusionCulling)) {
+        std::cerr << "Failed to create GPU culling, culling on the CPU\n";
+        options.gpuCulling = false;
+        options.cpuCulling = true;
+        options.cachedCommands = false;
+    }
+
+    // Pre-recorded command buffers. Secondaries from the recording threads are
+    // rewritten every frame, so they can't be referenced by cached primaries.
+    CommandCache commandCache;
+    if (options.cachedCommands && !commandCache.create(device, queueFamily, VulkanApp::maxFramesInFlight)) {
+        std::cerr << "Failed to create command cache, recording every frame\n";
+        options.cachedCommands = false;
+    }
 
     // Move render loop into Renderer class for cleaner separation of
     // responsibilities. The renderer operates on the Vulkan objects
@@ -257,33 +584,54 @@ int VulkanApp::run()
     ctx.queue = queue;
     ctx.allocator = allocator;
     ctx.swapchain = &swapHelper;
-    ctx.pipeline = pipeline;
+    ctx.scenePipeline = scenePipeline;
+    ctx.sceneDesc = sceneDesc;
+    ctx.sceneVariant = sceneVariant;
     ctx.pipelineLayout = pipelineLayout;
     ctx.descriptorSetTex = descriptorSetTex;
     ctx.vBuffer = vBuffer;
     ctx.vBufSize = vBufSize;
     ctx.indexCount = indexCount;
-    ctx.shaderDataBuffers = &shaderDataBuffers;
+    ctx.shaderDataBuffer = &shaderDataBuffer;
+    ctx.frameAllocator = &frameAllocator;
+    ctx.deletionQueue = &deletionQueue;
     ctx.commandBuffers = &commandBuffers;
     ctx.fences = &fences;
     ctx.presentSemaphores = &presentSemaphores;
     ctx.renderSemaphores = &renderSemaphores;
     ctx.surfaceCaps = &surfaceCaps;
+    ctx.scene = &scene;
+    ctx.meshBounds = glm::vec4(boundsCenter, boundsRadius);
+    ctx.options = options;
+    ctx.pipelineStats = &pipelineStats;
+    ctx.overdraw = &overdrawTarget;
+    ctx.recorder = &recorder;
+    ctx.commandCache = &commandCache;
+    ctx.culling = &culling;
+    ctx.pipelineCompiler = &pipelineCompiler;
+    ctx.shaderWatcher = &shaderWatcher;
+    ctx.overdrawPipeline = overdrawPipeline;
+    ctx.overdrawResolvePipeline = overdrawResolvePipeline;
 
-    int rendererExit = renderer.run(ctx);
+    // The benchmark only needs the setup above, skip to the tear down
+    int rendererExit = benchmarkBinds ? 0 : renderer.run(ctx);
     if (rendererExit != 0) {
         return rendererExit;
     }
 
     // Tear down
     chk(vkDeviceWaitIdle(device));
+    // Whatever the last frames retired
+    deletionQueue.destroy();
     for (auto i = 0; std::cmp_less(i, VulkanApp::maxFramesInFlight); i++) {
         vkDestroyFence(device, fences[i], nullptr);
         vkDestroySemaphore(device, presentSemaphores[i], nullptr);
-        vkDestroySemaphore(device, renderSemaphores[i], nullptr);
-        vmaUnmapMemory(allocator, shaderDataBuffers[i].allocation);
-        vmaDestroyBuffer(allocator, shaderDataBuffers[i].buffer, shaderDataBuffers[i].allocation);
     }
+    for (auto semaphore : renderSemaphores) {
+        vkDestroySemaphore(device, semaphore, nullptr);
+    }
+    shaderDataBuffer.destroy();
+    frameAllocator.destroy();
     // Swapchain helper owns swapchain images, image views and depth image.
     swapHelper.destroy(device, allocator);
     vmaDestroyBuffer(allocator, vBuffer, vBufferAllocation);
@@ -293,15 +641,28 @@ int VulkanApp::run()
         vkDestroySampler(device, texture.sampler, nullptr);
         vmaDestroyImage(allocator, texture.image, texture.allocation);
     }
-    vkDestroyDescriptorSetLayout(device, descriptorSetLayoutTex, nullptr);
     vkDestroyDescriptorPool(device, descriptorPool, nullptr);
-    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-    vkDestroyPipeline(device, pipeline, nullptr);
+    // Stop watching before the pipelines go
+    shaderWatcher.destroy();
+    // Owns all graphics pipelines
+    pipelineCompiler.destroy();
+    overdrawTarget.destroy(device);
+    // Pipeline and descriptor set layouts
+    layoutCache.destroy();
+    recorder.destroy();
+    commandCache.destroy();
+    culling.destroy();
+    scene.destroy();
+    pipelineStats.destroy(device);
+    // Writes the cache back for the next run
+    pipelineCache.destroy();
     // swapHelper.destroy already cleaned up the swapchain
     vkDestroySurfaceKHR(instance, surface, nullptr);
     // Explicitly destroy command pool before device destruction
     cmdPoolHelper.destroy();
-    vkDestroyShaderModule(device, shaderModule, nullptr);
+    if (cullingShaderModule != VK_NULL_HANDLE) {
+        vkDestroyShaderModule(device, cullingShaderModule, nullptr);
+    }
     vmaDestroyAllocator(allocator);
     vkDestroyDevice(device, nullptr);
     // Instance is destroyed automatically by InstanceWrapper destructor
@@ -24,16 +24,20 @@ struct Vertex {
 struct ShaderData {
     glm::mat4 projection;
     glm::mat4 view;
-    glm::mat4 model[3];
     glm::vec4 lightPos{ 0.0f, -10.0f, 10.0f, 0.0f };
+    // Device address of the frame's ObjectRecord array (see GpuScene)
+    VkDeviceAddress objects{ 0 };
     uint32_t selected{ 1 };
 };
 
-struct ShaderDataBuffer {
-    VmaAllocation allocation{ VK_NULL_HANDLE };
-    VkBuffer buffer{ VK_NULL_HANDLE };
-    VkDeviceAddress deviceAddress{};
-    void* mapped{ nullptr };
+// One indexed draw of the scene. The renderer keeps a list of these and may
+// split it across recording threads. firstInstance is the scene object index.
+struct DrawItem {
+    uint32_t indexCount{ 0 };
+    uint32_t instanceCount{ 1 };
+    uint32_t firstIndex{ 0 };
+    int32_t vertexOffset{ 0 };
+    uint32_t firstInstance{ 0 };
 };
 
 struct Texture {